@@ -7,6 +7,7 @@
 
 #include <cstdlib>
 #include <limits>
+#include <typeinfo>
 #include <cstdint>
 #include <sys/stat.h>
 
@@ -37,10 +38,11 @@ struct Record {
     }
 };
 
-enum OperationType {READ = 0, INSERT, UPDATE, DELETE};
+enum OperationType {READ = 0, INSERT, UPDATE, DELETE, SCAN};
 
 struct QueryType {
     OperationType op;
+    uint32_t len; // records of a SCAN
     int64_t key;
 };
 
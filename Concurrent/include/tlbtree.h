@@ -2,8 +2,11 @@
 #define __TLBTREE_H__
 
 #include "../src/tlbtree_impl.h"
+#include "../src/sharded_impl.h"
+#include "../src/trace.h"
 
 using tlbtree::TLBtreeImpl;
+using tlbtree::ShardedTLBtreeImpl;
 
 // configure the PMEM file and file size
 static constexpr uint64_t POOL_SIZE = 512UL * 1024 * 1024;
@@ -13,23 +16,28 @@ public:
     TLBtree(std::string tlbname, uint64_t poolsize = POOL_SIZE) {
         bool recover = file_exist(tlbname.c_str());
         tree_ = new TLBtreeImpl<2,2>(tlbname, recover, poolsize);
+        trace_ = NULL;
     }
 
     ~TLBtree() {
+        delete trace_;
         delete tree_;
     }
 
     inline void insert(_key_t key, uint64_t val) {
+        if(trace_ != NULL) trace_->record(INSERT, key, trace_digest(val));
         tree_->insert(key, val);
     }
 
     inline bool update(_key_t key, uint64_t val) {
+        if(trace_ != NULL) trace_->record(UPDATE, key, trace_digest(val));
         return tree_->update(key, val);
     }
 
     inline uint64_t lookup(_key_t key) {
         uint64_t val;
         bool found = tree_->find(key, val);
+        if(trace_ != NULL) trace_->record(READ, key, found ? trace_digest(val) : 0);
 
         if(found)
             return val;
@@ -38,11 +46,149 @@ public:
     }
 
     inline bool remove(_key_t key) {
+        if(trace_ != NULL) trace_->record(DELETE, key, 0);
         return tree_->remove(key);
     }
 
+    inline void scan(_key_t lo, _key_t hi, std::vector<Record> & out) { // records within [lo, hi)
+        if(trace_ != NULL) trace_->record(SCAN, lo, (uint64_t)hi);
+        tree_->scan(lo, hi, out);
+    }
+
+    /* record the following operations of each thread into the trace files <prefix>.<thread>, 
+       complete when the tree is closed. Call it before any concurrent operation */
+    inline void enable_trace(std::string prefix) {
+        trace_ = new TraceRecorder(prefix);
+    }
+
+    inline void enable_cache(size_t cache_size) { // DRAM budget in bytes of the hot record cache
+        tree_->enable_cache(cache_size);
+    }
+
+    inline double cache_hit_rate() const {
+        return tree_->cache() == NULL ? 0 : tree_->cache()->hit_rate();
+    }
+
+    inline bool is_rebuilding() const { // whether the top layer is being rebuilt now
+        return tree_->rebuilding();
+    }
+
+    inline void set_rebuild_listener(std::function<void(bool)> listener) { // told of the start and end of each rebuild
+        tree_->set_rebuild_listener(listener);
+    }
+
+    inline void enable_heatmap() { // sampled access heat of the key ranges of the subtrees
+        tree_->enable_heatmap();
+    }
+
+    /* write the heatmap to path, one line per sub-index tree in key order: the range [lo, hi), the
+       estimated reads and writes, and the splits, all decaying. Return false if it can not be written */
+    bool dump_heatmap(std::string path) {
+        std::vector<HeatRange> ranges;
+        tree_->heat_ranges(ranges);
+        FILE * f = fopen(path.c_str(), "w");
+        if(f == NULL) return false;
+        fprintf(f, "# lo hi reads writes splits\n");
+        for(const HeatRange & r : ranges)
+            fprintf(f, "%ld %ld %.0f %.0f %.0f\n", (long)r.lo, (long)r.hi, r.reads, r.writes, r.splits);
+        return fclose(f) == 0;
+    }
+
+    inline TreeStats stats() { // counters of the operations, the rebuildings and the space, see stats.h
+        return tree_->stats();
+    }
+
+    /* write the stats in the Prometheus text format to path, replaced at once so that a scraper
+       never reads a partial file. Return false if it can not be written */
+    bool export_stats(std::string path) {
+        std::string text = format_stats(tree_->stats());
+        std::string tmp = path + ".tmp";
+        FILE * f = fopen(tmp.c_str(), "w");
+        if(f == NULL) return false;
+        bool written = fwrite(text.data(), 1, text.size(), f) == text.size();
+        written = fclose(f) == 0 && written;
+        return written && rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    inline void enable_filters() { // a Bloom filter of the keys for absent keys
+        tree_->enable_filters();
+    }
+
+    inline void enable_tiering(std::string dram_file, size_t dram_size) { // DRAM replicas of read-hot subtrees
+        tree_->enable_tiering(dram_file.c_str(), dram_size);
+    }
+
+    inline void enable_spill(std::string spill_file, size_t pm_budget) { // spill cold subtrees to a file above a PM budget
+        tree_->enable_spill(spill_file.c_str(), pm_budget);
+    }
+
+    inline void enable_compression() { // pack cold subtrees into compressed blocks in PM
+        tree_->enable_compression();
+    }
+
+#if defined(__cpp_impl_coroutine)
+    inline coro::task<bool> lookup_async(_key_t key, uint64_t & val) {
+        return tree_->find_async(key, val);
+    }
+
+    inline coro::task<void> insert_async(_key_t key, uint64_t val) {
+        return tree_->insert_async(key, val);
+    }
+
+    inline coro::task<bool> update_async(_key_t key, uint64_t val) {
+        return tree_->update_async(key, val);
+    }
+#endif
+
 private:
     TLBtreeImpl <2,2> * tree_;
+    TraceRecorder * trace_; // NULL unless tracing
+};
+
+// a range-partitioned TLBtree, each shard is owned by one thread and stored in its own pool
+class ShardedTLBtree {
+public:
+    ShardedTLBtree(std::string tlbname, int shard_cnt = std::thread::hardware_concurrency(), uint64_t poolsize = POOL_SIZE) {
+        bool recover = file_exist((tlbname + ".route").c_str());
+        tree_ = new ShardedTLBtreeImpl<2,2>(tlbname, shard_cnt, recover, poolsize);
+    }
+
+    ~ShardedTLBtree() {
+        delete tree_;
+    }
+
+    inline void insert(_key_t key, uint64_t val) {
+        tree_->insert(key, val);
+    }
+
+    inline bool update(_key_t key, uint64_t val) {
+        return tree_->update(key, val);
+    }
+
+    inline uint64_t lookup(_key_t key) {
+        uint64_t val;
+        bool found = tree_->find(key, val);
+
+        if(found)
+            return val;
+        else 
+            return 0;
+    }
+
+    inline bool remove(_key_t key) {
+        return tree_->remove(key);
+    }
+
+    inline void scan(_key_t lo, _key_t hi, std::vector<Record> & out) { // records within [lo, hi), across the shards
+        tree_->scan(lo, hi, out);
+    }
+
+    inline bool rebalance() { // also done in the background
+        return tree_->rebalance();
+    }
+
+private:
+    ShardedTLBtreeImpl <2,2> * tree_;
 };
 
 #endif //__TLBTREE_H__
\ No newline at end of file
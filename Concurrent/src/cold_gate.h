@@ -0,0 +1,131 @@
+/*  cold_gate.h - Cold subtree tracking and the writer gate of their movers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __COLDGATE_H__
+#define __COLDGATE_H__
+
+#include <cstdint>
+#include <atomic>
+#include <unistd.h>
+
+#include "common.h"
+
+/*
+    ColdGate: what a mover needs to turn a cold sub-index tree into another form (spilled to a
+    file, or compressed) while other threads operate on the tree.
+
+    Coldness is a clock over the subroots: every operation sets the referenced bit hashed by its
+    subroot (a read-only check once set), the mover clears the bit of each subtree it passes and
+    moves the subtrees whose bit is still clear when it comes back.
+
+    Writers announce themselves on a stripe hashed by their subroot. The mover publishes the
+    subtree it is moving and waits for the announced writers of it to leave:
+
+        mover:  begin_move(root)    fence    drain(root)    move the subtree    end_move()
+        writer: enter(root)         fence    if moving() == root or root is cold: leave and fault it back
+
+    so a writer either sees the subtree being moved, or the mover waits for its write. Readers are
+    not announced here: they pin an Epoch (see epoch.h) while they search a subtree, and the mover
+    synchronizes it before it empties the PM nodes of a subtree it has published as cold.
+*/
+class ColdGate {
+public:
+    static const uint32_t DRAIN_US = 1000;     // the mover gives up a subtree whose writers stay longer
+    static const uint64_t ROUND_OPS = 1 << 16; // inserts per round if the caller runs the rounds
+    static const int ROUND_VISITS = 64;        // subtrees a round of packing visits
+    static const int STRIPES = 256;
+    static const int REF_SLOTS = 1 << 16;
+
+private:
+    struct stripe_t {
+        std::atomic<uint64_t> writers;
+        char padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    };
+
+    std::atomic<const void *> moving_;
+    stripe_t stripes_[STRIPES];
+    std::atomic<uint8_t> refs_[REF_SLOTS];  // referenced bits of the subtrees, cleared by the mover
+    uint64_t ops_;                          // used by a single owner only
+
+public:
+    ColdGate(): moving_(NULL), ops_(0) {
+        for(int i = 0; i < STRIPES; i++)
+            stripes_[i].writers.store(0, std::memory_order_relaxed);
+        for(int i = 0; i < REF_SLOTS; i++)
+            refs_[i].store(0, std::memory_order_relaxed);
+    }
+
+    /* mark the sub-index tree rooted at root as used */
+    inline void touch(const void * root) {
+        std::atomic<uint8_t> & r = refs_[ref_of(root)];
+        if(r.load(std::memory_order_relaxed) == 0)
+            r.store(1, std::memory_order_relaxed);
+    }
+
+    /* clear the referenced bit of a subtree, return whether it was set */
+    inline bool second_chance(const void * root) {
+        std::atomic<uint8_t> & r = refs_[ref_of(root)];
+        if(r.load(std::memory_order_relaxed) == 0) return false;
+        r.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    inline const void * moving() const {
+        return moving_.load(std::memory_order_acquire);
+    }
+
+    /* announce a writer of the subtree rooted at root, return the stripe to leave() */
+    inline int enter(const void * root) {
+        int s = stripe_of(root);
+        stripes_[s].writers.fetch_add(1, std::memory_order_seq_cst); // a full fence before checking moving()
+        return s;
+    }
+
+    inline void leave(int s) {
+        stripes_[s].writers.fetch_sub(1, std::memory_order_release);
+    }
+
+    /* wait until the move of the subtree rooted at root, if any, has ended */
+    inline void wait_moving(const void * root) const {
+        while(moving_.load(std::memory_order_acquire) == root)
+            usleep(10);
+    }
+
+    /* publish the subtree rooted at root as moving, writers that come later wait for the move */
+    inline void begin_move(const void * root) {
+        moving_.store(root, std::memory_order_seq_cst);
+    }
+
+    /* wait for the announced writers of the two subtrees, false if they do not leave in time */
+    bool drain(const void * root, const void * prev) {
+        for(uint32_t waited = 0; ; waited += 10) {
+            bool idle = stripes_[stripe_of(root)].writers.load(std::memory_order_acquire) == 0
+                && (prev == NULL || stripes_[stripe_of(prev)].writers.load(std::memory_order_acquire) == 0);
+            if(idle) return true;
+            if(waited >= DRAIN_US) return false;
+            usleep(10);
+        }
+    }
+
+    inline void end_move() {
+        moving_.store(NULL, std::memory_order_release);
+    }
+
+    /* a single owner runs a round of moves once per ROUND_OPS inserts */
+    inline bool tick() {
+        return ++ops_ % ROUND_OPS == 0;
+    }
+
+private:
+    static inline int stripe_of(const void * root) { // nodes are 256B aligned
+        return (((uint64_t)root >> 8) * 0x9E3779B97F4A7C15ULL >> 32) % STRIPES;
+    }
+
+    static inline int ref_of(const void * root) {
+        return (((uint64_t)root >> 8) * 0x9E3779B97F4A7C15ULL >> 32) % REF_SLOTS;
+    }
+};
+
+#endif //__COLDGATE_H__
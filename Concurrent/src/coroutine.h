@@ -0,0 +1,137 @@
+/*  coroutine.h - awaitable tasks for interleaving index operations
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES, 
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <xmmintrin.h>
+
+#include "common.h"
+
+namespace coro {
+
+/*  task<T>: a lazily started coroutine.
+
+    A task suspends every time it is about to touch a node it has only prefetched, and gives
+    the control back to whoever resumed it. A scheduler keeps several tasks in flight and 
+    resumes them in turn, so that the PM miss of one operation overlaps the work of others.
+
+    Tasks can also be co_awaited by other tasks. resume() always continues the innermost 
+    running task of the chain, so a scheduler only needs to know the outermost one.
+*/
+struct promise_base {
+    std::coroutine_handle<> continuation_ = nullptr; // the awaiting task, if any
+    promise_base * root_ = this;                     // the outermost task of the chain
+    std::coroutine_handle<> active_ = nullptr;       // innermost running task, valid in the root
+
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            promise_base & p = h.promise();
+            if(p.continuation_) {
+                p.root_->active_ = p.continuation_;
+                return p.continuation_;
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template<typename T>
+struct promise_value : public promise_base {
+    T value_;
+    void return_value(T v) { value_ = std::move(v); }
+    T result() { return std::move(value_); }
+};
+
+template<>
+struct promise_value<void> : public promise_base {
+    void return_void() {}
+    void result() {}
+};
+
+template<typename T = void>
+class task {
+public:
+    struct promise_type : public promise_value<T> {
+        task get_return_object() { 
+            this->active_ = handle_t::from_promise(*this);
+            return task(handle_t::from_promise(*this)); 
+        }
+    };
+    typedef std::coroutine_handle<promise_type> handle_t;
+
+    task(task && other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+    task & operator = (task && other) noexcept {
+        if(this != &other) {
+            if(h_) h_.destroy();
+            h_ = std::exchange(other.h_, nullptr);
+        }
+        return *this;
+    }
+    task(const task &) = delete;
+    task & operator = (const task &) = delete;
+    ~task() { if(h_) h_.destroy(); }
+
+    // run the task until its next suspension point, return false if it has finished
+    bool resume() {
+        if(!h_.done()) h_.promise().active_.resume();
+        return !h_.done();
+    }
+
+    bool done() const { return h_.done(); }
+
+    T result() { return h_.promise().result(); }
+
+    // awaiting a task runs it as a part of the awaiting one
+    bool await_ready() const noexcept { return false; }
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiting) noexcept {
+        promise_base & parent = awaiting.promise();
+        h_.promise().continuation_ = awaiting;
+        h_.promise().root_ = parent.root_;
+        parent.root_->active_ = h_;
+        return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+
+private:
+    explicit task(handle_t h): h_(h) {}
+
+    handle_t h_;
+};
+
+/*  co_await prefetch(addr, size): issue prefetches for [addr, addr + size) and suspend,
+    the memory is expected to be in cache when the task is resumed */
+struct prefetch {
+    const void * addr_;
+    int size_;
+
+    prefetch(const void * addr, int size = CACHE_LINE_SIZE): addr_(addr), size_(size) {}
+
+    bool await_ready() const noexcept { return addr_ == nullptr; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {
+        const char * ptr = (const char *)((uint64_t)addr_ & ~(uint64_t)(CACHE_LINE_SIZE - 1));
+        for(; ptr < (const char *)addr_ + size_; ptr += CACHE_LINE_SIZE)
+            _mm_prefetch(ptr, _MM_HINT_T0);
+    }
+    void await_resume() const noexcept {}
+};
+
+} // namespace coro
+
+#endif // __cpp_impl_coroutine
+
+#endif // __COROUTINE_H__
@@ -0,0 +1,345 @@
+/*  dram_tier.h - A DRAM tier of hot sub-index trees in front of the PM down layer
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __DRAMTIER_H__
+#define __DRAMTIER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "spinlock.h"
+
+/*
+    DramTier: replicas of read-hot sub-index trees, kept in a DRAM region mapped from a file
+    (e.g. on /dev/shm), so that two mmap'd files make up the two tiers.
+
+    A replica is the sorted records of one sub-index tree, looked up by the address of its
+    subroot. The PM sub-index tree stays the persistent copy: a write goes to PM first and then
+    drops the replica, so nothing in DRAM has to be recovered and write-hot subtrees stay on PM.
+
+    Hotness is tracked by sampling finds into a direct-mapped table of access counters. A mover
+    periodically calls round() to pick the hottest subtrees that are not replicated, and builds
+    each of them between begin_promote() and end_promote():
+
+        mover:   begin_promote (publish BUILDING)   fence   scan the PM subtree   end_promote (READY)
+        writer:  write PM                           fence   invalidate (DEAD)
+
+    so either the scan sees the write, or the writer sees the replica and kills it. A replica that
+    is dropped, or demoted to make room for a hotter one, is reclaimed one round later.
+*/
+class DramTier {
+public:
+    enum {MISS = 0, FOUND, ABSENT}; // results of lookup()
+
+    static const uint32_t SAMPLE_RATE = 16;     // one of SAMPLE_RATE finds is recorded
+    static const uint32_t PROMOTE_HEAT = 4;     // sampled finds of a subtree in a round to promote it
+    static const uint32_t ROUND_SAMPLES = 4096; // samples per round if the caller runs the rounds
+    static const int HEAT_SLOTS = 4096;
+    static const int MAX_PROMOTE = 256;         // promotions per round
+
+private:
+    enum {FREE = 0, BUILDING, READY, DEAD};
+
+    struct replica_t {
+        std::atomic<uint64_t> state;  // generation << 2 | FREE/BUILDING/READY/DEAD
+        std::atomic<uint32_t> hits;   // sampled hits in this round, the coldest replica is demoted first
+        uint32_t count;
+        const void * root;
+        // followed by _key_t keys[cap_] and uint64_t vals[cap_]
+    };
+
+    struct heat_t {
+        std::atomic<const void *> root;
+        std::atomic<uint32_t> heat;
+    };
+
+    int fd_;
+    char * region_;
+    size_t region_size_;
+    size_t slot_size_;
+    uint32_t cap_;                      // records per replica
+    uint32_t slot_cnt_;
+    std::atomic<uint32_t> * index_;     // subroot hash => slot id + 1, 0 if none
+    uint64_t index_mask_;
+    heat_t heat_[HEAT_SLOTS];
+    std::atomic<uint32_t> samples_;
+
+    // used by the mover only
+    std::vector<uint32_t> free_slots_;
+    std::vector<uint32_t> dead_slots_;  // reclaimed at the next round
+    uint64_t promotions_, demotions_;
+
+public:
+    /*
+     *  @param file     the file to map the DRAM region from, its content is discarded
+     *  @param budget   size of the DRAM region in bytes
+     *  @param cap      the maximum records of a sub-index tree
+     */
+    DramTier(const char * file, size_t budget, uint32_t cap): cap_(cap), samples_(0), promotions_(0), demotions_(0) {
+        slot_size_ = (sizeof(replica_t) + cap * (sizeof(_key_t) + sizeof(uint64_t)) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+        slot_cnt_ = std::max((size_t)1, budget / slot_size_);
+        region_size_ = slot_cnt_ * slot_size_;
+
+        fd_ = open(file, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
+        if(fd_ < 0 || ftruncate(fd_, region_size_) != 0) {
+            printf("can not create the DRAM tier file %s\n", file);
+            exit(-1);
+        }
+        region_ = (char *)mmap(NULL, region_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if(region_ == MAP_FAILED) {
+            printf("can not map the DRAM tier file %s\n", file);
+            exit(-1);
+        }
+
+        uint64_t index_size = 1;
+        while(index_size < 4 * (uint64_t)slot_cnt_) index_size *= 2;
+        index_ = new std::atomic<uint32_t>[index_size];
+        index_mask_ = index_size - 1;
+        for(uint64_t i = 0; i < index_size; i++)
+            index_[i].store(0, std::memory_order_relaxed);
+
+        for(uint32_t i = 0; i < slot_cnt_; i++) {
+            new (slot(i)) replica_t;
+            slot(i)->state.store(FREE, std::memory_order_relaxed);
+            slot(i)->hits.store(0, std::memory_order_relaxed);
+            free_slots_.push_back(slot_cnt_ - 1 - i);
+        }
+        for(int i = 0; i < HEAT_SLOTS; i++) {
+            heat_[i].root.store(NULL, std::memory_order_relaxed);
+            heat_[i].heat.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~DramTier() {
+        delete [] index_;
+        munmap(region_, region_size_);
+        close(fd_);
+    }
+
+    /* search the replica of the sub-index tree rooted at root, MISS if it is not replicated */
+    int lookup(const void * root, const _key_t & k, uint64_t & v) const {
+        uint32_t id = index_[index_of(root)].load(std::memory_order_acquire);
+        if(id == 0) return MISS;
+
+        replica_t * r = slot(id - 1);
+        uint64_t st = r->state.load(std::memory_order_acquire);
+        if((st & 3) != READY || r->root != root) return MISS;
+
+        const _key_t * keys = keys_of(r);
+        uint32_t cnt = std::min(r->count, cap_); // the slot may be reused while we search it
+        uint32_t pos = std::lower_bound(keys, keys + cnt, k) - keys;
+        bool found = pos < cnt && keys[pos] == k;
+        if(found) v = vals_of(r)[pos];
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(r->state.load(std::memory_order_relaxed) != st) return MISS;
+        return found ? FOUND : ABSENT;
+    }
+
+    /* sample a find on the sub-index tree rooted at root, return true once per ROUND_SAMPLES
+       samples, when a caller without a background mover should run round() */
+    inline bool record(const void * root) {
+        if(Backoff::next_random() % SAMPLE_RATE != 0) return false;
+
+        uint32_t id = index_[index_of(root)].load(std::memory_order_relaxed);
+        if(id != 0 && slot(id - 1)->root == root) { // replicated, count a hit of it
+            slot(id - 1)->hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            heat_t & h = heat_of(root);
+            if(h.root.load(std::memory_order_relaxed) == root) {
+                h.heat.fetch_add(1, std::memory_order_relaxed);
+            } else { // compete for the counter, the one with a larger heat keeps it
+                uint32_t cur = h.heat.load(std::memory_order_relaxed);
+                if(cur <= 1) {
+                    h.root.store(root, std::memory_order_relaxed);
+                    h.heat.store(1, std::memory_order_relaxed);
+                } else {
+                    h.heat.store(cur - 1, std::memory_order_relaxed);
+                }
+            }
+        }
+        return samples_.fetch_add(1, std::memory_order_relaxed) % ROUND_SAMPLES == ROUND_SAMPLES - 1;
+    }
+
+    /* drop the replica of the sub-index tree rooted at root, called after it is written */
+    void invalidate(const void * root) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // order the PM write before reading the index
+        uint32_t id = index_[index_of(root)].load(std::memory_order_relaxed);
+        if(id == 0) return ;
+
+        replica_t * r = slot(id - 1);
+        uint64_t st = r->state.load(std::memory_order_acquire);
+        while(((st & 3) == BUILDING || (st & 3) == READY) && r->root == root) {
+            if(r->state.compare_exchange_weak(st, (st & ~3UL) | DEAD, std::memory_order_acq_rel))
+                break;
+        }
+
+        // a written subtree has to be read hot again to come back
+        heat_t & h = heat_of(root);
+        if(h.root.load(std::memory_order_relaxed) == root && h.heat.load(std::memory_order_relaxed) != 0)
+            h.heat.store(0, std::memory_order_relaxed);
+    }
+
+    /* reclaim the replicas dropped before the last round, return the hottest subtrees that are
+       not replicated and cool all the counters down. Called by one mover at a time */
+    void round(std::vector<const void *> & hot) {
+        for(uint32_t id : dead_slots_) { // readers have left them for a round
+            replica_t * r = slot(id);
+            r->state.store(((r->state.load(std::memory_order_relaxed) >> 2) + 1) << 2 | FREE, std::memory_order_release);
+            free_slots_.push_back(id);
+        }
+        dead_slots_.clear();
+        for(uint32_t id = 0; id < slot_cnt_; id++) {
+            replica_t * r = slot(id);
+            if((r->state.load(std::memory_order_acquire) & 3) == DEAD) {
+                unlink(id);
+                dead_slots_.push_back(id);
+            }
+        }
+
+        std::vector<std::pair<uint32_t, const void *>> cands;
+        for(int i = 0; i < HEAT_SLOTS; i++) {
+            uint32_t heat = heat_[i].heat.load(std::memory_order_relaxed);
+            const void * root = heat_[i].root.load(std::memory_order_relaxed);
+            if(heat >= PROMOTE_HEAT && root != NULL && !replicated(root))
+                cands.push_back({heat, root});
+            heat_[i].heat.store(heat / 2, std::memory_order_relaxed);
+        }
+        std::sort(cands.begin(), cands.end(), [](const std::pair<uint32_t, const void *> & a, const std::pair<uint32_t, const void *> & b) {
+            return a.first > b.first;
+        });
+
+        hot.clear();
+        for(int i = 0; i < (int)cands.size() && i < MAX_PROMOTE; i++)
+            hot.push_back(cands[i].second);
+
+        for(uint32_t id = 0; id < slot_cnt_; id++)
+            slot(id)->hits.store(slot(id)->hits.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+
+    /* publish an empty replica of the sub-index tree rooted at root, -1 if the DRAM tier is full,
+       in which case the coldest replica is demoted to make room at the next round */
+    int begin_promote(const void * root) {
+        if(free_slots_.empty()) {
+            demote_coldest();
+            return -1;
+        }
+        uint32_t id = free_slots_.back();
+        free_slots_.pop_back();
+
+        replica_t * r = slot(id);
+        uint64_t gen = r->state.load(std::memory_order_relaxed) >> 2;
+        r->root = root;
+        r->count = 0;
+        r->hits.store(PROMOTE_HEAT, std::memory_order_relaxed); // not demoted before it is used
+        r->state.store(gen << 2 | BUILDING, std::memory_order_release);
+
+        heat_of(root).heat.store(0, std::memory_order_relaxed);
+
+        uint32_t old = index_[index_of(root)].exchange(id + 1, std::memory_order_acq_rel);
+        if(old != 0) kill(old - 1); // the replica of another subtree hashed here
+
+        std::atomic_thread_fence(std::memory_order_seq_cst); // order the publication before the scan
+        return id;
+    }
+
+    /* fill the replica with the records of the subtree scanned after begin_promote() */
+    void end_promote(int id, const std::vector<Record> & records) {
+        replica_t * r = slot(id);
+        if(records.size() > cap_) { // can not be replicated
+            kill(id);
+            return ;
+        }
+
+        _key_t * keys = keys_of(r);
+        uint64_t * vals = vals_of(r);
+        for(uint32_t i = 0; i < records.size(); i++) {
+            keys[i] = records[i].key;
+            vals[i] = (uint64_t)records[i].val;
+        }
+        r->count = records.size();
+
+        uint64_t st = r->state.load(std::memory_order_relaxed);
+        if((st & 3) == BUILDING && r->state.compare_exchange_strong(st, (st & ~3UL) | READY, std::memory_order_release))
+            promotions_ += 1;
+    }
+
+    inline void get_stats(uint64_t & promotions, uint64_t & demotions) const {
+        promotions = promotions_;
+        demotions = demotions_;
+    }
+
+    inline size_t capacity() const { // in sub-index trees
+        return slot_cnt_;
+    }
+
+private:
+    inline replica_t * slot(uint32_t id) const {
+        return (replica_t *)(region_ + id * slot_size_);
+    }
+
+    inline _key_t * keys_of(replica_t * r) const {
+        return (_key_t *)(r + 1);
+    }
+
+    inline uint64_t * vals_of(replica_t * r) const {
+        return (uint64_t *)(keys_of(r) + cap_);
+    }
+
+    inline uint64_t index_of(const void * root) const { // nodes are 256B aligned
+        return (((uint64_t)root >> 8) * 0x9E3779B97F4A7C15ULL >> 20) & index_mask_;
+    }
+
+    inline heat_t & heat_of(const void * root) {
+        return heat_[((uint64_t)root >> 8) % HEAT_SLOTS];
+    }
+
+    inline bool replicated(const void * root) const {
+        uint32_t id = index_[index_of(root)].load(std::memory_order_relaxed);
+        return id != 0 && slot(id - 1)->root == root;
+    }
+
+    void kill(uint32_t id) {
+        replica_t * r = slot(id);
+        uint64_t st = r->state.load(std::memory_order_acquire);
+        while((st & 3) == BUILDING || (st & 3) == READY) {
+            if(r->state.compare_exchange_weak(st, (st & ~3UL) | DEAD, std::memory_order_acq_rel))
+                break;
+        }
+    }
+
+    void unlink(uint32_t id) { // remove a dead replica from the index, if it is still there
+        uint32_t expected = id + 1;
+        index_[index_of(slot(id)->root)].compare_exchange_strong(expected, 0, std::memory_order_acq_rel);
+    }
+
+    void demote_coldest() {
+        int coldest = -1;
+        uint32_t min_hits = PROMOTE_HEAT;
+        for(uint32_t id = 0; id < slot_cnt_; id++) {
+            replica_t * r = slot(id);
+            uint32_t hits = r->hits.load(std::memory_order_relaxed);
+            if((r->state.load(std::memory_order_relaxed) & 3) == READY && hits < min_hits) {
+                min_hits = hits;
+                coldest = id;
+            }
+        }
+        if(coldest >= 0) {
+            kill(coldest);
+            demotions_ += 1;
+        }
+    }
+};
+
+#endif //__DRAMTIER_H__
@@ -0,0 +1,112 @@
+/*  epoch.h - Grace periods for the structures TLBtree frees under its readers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <emmintrin.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "thread_slots.h"
+
+/*
+    Epoch: a reader pins the current epoch before it reaches a structure that may be unlinked, and
+    unpins it when it no longer holds a pointer into it. A writer unlinks the structure, calls
+    synchronize() and then frees it:
+
+        reader: e = epoch   pins[e & 1] += 1 (fence)   if epoch != e: unpin, retry   ...   pins[e & 1] -= 1
+        writer: unlink      epoch += 1 (fence)        wait until the pins of the old parity are 0    free
+
+    so a reader either pinned before the flip, and is waited for, or sees the new epoch, and
+    reads what the writer published before it. The pins are counted per thread slot, and a pin
+    is a ticket, so it may be released by another thread (a task resumed elsewhere) and several
+    tasks of one thread may be pinned at the same time. synchronize() only waits for the readers
+    that pinned before it, later ones count on the other parity.
+
+    NoEpoch is its single owner counterpart: nothing is freed while the owner reads it.
+*/
+class Epoch {
+public:
+    Epoch(): epoch_(0) {
+        for(int i = 0; i < ThreadSlots::MAX; i++) {
+            slots_[i].pins[0].store(0, std::memory_order_relaxed);
+            slots_[i].pins[1].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /* pin the current epoch, return the ticket to leave() */
+    inline uint32_t enter() {
+        int id = ThreadSlots::id();
+        slot_t & s = slots_[id];
+        while(true) {
+            uint64_t e = epoch_.load(std::memory_order_relaxed);
+            s.pins[e & 1].fetch_add(1, std::memory_order_seq_cst); // a full fence before checking the epoch
+            if(epoch_.load(std::memory_order_seq_cst) == e)
+                return (uint32_t)id << 1 | (e & 1);
+            s.pins[e & 1].fetch_sub(1, std::memory_order_relaxed); // a writer has flipped it meanwhile
+        }
+    }
+
+    inline void leave(uint32_t ticket) {
+        slots_[ticket >> 1].pins[ticket & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    /* wait until the readers pinned at the moment of the call have left */
+    void synchronize() {
+        std::lock_guard<std::mutex> l(mtx_);
+        uint64_t e = epoch_.load(std::memory_order_relaxed);
+        epoch_.store(e + 1, std::memory_order_seq_cst);
+
+        for(uint32_t spins = 0; pinned(e & 1); spins++) {
+            if(spins < 64) _mm_pause();
+            else usleep(10);
+        }
+    }
+
+private:
+    struct slot_t {
+        std::atomic<int64_t> pins[2];
+        char padding[CACHE_LINE_SIZE - 2 * sizeof(int64_t)];
+    };
+
+    inline bool pinned(int parity) const {
+        int cnt = ThreadSlots::count();
+        for(int i = 0; i < cnt; i++)
+            if(slots_[i].pins[parity].load(std::memory_order_acquire) != 0) return true;
+        return false;
+    }
+
+    std::atomic<uint64_t> epoch_;
+    std::mutex mtx_;
+    slot_t slots_[ThreadSlots::MAX];
+};
+
+class NoEpoch {
+public:
+    inline uint32_t enter() { return 0; }
+    inline void leave(uint32_t ticket) { (void)ticket; }
+    inline void synchronize() {}
+};
+
+/* pins epoch (if not NULL) for its scope, which may span the suspensions of a task */
+template<typename E>
+class EpochGuard {
+public:
+    EpochGuard(E * epoch): epoch_(epoch), ticket_(epoch != NULL ? epoch->enter() : 0) {}
+    ~EpochGuard() { if(epoch_ != NULL) epoch_->leave(ticket_); }
+
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard & operator = (const EpochGuard &) = delete;
+
+private:
+    E * epoch_;
+    uint32_t ticket_;
+};
+
+#endif //__EPOCH_H__
@@ -12,13 +12,15 @@
 #include <vector>
 #include <cassert>
 #include <cstring>
+#include <atomic>
 
 #include "flush.h"
 #include "pmallocator.h"
+#include "policy.h"
 
 namespace fixtree {
     const int INNER_CARD = 32; // node size: 256B, the fanout of inner node is 32
-    const int LEAF_CARD = 15;  // node size: 256B, the fanout of leaf node is 16
+    const int LEAF_CARD = 15;  // node size: 256B, the fanout of leaf node is 15
     const int LEAF_REBUILD_CARD = 8;
     const int MAX_HEIGHT = 10;
 
@@ -32,7 +34,9 @@ namespace fixtree {
 
 /*  Fixtree: 
         a search-optimized linearize tree structure which can absort moderate insertions: 
+        the leaf latches and versions are those of Policy, see policy.h
 */
+template<typename Policy>
 class Fixtree {
     public:
         struct INNode { // inner node is packed keys, which is very compact
@@ -41,16 +45,23 @@ class Fixtree {
 
         struct LFNode { // leaf node is packed key-ptr along with a header. 
                         // leaf node has some gap to absort insert
-            Spinlock mtx;
-            uint64_t node_version;
+            uint64_t reserved[2]; // unused header, the latch and version live in LFMeta
             _key_t keys[LEAF_CARD];
             char * vals[LEAF_CARD];
         } __attribute__((aligned(CACHE_LINE_SIZE)));
 
+        struct LFMeta { // volatile latch and version of a leaf node, padded to a cache line
+                        // so that locking a leaf does not invalidate the keys readers search
+            typename Policy::mutex_t mtx;
+            typename Policy::counter_t node_version; // odd while a writer is modifying the leaf
+            LFMeta(): node_version(0) {}
+        } __attribute__((aligned(CACHE_LINE_SIZE)));
+
     public:
         // volatile structures
         INNode * inner_nodes_;
         LFNode * leaf_nodes_;
+        LFMeta * leaf_meta_;
         uint32_t height_;
         uint32_t leaf_cnt_;
         entrance_t * entrance_;
@@ -62,6 +73,7 @@ class Fixtree {
             leaf_nodes_ = (LFNode *)galc->absolute(ent->leaf_buff);
             height_ = ent->height;
             leaf_cnt_ = ent->leaf_cnt;
+            leaf_meta_ = new LFMeta[leaf_cnt_];
             entrance_ = ent;
 
             uint32_t tmp = 0;
@@ -125,6 +137,7 @@ class Fixtree {
             }
             
             leaf_cnt_ = lfnode_cnt;
+            leaf_meta_ = new LFMeta[leaf_cnt_];
             entrance_ = (entrance_t *)galc->malloc(4096); // the allocator is not thread_safe, allocate a large entrance
             uint32_t tmp = 0;
             for(int l = 0; l < height_; l++) {
@@ -141,6 +154,10 @@ class Fixtree {
             return ;
         }
 
+        ~Fixtree() {
+            delete [] leaf_meta_;
+        }
+
     public:
         char ** find_lower(_key_t key) const { 
             /* linear search, return the position of the stored value */
@@ -156,6 +173,26 @@ class Fixtree {
             return leaf_search(cur_idx, key);
         }
 
+        /* find_lower one level at a time, used by the asynchronous operations to prefetch the 
+           next node before touching it: start at root_index(), descend() height_ times and then 
+           call leaf_lower() with the returned leaf index */
+        inline uint32_t root_index() const { 
+            return level_offset_[0]; 
+        }
+
+        inline uint32_t descend(int level, uint32_t cur_idx, _key_t key) const {
+            uint32_t child_idx = level_offset_[level + 1] + (cur_idx - level_offset_[level]) * INNER_CARD + inner_search(cur_idx, key);
+            return level + 1 == height_ ? child_idx - level_offset_[height_] : child_idx;
+        }
+
+        inline const void * node_addr(int level, uint32_t idx) const { // level height_ is the leaf level
+            return level == height_ ? (const void *)(leaf_nodes_ + idx) : (const void *)(inner_nodes_ + idx);
+        }
+
+        inline char ** leaf_lower(uint32_t leaf_idx, _key_t key) const {
+            return leaf_search(leaf_idx, key);
+        }
+
         bool insert(_key_t key, uint64_t val) {
             uint32_t cur_idx = level_offset_[0];
             for(int l = 0; l < height_; l++) {
@@ -167,13 +204,17 @@ class Fixtree {
             cur_idx -= level_offset_[height_];
             
             LFNode * cur_leaf = leaf_nodes_ + cur_idx;
+            LFMeta * cur_meta = leaf_meta_ + cur_idx;
 
             for(int i = 0; i < LEAF_CARD; i++) {
                 if (cur_leaf->keys[i] == MAX_KEY) { // empty slot
-                    cur_leaf->mtx.lock();
-                        leaf_insert(cur_idx, i, {key, (char *)val});
-                    cur_leaf->node_version++;
-                    cur_leaf->mtx.unlock();
+                    cur_meta->mtx.lock();
+                    if(cur_leaf->keys[i] != MAX_KEY) { // taken by another writer, look for the next one
+                        cur_meta->mtx.unlock();
+                        continue;
+                    }
+                    leaf_insert(cur_idx, i, {key, (char *)val});
+                    cur_meta->mtx.unlock();
                     return true;
                 }
             }
@@ -191,8 +232,9 @@ class Fixtree {
             cur_idx -= level_offset_[height_];
             
             LFNode * cur_leaf = leaf_nodes_ + cur_idx;
+            LFMeta * cur_meta = leaf_meta_ + cur_idx;
 
-            cur_leaf->mtx.lock();
+            cur_meta->mtx.lock();
 
             _key_t max_leqkey = cur_leaf->keys[0];
             int8_t max_leqi = 0;
@@ -211,15 +253,18 @@ class Fixtree {
                   1. | k1 | --- | kx |, delete k1, leaf is not empty if k1 is deleted (fail)
                   2. | k1 | ---      |, delete k1, leaf is empty if k1 is deleted (success)
                   3. | k1 | --- | kx |, delete kx, leaf is not empty if kx is deleted (success)
+               the leftmost subroot (MIN_KEY) is never deleted, every key must have a lower one
             */
-            if(max_leqi == 0 && rec_cnt > 1) { // case 1
-                cur_leaf->mtx.unlock();
+            if((max_leqi == 0 && rec_cnt > 1) || max_leqkey == MIN_KEY) { // case 1
+                cur_meta->mtx.unlock();
                 return false;
             } else { // case 2, 3
-                persist_assign(&(cur_leaf->keys[max_leqi]), MAX_KEY);
+                cur_meta->node_version.fetch_add(1, std::memory_order_acq_rel);
+                cur_leaf->keys[max_leqi] = MAX_KEY;
+                cur_meta->node_version.fetch_add(1, std::memory_order_release);
+                clwb(&(cur_leaf->keys[max_leqi]), sizeof(_key_t)); // readers do not wait for the flush
                 
-                cur_leaf->node_version++;
-                cur_leaf->mtx.unlock();
+                cur_meta->mtx.unlock();
                 return true;
             }
         }
@@ -318,9 +363,14 @@ class Fixtree {
         
         char **leaf_search(int node_idx, _key_t key) const {
             LFNode * cur_leaf = leaf_nodes_ + node_idx;
+            const LFMeta * cur_meta = leaf_meta_ + node_idx;
 
             retry:
-            auto old_version = cur_leaf->node_version;
+            auto old_version = cur_meta->node_version.load(std::memory_order_acquire);
+            if (old_version % 2 != 0) { // a writer is modifying the leaf
+                _mm_pause();
+                goto retry;
+            }
 
             _key_t max_leqkey = cur_leaf->keys[0];
             int8_t max_leqi = 0;
@@ -331,17 +381,24 @@ class Fixtree {
                 }
             }
 
-            if (old_version != cur_leaf->node_version) goto retry;
+            Policy::acquire_fence();
+            if (old_version != cur_meta->node_version.load(std::memory_order_relaxed)) goto retry;
             
             return (char **) &(cur_leaf->vals[max_leqi]);
         }
 
-        void leaf_insert(int node_idx, int off, Record rec) { // TODO: should do it in a CAS way
+        void leaf_insert(int node_idx, int off, Record rec) { // the latch of the leaf is held
+            LFMeta * cur_meta = leaf_meta_ + node_idx;
+
+            // a reader never picks the value of an empty slot, so the value is written and 
+            // persisted before the version turns odd, and the key flushed after it turns even
             leaf_nodes_[node_idx].vals[off] = rec.val;
             clwb(&leaf_nodes_[node_idx].vals[off], 8);
             mfence();
 
+            cur_meta->node_version.fetch_add(1, std::memory_order_acq_rel);
             leaf_nodes_[node_idx].keys[off] = rec.key;
+            cur_meta->node_version.fetch_add(1, std::memory_order_release);
             clwb(&leaf_nodes_[node_idx].keys[off], 8);
             mfence();
         }
@@ -376,11 +433,13 @@ class Fixtree {
         }
 };
 
-inline entrance_t * get_entrance(Fixtree * tree) {
+template<typename Policy>
+inline entrance_t * get_entrance(Fixtree<Policy> * tree) {
     return tree->entrance_;
 }
 
-inline void free(Fixtree * tree) {
+template<typename Policy>
+inline void free(Fixtree<Policy> * tree) {
     entrance_t * upent = get_entrance(tree);
     delete tree;
 
@@ -391,7 +450,8 @@ inline void free(Fixtree * tree) {
     return ;
 }
 
-typedef Fixtree uptree_t;
+template<typename Policy>
+using uptree_t = Fixtree<Policy>;
 
 } // namespace fixtree
 
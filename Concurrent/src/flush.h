@@ -4,9 +4,12 @@
 #include <x86intrin.h>
 
 #include "common.h"
+#include "phase_timer.h"
 
 static inline void mfence() {
+    PHASE_BEGIN(t);
     asm volatile("sfence" ::: "memory");
+    PHASE_END(PH_PERSIST, t);
 }
 
 static inline void flush(void * ptr) {
@@ -21,10 +24,12 @@ static inline void flush(void * ptr) {
 
 inline void clwb(void *data, int len) {
 #ifdef DOFLUSH
+    PHASE_BEGIN(t);
     volatile char *ptr = (char *)((unsigned long long)data &~(CACHE_LINE_SIZE-1));
     for(; ptr < (char *)data + len; ptr += CACHE_LINE_SIZE) {
         flush((void *)ptr);
     }
+    PHASE_END(PH_PERSIST, t);
 #endif //DOFLUSH
 }
 
@@ -33,9 +38,11 @@ inline void clflush(void *data, int len, bool fence=true)
 #ifdef DOFLUSH
     volatile char *ptr = (char *)((unsigned long long)data &~(CACHE_LINE_SIZE-1));
     if(fence) mfence();
+    PHASE_BEGIN(t); // the fences time themselves
     for(; ptr < (char *)data + len; ptr += CACHE_LINE_SIZE){
         flush((void *)ptr);
     }
+    PHASE_END(PH_PERSIST, t);
     if(fence) mfence();
 #endif //DOFLUSH
 }
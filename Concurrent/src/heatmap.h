@@ -0,0 +1,114 @@
+/*  heatmap.h - Sampled access heat of the key ranges of TLBtree
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __HEATMAP_H__
+#define __HEATMAP_H__
+
+#include <cstdint>
+#include <atomic>
+
+#include "common.h"
+#include "spinlock.h"
+
+/* the heat of the key range of one sub-index tree */
+struct HeatRange {
+    _key_t lo, hi;  // [lo, hi)
+    double reads;   // estimated reads and writes
+    double writes;
+    double splits;  // of the sub-index tree, not sampled; all three are halved at each decay
+};
+
+/*
+    KeyHeatmap: the access heat of the sub-index trees, i.e. of the key ranges of their subroots.
+
+    One of SAMPLE_RATE reads and writes is counted into a slot hashed by its subroot, splits of the
+    subtree are counted unsampled. Slots are shared on collisions the way the heat counters of
+    DramTier are: a foreign subroot, on a sampled access or on a split, wears the reads and writes
+    of the slot down and takes it over once they are cold, so the hot subtrees keep their slots and
+    the splits of a subtree without its slot are lost. Every DECAY_SAMPLES samples all the counts,
+    the splits included, are halved, a count then weighs the recent accesses most, with a half-life
+    of DECAY_SAMPLES * SAMPLE_RATE operations. The counts are updated with relaxed loads and
+    stores, a racing update may be lost.
+*/
+class KeyHeatmap {
+public:
+    static const uint32_t SAMPLE_RATE = 64;
+    static const uint32_t DECAY_SAMPLES = 1 << 16;
+    static const int SLOTS = 1 << 16;
+
+private:
+    enum {READ = 0, WRITE, SPLIT, KINDS};
+
+    struct slot_t {
+        std::atomic<const void *> root;
+        std::atomic<uint32_t> cnt[KINDS];
+    };
+
+    slot_t slots_[SLOTS];
+    std::atomic<uint64_t> samples_;
+
+public:
+    KeyHeatmap(): samples_(0) {
+        for(int i = 0; i < SLOTS; i++) {
+            slots_[i].root.store(NULL, std::memory_order_relaxed);
+            for(int k = 0; k < KINDS; k++) slots_[i].cnt[k].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /* an access to the sub-index tree rooted at root, sampled */
+    inline void access(const void * root, bool write) {
+        if(Backoff::next_random() % SAMPLE_RATE != 0) return ;
+        count(root, write ? WRITE : READ);
+        if(samples_.fetch_add(1, std::memory_order_relaxed) % DECAY_SAMPLES == DECAY_SAMPLES - 1) decay();
+    }
+
+    /* the sub-index tree rooted at root has split */
+    inline void split(const void * root) {
+        count(root, SPLIT);
+    }
+
+    /* fill the estimated heat of the sub-index tree rooted at root into r, 0 if it has no slot */
+    void heat(const void * root, HeatRange & r) const {
+        const slot_t & s = slots_[slot_of(root)];
+        bool own = s.root.load(std::memory_order_relaxed) == root;
+        r.reads = own ? (double)s.cnt[READ].load(std::memory_order_relaxed) * SAMPLE_RATE : 0;
+        r.writes = own ? (double)s.cnt[WRITE].load(std::memory_order_relaxed) * SAMPLE_RATE : 0;
+        r.splits = own ? s.cnt[SPLIT].load(std::memory_order_relaxed) : 0;
+    }
+
+    inline uint64_t samples() const { return samples_.load(std::memory_order_relaxed); }
+
+private:
+    static inline uint32_t slot_of(const void * root) { // subroots are 256B aligned
+        uint64_t x = (uint64_t)root >> 8;
+        return (x ^ (x >> 16)) % SLOTS;
+    }
+
+    inline void count(const void * root, int kind) {
+        slot_t & s = slots_[slot_of(root)];
+        if(s.root.load(std::memory_order_relaxed) == root) {
+            s.cnt[kind].store(s.cnt[kind].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return ;
+        }
+        // compete for the slot, the owner keeps it while it is hotter
+        uint32_t reads = s.cnt[READ].load(std::memory_order_relaxed), writes = s.cnt[WRITE].load(std::memory_order_relaxed);
+        if(reads + writes <= 1) {
+            s.root.store(root, std::memory_order_relaxed);
+            for(int k = 0; k < KINDS; k++) s.cnt[k].store(k == kind ? 1 : 0, std::memory_order_relaxed);
+        } else if(reads >= writes) {
+            s.cnt[READ].store(reads - 1, std::memory_order_relaxed);
+        } else {
+            s.cnt[WRITE].store(writes - 1, std::memory_order_relaxed);
+        }
+    }
+
+    void decay() { // by the thread whose sample completes the period
+        for(int i = 0; i < SLOTS; i++)
+            for(int k = 0; k < KINDS; k++)
+                slots_[i].cnt[k].store(slots_[i].cnt[k].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+    }
+};
+
+#endif //__HEATMAP_H__
@@ -0,0 +1,103 @@
+/*  key_filter.h - A volatile Bloom filter of the keys of TLBtree
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __KEYFILTER_H__
+#define __KEYFILTER_H__
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "common.h"
+#include "policy.h"
+
+/*
+    KeyFilter: a blocked Bloom filter over all the keys of the tree, independent of the top layer,
+    so it lives on across the rebuildings of the top layer.
+
+    A key is hashed to one 64B block, and HASHES bits are set within the block, so a probe touches
+    a single cache line. The blocks are sized for BITS_PER_KEY bits per expected key, which gives
+    about 1% false positives. Bits are only set: inserts set them before writing the tree, and the
+    keys removed are forgotten when the filter is replaced by a new one, built from the down layer.
+    Until built, a filter answers "maybe" for every key.
+*/
+template<typename Policy>
+class KeyFilter {
+public:
+    static const int BITS_PER_KEY = 10;
+    static const int HASHES = 6;
+
+private:
+    static const int BLOCK_WORDS = CACHE_LINE_SIZE / sizeof(uint64_t);
+    static const int BLOCK_BITS = CACHE_LINE_SIZE * 8;
+
+    uint64_t * words_;
+    uint64_t blocks_;
+    typename Policy::counter_t built_;
+
+public:
+    KeyFilter(size_t expected_keys): built_(0) {
+        blocks_ = std::max((size_t)1, expected_keys * BITS_PER_KEY / BLOCK_BITS);
+        words_ = (uint64_t *)aligned_alloc(CACHE_LINE_SIZE, size());
+        memset(words_, 0, size());
+    }
+
+    ~KeyFilter() {
+        ::free(words_);
+    }
+
+    inline void add(const _key_t & k) {
+        uint64_t h = hash(k);
+        uint64_t * block = words_ + block_of(h) * BLOCK_WORDS;
+        uint32_t h1 = h, h2 = ((h * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+        for(int i = 0; i < HASHES; i++) {
+            uint32_t bit = (h1 + i * h2) % BLOCK_BITS;
+            uint64_t mask = 1UL << (bit % 64);
+            if((block[bit / 64] & mask) == 0) // do not write a line that has the bit already
+                Policy::fetch_or(&block[bit / 64], mask);
+        }
+    }
+
+    inline bool may_contain(const _key_t & k) const {
+        if(built_.load(std::memory_order_acquire) == 0)
+            return true;
+
+        uint64_t h = hash(k);
+        const uint64_t * block = words_ + block_of(h) * BLOCK_WORDS;
+        uint32_t h1 = h, h2 = ((h * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+        for(int i = 0; i < HASHES; i++) {
+            uint32_t bit = (h1 + i * h2) % BLOCK_BITS;
+            if((block[bit / 64] & (1UL << (bit % 64))) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    inline void set_built() { // all the keys in the tree are added
+        built_.store(1, std::memory_order_release);
+    }
+
+    inline size_t size() const { // in bytes
+        return blocks_ * CACHE_LINE_SIZE;
+    }
+
+private:
+    inline uint64_t block_of(uint64_t h) const { // the high 32 bits pick a block without a division
+        return ((h >> 32) * blocks_) >> 32;
+    }
+
+    static inline uint64_t hash(const _key_t & k) { // murmur3 finalizer
+        uint64_t h = (uint64_t)k;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+#endif //__KEYFILTER_H__
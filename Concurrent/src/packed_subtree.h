@@ -0,0 +1,263 @@
+/*  packed_subtree.h - A read-optimized compressed form of cold sub-index trees
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __PACKEDSUBTREE_H__
+#define __PACKEDSUBTREE_H__
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "common.h"
+
+/*
+    PackedSubtree: the records of a cold sub-index tree packed into one block of PM, which takes
+    the place of its nodes (about 28B per record at the usual fill factor of a leaf).
+
+    The sorted records are cut into groups of GROUP records. A group keeps its first key and the
+    smallest of its values in full, and the other keys and values as offsets from them, bit
+    packed with the fewest bits that hold the largest offset (frame of reference). Dense or
+    clustered keys take a few bits per record, and a group is decoded without the ones before it:
+
+        | header | group_t[groups] | keys of group 0 | values of group 0 | keys of group 1 | ...
+
+    A lookup binary searches the first keys of the groups, then decodes the keys of one group
+    and compares them with the searched key, 4 at a time on AVX2. Keys are packed as unsigned
+    integers that keep their order, see code().
+
+    A block is written once and never modified, a writer of the subtree unpacks it back into nodes.
+*/
+class PackedSubtree {
+public:
+    static const int GROUP = 16;
+    static const int SLACK = 32; // bytes after the last group, the decoder loads whole words
+
+private:
+    struct group_t {
+        uint64_t key_base;  // code of the first key
+        uint64_t val_base;  // the smallest value
+        uint32_t offset;    // of the packed keys from the end of the group headers, the values follow
+        uint8_t key_bits;   // bits per offset, 0 to 56, or 64 for offsets kept whole
+        uint8_t val_bits;
+        uint16_t count;
+    };
+
+    uint32_t count_;
+    uint32_t groups_;
+    uint32_t size_;     // bytes of the block
+    uint32_t padding_;
+
+public:
+    /* bytes of the block that packs the sorted recs */
+    static size_t packed_size(const std::vector<Record> & recs) {
+        size_t size = sizeof(PackedSubtree) + SLACK;
+        for(size_t i = 0; i < recs.size(); i += GROUP) {
+            group_t g;
+            plan(recs, i, g);
+            size += sizeof(group_t) + packed_bytes(g.count, g.key_bits) + packed_bytes(g.count, g.val_bits);
+        }
+        return size;
+    }
+
+    /* pack the sorted recs into mem of packed_size(recs) bytes, which the caller persists */
+    static PackedSubtree * pack(void * mem, const std::vector<Record> & recs) {
+        size_t size = packed_size(recs);
+        memset(mem, 0, size);
+
+        PackedSubtree * p = (PackedSubtree *)mem;
+        p->count_ = recs.size();
+        p->groups_ = (recs.size() + GROUP - 1) / GROUP;
+        p->size_ = size;
+        p->padding_ = 0;
+
+        uint32_t offset = 0;
+        for(uint32_t gi = 0; gi < p->groups_; gi++) {
+            group_t & g = p->group(gi);
+            size_t first = (size_t)gi * GROUP;
+            plan(recs, first, g);
+            g.offset = offset;
+
+            uint8_t * keys = p->data() + offset;
+            uint8_t * vals = keys + packed_bytes(g.count, g.key_bits);
+            for(int i = 0; i < g.count; i++) {
+                put(keys, g.key_bits, i, code(recs[first + i].key) - g.key_base);
+                put(vals, g.val_bits, i, (uint64_t)recs[first + i].val - g.val_base);
+            }
+            offset += packed_bytes(g.count, g.key_bits) + packed_bytes(g.count, g.val_bits);
+        }
+        return p;
+    }
+
+    inline uint32_t count() const { return count_; }
+
+    inline size_t size() const { return size_; }
+
+    bool find(const _key_t & k, uint64_t & v) const {
+        uint64_t c = code(k);
+
+        // the first group whose first key is not less than k, k may also end the group before it
+        uint32_t lo = 0, hi = groups_;
+        while(lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if(group(mid).key_base < c) lo = mid + 1;
+            else hi = mid;
+        }
+
+        if(lo > 0) {
+            const group_t & g = group(lo - 1);
+            const uint8_t * keys = data() + g.offset;
+            int i = match(keys, g.key_bits, g.count, c - g.key_base);
+            if(i >= 0) {
+                v = g.val_base + get(keys + packed_bytes(g.count, g.key_bits), g.val_bits, i);
+                return true;
+            }
+        }
+        if(lo < groups_ && group(lo).key_base == c) {
+            const group_t & g = group(lo);
+            v = g.val_base + get(data() + g.offset + packed_bytes(g.count, g.key_bits), g.val_bits, 0);
+            return true;
+        }
+        return false;
+    }
+
+    /* append the records within [lo, hi) */
+    void scan(const _key_t & lo, const _key_t & hi, std::vector<Record> & out) const {
+        uint64_t clo = code(lo);
+        uint32_t gi = 0;
+        while(gi + 1 < groups_ && group(gi + 1).key_base < clo) gi++; // the groups are few, a scan is long
+        for(; gi < groups_; gi++) {
+            const group_t & g = group(gi);
+            const uint8_t * keys = data() + g.offset;
+            const uint8_t * vals = keys + packed_bytes(g.count, g.key_bits);
+            for(int i = 0; i < g.count; i++) {
+                _key_t k = decode(g.key_base + get(keys, g.key_bits, i));
+                if(k >= hi) return ;
+                if(k >= lo) out.push_back({k, (char *)(g.val_base + get(vals, g.val_bits, i))});
+            }
+        }
+    }
+
+    /* append all records, in order */
+    inline void unpack(std::vector<Record> & out) const {
+        out.reserve(out.size() + count_);
+        scan(MIN_KEY, MAX_KEY, out);
+    }
+
+private:
+    inline group_t & group(uint32_t gi) { return ((group_t *)(this + 1))[gi]; }
+
+    inline const group_t & group(uint32_t gi) const { return ((const group_t *)(this + 1))[gi]; }
+
+    inline uint8_t * data() { return (uint8_t *)&group(groups_); }
+
+    inline const uint8_t * data() const { return (const uint8_t *)&group(groups_); }
+
+    /* the header of the group of recs from first, without its offset */
+    static void plan(const std::vector<Record> & recs, size_t first, group_t & g) {
+        g.count = std::min((size_t)GROUP, recs.size() - first);
+        g.key_base = code(recs[first].key);
+        g.val_base = (uint64_t)recs[first].val;
+        for(int i = 1; i < g.count; i++)
+            g.val_base = std::min(g.val_base, (uint64_t)recs[first + i].val);
+
+        uint64_t max_key = code(recs[first + g.count - 1].key) - g.key_base, max_val = 0;
+        for(int i = 0; i < g.count; i++)
+            max_val = std::max(max_val, (uint64_t)recs[first + i].val - g.val_base);
+        g.key_bits = bits_of(max_key);
+        g.val_bits = bits_of(max_val);
+        g.offset = 0;
+    }
+
+    static inline uint8_t bits_of(uint64_t x) { // up to 56 bits are read with one unaligned load
+        uint8_t bits = x == 0 ? 0 : 64 - __builtin_clzll(x);
+        return bits > 56 ? 64 : bits;
+    }
+
+    static inline size_t packed_bytes(int n, int bits) {
+        return ((size_t)n * bits + 7) / 8;
+    }
+
+    static inline uint64_t mask(int bits) {
+        return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+    }
+
+    static inline uint64_t get(const uint8_t * p, int bits, int i) {
+        uint64_t bit = (uint64_t)i * bits, word;
+        memcpy(&word, p + (bit >> 3), sizeof(word));
+        return (word >> (bit & 7)) & mask(bits);
+    }
+
+    static inline void put(uint8_t * p, int bits, int i, uint64_t x) { // on zeroed bits
+        uint64_t bit = (uint64_t)i * bits, word;
+        memcpy(&word, p + (bit >> 3), sizeof(word));
+        word |= x << (bit & 7);
+        memcpy(p + (bit >> 3), &word, sizeof(word));
+    }
+
+    /* the first of the n packed offsets that equals x, -1 if none */
+    static inline int match(const uint8_t * p, int bits, int n, uint64_t x) {
+#if defined(__x86_64__) && defined(__GNUC__)
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if(has_avx2) return match_avx2(p, bits, n, x);
+#endif
+        for(int i = 0; i < n; i++)
+            if(get(p, bits, i) == x) return i;
+        return -1;
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static int match_avx2(const uint8_t * p, int bits, int n, uint64_t x) {
+        const __m256i target = _mm256_set1_epi64x(x);
+        const __m256i masks = _mm256_set1_epi64x(mask(bits));
+        const __m256i sevens = _mm256_set1_epi64x(7);
+        __m256i pos = _mm256_setr_epi64x(0, bits, 2 * bits, 3 * bits); // bit positions of 4 offsets
+        const __m256i step = _mm256_set1_epi64x(4 * bits);
+        for(int i = 0; i < n; i += 4) {
+            __m256i words = _mm256_i64gather_epi64((const long long *)p, _mm256_srli_epi64(pos, 3), 1);
+            __m256i offs = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(pos, sevens)), masks);
+            int hits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(offs, target)));
+            hits &= (1 << std::min(4, n - i)) - 1;
+            if(hits != 0) return i + __builtin_ctz(hits);
+            pos = _mm256_add_epi64(pos, step);
+        }
+        return -1;
+    }
+#endif
+
+    /* map a key to an unsigned integer of the same order */
+    static inline uint64_t code(const _key_t & k) {
+        if constexpr (std::is_floating_point<_key_t>::value) {
+            double d = k;
+            uint64_t u;
+            memcpy(&u, &d, sizeof(u));
+            return (u >> 63) ? ~u : u | (1ULL << 63);
+        } else if constexpr (std::is_signed<_key_t>::value) {
+            return (uint64_t)(int64_t)k ^ (1ULL << 63);
+        } else {
+            return (uint64_t)k;
+        }
+    }
+
+    static inline _key_t decode(uint64_t u) {
+        if constexpr (std::is_floating_point<_key_t>::value) {
+            u = (u >> 63) ? u & ~(1ULL << 63) : ~u;
+            double d;
+            memcpy(&d, &u, sizeof(d));
+            return (_key_t)d;
+        } else if constexpr (std::is_signed<_key_t>::value) {
+            return (_key_t)(int64_t)(u ^ (1ULL << 63));
+        } else {
+            return (_key_t)u;
+        }
+    }
+};
+
+#endif //__PACKEDSUBTREE_H__
@@ -0,0 +1,189 @@
+/*  phase_timer.h - TSC timers of the phases of the operations of TLBtree
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __PHASE_TIMER_H__
+#define __PHASE_TIMER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "common.h"
+#include "thread_slots.h"
+
+/*
+    Where the cycles of find, insert, update and remove go, compiled in by defining PHASE_TIMERS
+    (cmake -DPHASE_TIMERS=ON) and out otherwise, where the macros below expand to nothing:
+
+        top:        Fixtree::find_lower (and the Bloom filter of the keys)
+        chain:      the walk along the sibling chain to the subtree of the key
+        down:       the rest of the operation, mostly the descent and the write in the wotree256
+                    subtree (an operation answered by the record cache has no other phase)
+        split:      node splits and merges, and saving new subroots into the top layer
+        persist:    clwb and sfence
+        total:      the whole operation
+
+    split and persist are parts of down (and persist of split), an operation that neither splits
+    nor flushes adds no sample to them. The TSC is read at the bounds of the phases and around
+    each flush, which costs some tens of cycles each.
+*/
+enum TimedOp {PT_FIND = 0, PT_INSERT, PT_UPDATE, PT_REMOVE, PT_OPS};
+enum TimedPhase {PH_TOP = 0, PH_CHAIN, PH_DOWN, PH_SPLIT, PH_PERSIST, PH_TOTAL, PH_PHASES};
+
+class PhaseTimers {
+public:
+    static const int SUB_BITS = 2;  // 4 buckets per power of two, a percentile is off by 1/4 at most
+    static const int BUCKETS = 64 << SUB_BITS;
+
+    /* the histograms of the cycles of each phase of each operation type */
+    struct hist_t {
+        uint64_t counts[PT_OPS][PH_PHASES][BUCKETS];
+        uint64_t cnt[PT_OPS][PH_PHASES];
+        uint64_t sum[PT_OPS][PH_PHASES];
+    };
+
+    static inline void begin_op() {
+        local_t & l = local();
+        if(l.depth++ > 0) return ; // an operation within another is a part of it
+        for(int p = 0; p < PH_PHASES; p++) l.acc[p] = 0;
+        l.start = __rdtsc();
+    }
+
+    static inline void end_op(TimedOp op) {
+        local_t & l = local();
+        if(--l.depth > 0) return ;
+        l.acc[PH_TOTAL] = __rdtsc() - l.start;
+        l.acc[PH_DOWN] = l.acc[PH_TOTAL] - std::min(l.acc[PH_TOTAL], l.acc[PH_TOP] + l.acc[PH_CHAIN]);
+        for(int p = 0; p < PH_PHASES; p++) {
+            if(l.acc[p] == 0 && p != PH_TOTAL) continue; // not reached, e.g. found in the record cache
+            l.hist->counts[op][p][bucket_of(l.acc[p])]++;
+            l.hist->cnt[op][p]++;
+            l.hist->sum[op][p] += l.acc[p];
+        }
+    }
+
+    static inline void add(TimedPhase p, uint64_t cycles) {
+        local().acc[p] += cycles;
+    }
+
+    /* sum the histograms of all the threads, taken while no operation runs */
+    static void merge(hist_t & out) {
+        memset(&out, 0, sizeof(out));
+        int cnt = ThreadSlots::count();
+        for(int i = 0; i < cnt; i++) {
+            hist_t * h = pool()[i].load(std::memory_order_acquire);
+            if(h == NULL) continue;
+            for(int op = 0; op < PT_OPS; op++) {
+                for(int p = 0; p < PH_PHASES; p++) {
+                    for(int b = 0; b < BUCKETS; b++) out.counts[op][p][b] += h->counts[op][p][b];
+                    out.cnt[op][p] += h->cnt[op][p];
+                    out.sum[op][p] += h->sum[op][p];
+                }
+            }
+        }
+    }
+
+    /* print count, mean and percentiles of each phase of each operation type, in cycles and in ns */
+    static void report() {
+        static const char * OPS[] = {"find", "insert", "update", "remove"};
+        static const char * PHASES[] = {"top", "chain", "down", "split", "persist", "total"};
+        hist_t * h = new hist_t;
+        merge(*h);
+        double ghz = tsc_ghz();
+        printf("phase breakdown (TSC at %.2f GHz), cycles\n", ghz);
+        printf("%-7s %-8s %12s %9s %9s %9s %9s %9s %8s\n", "op", "phase", "count", "avg", "p50", "p90", "p99", "p99.9", "avg(ns)");
+        for(int op = 0; op < PT_OPS; op++) {
+            if(h->cnt[op][PH_TOTAL] == 0) continue;
+            for(int p = 0; p < PH_PHASES; p++) {
+                if(h->cnt[op][p] == 0) continue;
+                double avg = (double)h->sum[op][p] / h->cnt[op][p];
+                printf("%-7s %-8s %12lu %9.0f %9lu %9lu %9lu %9lu %8.1f\n", OPS[op], PHASES[p], h->cnt[op][p], avg,
+                    percentile(*h, op, p, 50), percentile(*h, op, p, 90), percentile(*h, op, p, 99), percentile(*h, op, p, 99.9), avg / ghz);
+            }
+        }
+        delete h;
+    }
+
+private:
+    struct local_t {
+        uint64_t acc[PH_PHASES];
+        uint64_t start;
+        int depth;
+        hist_t * hist;
+    };
+
+    static inline local_t & local() {
+        static thread_local local_t l = {{0}, 0, 0, NULL};
+        if(l.hist == NULL) {
+            // the histogram of the thread slot, kept for the next thread of the index (see 
+            // thread_slots.h), so the samples outlive their thread and the histograms are 
+            // bounded by the threads alive at the same time, e.g. not by the rebuilding threads
+            std::atomic<hist_t *> & slot = pool()[ThreadSlots::id()];
+            l.hist = slot.load(std::memory_order_relaxed);
+            if(l.hist == NULL) { // only this thread stores into its slot
+                l.hist = new hist_t;
+                memset(l.hist, 0, sizeof(hist_t));
+                slot.store(l.hist, std::memory_order_release);
+            }
+        }
+        return l;
+    }
+
+    static std::atomic<hist_t *> * pool() { static std::atomic<hist_t *> p[ThreadSlots::MAX] = {}; return p; }
+
+    static inline int bucket_of(uint64_t c) {
+        if(c < (2 << SUB_BITS)) return c;
+        int e = 63 - __builtin_clzll(c);
+        int sub = (c >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+        return ((e - SUB_BITS) << SUB_BITS) + (1 << SUB_BITS) + sub;
+    }
+
+    static inline uint64_t value_of(int b) { // the lower bound of the bucket
+        if(b < (2 << SUB_BITS)) return b;
+        int e = ((b - (1 << SUB_BITS)) >> SUB_BITS) + SUB_BITS;
+        uint64_t sub = b & ((1 << SUB_BITS) - 1);
+        return ((1ULL << SUB_BITS) + sub) << (e - SUB_BITS);
+    }
+
+    static uint64_t percentile(const hist_t & h, int op, int p, double pct) {
+        uint64_t rank = std::max((uint64_t)1, (uint64_t)(pct / 100 * h.cnt[op][p] + 0.5)), seen = 0;
+        for(int b = 0; b < BUCKETS; b++) {
+            seen += h.counts[op][p][b];
+            if(seen >= rank) return value_of(b);
+        }
+        return 0;
+    }
+
+    static double tsc_ghz() { // against the wall clock over 20ms
+        double t0 = seconds();
+        uint64_t c0 = __rdtsc();
+        usleep(20000);
+        return (__rdtsc() - c0) / (seconds() - t0) / 1e9;
+    }
+};
+
+#ifdef PHASE_TIMERS
+    struct PhaseScope { // an operation, ended on any return
+        TimedOp op;
+        PhaseScope(TimedOp o): op(o) { PhaseTimers::begin_op(); }
+        ~PhaseScope() { PhaseTimers::end_op(op); }
+    };
+
+    #define PHASE_OP(op)            PhaseScope phase_scope_(op)
+    #define PHASE_BEGIN(t)          uint64_t t = __rdtsc()
+    #define PHASE_END(phase, t)     PhaseTimers::add(phase, __rdtsc() - (t))
+    #define PHASE_NEXT(phase, t)    do { uint64_t now_ = __rdtsc(); PhaseTimers::add(phase, now_ - (t)); t = now_; } while(0)
+#else
+    #define PHASE_OP(op)
+    #define PHASE_BEGIN(t)
+    #define PHASE_END(phase, t)
+    #define PHASE_NEXT(phase, t)
+#endif
+
+#endif //__PHASE_TIMER_H__
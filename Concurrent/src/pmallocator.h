@@ -8,11 +8,14 @@
 
 #include <cassert>
 #include <cstdio>
+#include <atomic>
+#include <vector>
 #include <libpmemobj.h>
 
 #include "common.h"
 #include "flush.h"
 #include "spinlock.h"
+#include "policy.h"
 
 POBJ_LAYOUT_BEGIN(pmallocator);
 POBJ_LAYOUT_TOID(pmallocator, char)
@@ -48,6 +51,10 @@ private:
     size_t piece_size_;
     size_t max_blk_;
     Spinlock alloc_mtx;
+    static const int RECYCLE_CLASSES = 16; // recycled pieces of 1 to 16 blocks
+    std::vector<void *> recycled_[RECYCLE_CLASSES]; // pieces handed back by recycle(), reused by malloc
+    uint64_t recycled_cnt_;                        // in blocks, updated with the Policy of the caller
+    Spinlock recycle_mtx_;                         // taken only under a concurrent Policy
 
 public: 
     /*
@@ -57,7 +64,7 @@ public:
      *  @param layout_name  ID of a group of allocations (in characters), each ID corresponding to a root entry
      *  @param pool_size    pool size of the pool file, vaild if the file doesn't exist
      */
-    PMAllocator(const char *file_name, bool recover, const char *layout_name, uint64_t pool_size) {
+    PMAllocator(const char *file_name, bool recover, const char *layout_name, uint64_t pool_size): recycled_cnt_(0) {
         PMEMobjpool *tmp_pool = nullptr;
         pool_size = pool_size + ((pool_size & ((1 << 23) - 1)) > 0 ? (1 << 23) : 0); // align to 8MB
 	    if(recover == false) {
@@ -124,10 +131,19 @@ public:
         return absolute(meta_->entrance);
     }
 
+    /*
+     *  The root entry, NULL if it has not been allocated, without allocating it
+     */
+    inline void * peek_root() {
+        return meta_->entrance == NULL ? NULL : absolute(meta_->entrance);
+    }
+
     /*
      *  Allocate a non-root piece of persistent memory from the mapped pool
      *  return the virtual memory address
+     *  Policy decides whether the block cursor is bumped with a CAS, see policy.h
      */
+    template<typename Policy = ConcurrentPolicy>
     void * malloc(size_t nsize) { 
         if(nsize >= (1 << 12)) { // large than 4KB, make sure it is atomic
             void * mem = mem_alloc(nsize + ALIGN_SIZE); // not aligned
@@ -141,6 +157,20 @@ public:
             return (void *)((uint64_t)mem + offset);
         }
         
+        if(__atomic_load_n(&recycled_cnt_, __ATOMIC_RELAXED) > 0) {
+            int blks = (nsize + ALIGN_SIZE - 1) / ALIGN_SIZE;
+            void * mem = NULL;
+            if(Policy::concurrent) recycle_mtx_.lock();
+            std::vector<void *> & list = recycled_[blks - 1];
+            if(!list.empty()) {
+                mem = list.back();
+                list.pop_back();
+                Policy::fetch_add(&recycled_cnt_, -blks);
+            }
+            if(Policy::concurrent) recycle_mtx_.unlock();
+            if(mem != NULL) return mem;
+        }
+
         retry_malloc:
         uint64_t old_cur_blk = meta_->cur_blk;
 
@@ -156,7 +186,7 @@ public:
             void * mem = buff_aligned_[piece_id + 1]; // allocate from a new peice
 
             uint64_t new_cur_blk = piece_size_ * (piece_id + 1) + blk_demand;
-            if(__sync_bool_compare_and_swap(&(meta_->cur_blk), old_cur_blk, new_cur_blk) == false) 
+            if(Policy::cas(&(meta_->cur_blk), old_cur_blk, new_cur_blk) == false) 
                 goto retry_malloc;
             clwb(&(meta_->cur_blk), 8);
 
@@ -167,7 +197,7 @@ public:
             void * mem = buff_aligned_[piece_id] + ALIGN_SIZE * (meta_->cur_blk % piece_size_);
 
             uint64_t new_cur_blk = old_cur_blk + blk_demand;
-            if(__sync_bool_compare_and_swap(&(meta_->cur_blk), old_cur_blk, new_cur_blk) == false) 
+            if(Policy::cas(&(meta_->cur_blk), old_cur_blk, new_cur_blk) == false) 
                 goto retry_malloc;
             clwb(&(meta_->cur_blk), 8);
 
@@ -197,6 +227,35 @@ public:
         POBJ_FREE(&ptr_cpy);
     }  
 
+    /*
+     *  Hand a piece of nsize (less than 4KB) bytes, that nobody may access any more, back to 
+     *  malloc for an allocation of the same number of blocks. The lists of recycled pieces are 
+     *  volatile, the ones not reused before a restart are leaked
+     *  Policy decides whether the lists are latched, as in malloc
+     */
+    template<typename Policy = ConcurrentPolicy>
+    void recycle(void * addr, size_t nsize = ALIGN_SIZE) {
+        int blks = (nsize + ALIGN_SIZE - 1) / ALIGN_SIZE;
+        if(Policy::concurrent) recycle_mtx_.lock();
+        recycled_[blks - 1].push_back(addr);
+        Policy::fetch_add(&recycled_cnt_, blks);
+        if(Policy::concurrent) recycle_mtx_.unlock();
+    }
+
+    /*
+     *  Bytes of the blocks in use, allocations larger than 4KB are not counted
+     */
+    inline size_t used() const {
+        return (meta_->cur_blk - __atomic_load_n(&recycled_cnt_, __ATOMIC_RELAXED)) * ALIGN_SIZE;
+    }
+
+    /*
+     *  Bytes of the blocks the pool was created with, the limit of used()
+     */
+    inline size_t capacity() const {
+        return max_blk_ * ALIGN_SIZE;
+    }
+
     /*
      *  Distinguish from virtual memory address and offset in the pool
      *  Each memory piece allocated from the pool has an in-pool offset, which remains unchanged
@@ -238,6 +297,8 @@ private:
     }
 };
 
-extern PMAllocator * galc;
+// the allocator context of the calling thread, set by the index that is being operated on, 
+// so that several indices (e.g. shards), each with its own pool, can live in one process
+extern __thread PMAllocator * galc;
 
 #endif // __BLKALLOCATOR_H__
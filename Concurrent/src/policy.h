@@ -0,0 +1,134 @@
+/*  policy.h - Concurrency policies of TLBtree
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <atomic>
+#include <cstdint>
+
+#include "spinlock.h"
+#include "epoch.h"
+
+/*
+    The trees, their nodes and the allocator are templated on a concurrency policy, which decides
+    how latches, versions and shared counters are implemented:
+
+    ConcurrentPolicy:   any thread may operate on the tree at any time. Node latches are CAS-ed
+                        into the state words, leaf versions are atomics, writers may combine on hot
+                        leaves and the top layer is rebuilt in the background.
+    SingleOwnerPolicy:  the tree is confined to one thread at a time (a single-threaded program,
+                        or a shard handed between threads with a release/acquire pair). Latches and
+                        versions compile to nothing, counters are plain integers and the top layer
+                        is rebuilt in the foreground, so no atomic instruction is left on any path.
+
+    A policy provides:
+        lock(s, v), try_lock(s, v), unlock(s, v)  latch a node state word s, changing its version if v
+        cas(addr, old, new)                        compare and swap a shared 8 bytes word
+        fetch_or(addr, bits)                       set bits of a shared 8 bytes word
+        fetch_add(addr, delta)                     add delta to a shared 8 bytes word
+        acquire_fence()                            order the version check after the reads it validates
+        mutex_t, counter_t                         a latch and a version/counter type for DRAM metadata
+        epoch_t                                    the grace periods of what is freed under readers
+        concurrent                                 whether other threads may run at the same time
+*/
+
+/* a counter with the interface of std::atomic<uint64_t> but plain loads and stores */
+class plain_counter {
+public:
+    plain_counter(uint64_t v = 0): val_(v) {}
+
+    inline uint64_t load(std::memory_order = std::memory_order_seq_cst) const { return val_; }
+
+    inline void store(uint64_t v, std::memory_order = std::memory_order_seq_cst) { val_ = v; }
+
+    inline uint64_t fetch_add(uint64_t v, std::memory_order = std::memory_order_seq_cst) {
+        uint64_t old = val_;
+        val_ += v;
+        return old;
+    }
+
+    inline uint64_t exchange(uint64_t v, std::memory_order = std::memory_order_seq_cst) {
+        uint64_t old = val_;
+        val_ = v;
+        return old;
+    }
+
+private:
+    uint64_t val_;
+};
+
+/* a latch that is never contended */
+class NoLock {
+public:
+    inline void lock() {}
+    inline void unlock() {}
+    inline bool trylock() { return true; }
+};
+
+struct ConcurrentPolicy {
+    static const bool concurrent = true;
+
+    typedef Spinlock mutex_t;
+    typedef std::atomic<uint64_t> counter_t;
+    typedef Epoch epoch_t;
+
+    template<typename State>
+    static inline uint32_t lock(State & s, bool change_version) { return s.lock(change_version); }
+
+    template<typename State>
+    static inline bool try_lock(State & s, bool change_version) { return s.try_lock(change_version); }
+
+    template<typename State>
+    static inline void unlock(State & s, bool change_version) { s.unlock(change_version); }
+
+    static inline bool cas(uint64_t * addr, uint64_t old_val, uint64_t new_val) {
+        return __sync_bool_compare_and_swap(addr, old_val, new_val);
+    }
+
+    static inline void fetch_or(uint64_t * addr, uint64_t bits) {
+        __atomic_fetch_or(addr, bits, __ATOMIC_RELAXED);
+    }
+
+    static inline void fetch_add(uint64_t * addr, int64_t delta) {
+        __atomic_fetch_add(addr, delta, __ATOMIC_RELAXED);
+    }
+
+    static inline void acquire_fence() { std::atomic_thread_fence(std::memory_order_acquire); }
+};
+
+struct SingleOwnerPolicy {
+    static const bool concurrent = false;
+
+    typedef NoLock mutex_t;
+    typedef plain_counter counter_t;
+    typedef NoEpoch epoch_t;
+
+    template<typename State>
+    static inline uint32_t lock(State &, bool) { return 0; }
+
+    template<typename State>
+    static inline bool try_lock(State &, bool) { return true; }
+
+    template<typename State>
+    static inline void unlock(State &, bool) {}
+
+    static inline bool cas(uint64_t * addr, uint64_t, uint64_t new_val) {
+        *addr = new_val;
+        return true;
+    }
+
+    static inline void fetch_or(uint64_t * addr, uint64_t bits) {
+        *addr |= bits;
+    }
+
+    static inline void fetch_add(uint64_t * addr, int64_t delta) {
+        *addr += delta;
+    }
+
+    static inline void acquire_fence() {}
+};
+
+#endif // __POLICY_H__
@@ -0,0 +1,258 @@
+/*  pool_analyzer.h - Space and shape diagnostics of a TLBtree pool
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __POOL_ANALYZER_H__
+#define __POOL_ANALYZER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unordered_set>
+
+#include "tlbtree_impl.h"
+
+namespace tlbtree {
+
+/*
+    PoolAnalyzer: reads the persistent structures of a closed TLBtree pool and reports their shape
+    and the space they take, without writing the pool (it does not open a TLBtreeImpl, whose open
+    restores the backlog and marks the pool dirty):
+
+        top layer:      height, leaf slots in use, inner nodes allocated but beyond the last one
+                        of their level
+        backlog:        subtree roots saved in the restore array at the last clean shutdown
+        sibling chain:  the roots walked from the first one the way rebuild_recover does, the ones
+                        the top layer misses are the backlog a lookup crosses by the sibling links
+        subtrees:       heights, nodes per fill (records of CARDINALITY), packed subtrees
+        space:          blocks the allocator handed out against the blocks reachable from the
+                        entrance, the rest was leaked (merged nodes, roots of removed subtrees)
+
+    The subtrees are traversed by several threads, each takes chunks of the roots of the chain.
+*/
+template<int DOWNLEVEL, int REBUILD_THRESHOLD = 2, typename Policy = ConcurrentPolicy>
+class PoolAnalyzer {
+    typedef TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy> tree_t;
+    typedef typename tree_t::tlbtree_entrance_t entrance_t;
+    typedef DOWNTREE_NS::Node<Policy> Node;
+    typedef UPTREE_NS::uptree_t<Policy> uptree_t;
+
+    static const int MAX_DEPTH = 16;
+    static const int CHUNK = 1024; // roots taken by a thread at a time
+    static const size_t BLOCK = 256; // of the allocator
+    static const size_t LARGE = 4096; // allocations of this size or more are not blocks
+
+    struct stats_t {
+        uint64_t heights[MAX_DEPTH + 1] = {0};            // subtrees by height
+        uint64_t leaf_fill[DOWNTREE_NS::CARDINALITY + 1] = {0};  // leaves by records
+        uint64_t inner_fill[DOWNTREE_NS::CARDINALITY + 1] = {0}; // inner nodes by children - 1
+        uint64_t packed = 0, packed_records = 0, packed_blocks = 0, packed_large = 0;
+        uint64_t empty = 0; // roots without a record, removed or spilled
+
+        void merge(const stats_t & o) {
+            for(int i = 0; i <= MAX_DEPTH; i++) heights[i] += o.heights[i];
+            for(int i = 0; i <= DOWNTREE_NS::CARDINALITY; i++) {
+                leaf_fill[i] += o.leaf_fill[i];
+                inner_fill[i] += o.inner_fill[i];
+            }
+            packed += o.packed;
+            packed_records += o.packed_records;
+            packed_blocks += o.packed_blocks;
+            packed_large += o.packed_large;
+            empty += o.empty;
+        }
+    };
+
+    PMAllocator * alc_;
+    entrance_t * entrance_;
+    uptree_t * uptree_;
+    std::vector<Node *> roots_; // the sibling chain of the roots
+
+    // top layer
+    uint64_t top_slots_ = 0, top_used_ = 0, top_empty_leaves_ = 0, inner_alloc_ = 0, inner_used_ = 0;
+    // sibling chain
+    uint64_t unindexed_ = 0, longest_gap_ = 0, top_off_chain_ = 0;
+    stats_t stats_;
+
+public:
+    PoolAnalyzer(const char * path) {
+        if(!file_exist(path)) {
+            printf("Pool File Not Exist\n");
+            exit(-1);
+        }
+        galc = alc_ = new PMAllocator(path, true, "tlbtree", 0);
+        entrance_ = (entrance_t *)alc_->peek_root();
+        if(entrance_ == NULL || entrance_->upent == NULL) {
+            printf("the tree is empty\n");
+            exit(-1);
+        }
+        uptree_ = new uptree_t(galc->absolute(entrance_->upent)); // only its volatile part is built
+    }
+
+    ~PoolAnalyzer() {
+        delete uptree_;
+        delete alc_;
+        galc = NULL;
+    }
+
+    void run(int threads) {
+        galc = alc_;
+        analyze_top();
+        analyze_chain();
+
+        std::atomic<size_t> next(0);
+        std::vector<stats_t> stats(threads);
+        std::vector<std::thread> workers;
+        for(int t = 0; t < threads; t++) {
+            workers.emplace_back([this, t, &next, &stats]() {
+                galc = alc_;
+                size_t begin;
+                while((begin = next.fetch_add(CHUNK)) < roots_.size()) {
+                    size_t end = std::min(roots_.size(), begin + CHUNK);
+                    for(size_t i = begin; i < end; i++) analyze_subtree(roots_[i], stats[t]);
+                }
+            });
+        }
+        for(auto & w : workers) w.join();
+        for(auto & s : stats) stats_.merge(s);
+    }
+
+    void report() const {
+        const int CARD = DOWNTREE_NS::CARDINALITY;
+        printf("pool: %s shutdown, %s rebuilding next time\n", entrance_->is_clean ? "clean" : "unclean",
+                entrance_->use_rebuild_recover ? "recover" : "fast");
+
+        printf("\n[top layer]\n");
+        printf("height %u, %u leaves\n", uptree_->height_, uptree_->leaf_cnt_);
+        printf("leaf slots: %lu of %lu in use (%.1f%%), %lu leaves empty\n", top_used_, top_slots_,
+                100.0 * top_used_ / std::max(top_slots_, (uint64_t)1), top_empty_leaves_);
+        printf("inner nodes: %lu of %lu allocated in use, %.2f MB wasted\n", inner_used_, inner_alloc_,
+                (inner_alloc_ - inner_used_) * sizeof(typename uptree_t::INNode) / 1048576.0);
+
+        printf("\n[backlog]\n");
+        printf("restore: %d roots saved at the last shutdown\n", entrance_->restore_size);
+
+        printf("\n[sibling chain]\n");
+        printf("%lu subtree roots, %lu not in the top layer, at most %lu of them in a row\n", (uint64_t)roots_.size(),
+                unindexed_, longest_gap_);
+        if(top_off_chain_ > 0) printf("%lu top layer entries point off the chain\n", top_off_chain_);
+
+        printf("\n[subtrees]\n");
+        for(int h = 0; h <= MAX_DEPTH; h++)
+            if(stats_.heights[h] > 0) printf("height %2d%s: %lu\n", h, h == MAX_DEPTH ? "+" : "", stats_.heights[h]);
+        if(stats_.empty > 0) printf("empty (removed or spilled): %lu\n", stats_.empty);
+        if(stats_.packed > 0) printf("packed: %lu with %lu records\n", stats_.packed, stats_.packed_records);
+        uint64_t leaves = 0, inners = 0, records = 0, children = 0;
+        for(int i = 0; i <= CARD; i++) {
+            leaves += stats_.leaf_fill[i];
+            inners += stats_.inner_fill[i];
+            records += stats_.leaf_fill[i] * i;
+            children += stats_.inner_fill[i] * (i + 1);
+        }
+        printf("%lu records in %lu leaves (%.1f%% full), %lu inner nodes (%.1f%% full)\n", records, leaves,
+                100.0 * records / std::max(leaves * CARD, (uint64_t)1), inners, 100.0 * children / std::max(inners * (CARD + 1), (uint64_t)1));
+        printf("%-8s %10s %10s\n", "fill", "leaves", "inners");
+        for(int i = 0; i <= CARD; i++)
+            printf("%2d/%-5d %10lu %10lu\n", i, CARD, stats_.leaf_fill[i], stats_.inner_fill[i]);
+
+        printf("\n[space]\n");
+        uint64_t nodes = leaves + inners;
+        uint64_t reachable = (nodes + stats_.packed + stats_.packed_blocks + 1) * BLOCK; // with the marked roots and the entrance
+        uint64_t used = alc_->used();
+        printf("blocks: %.2f MB of %.2f MB handed out, %.2f MB reachable (%.2f MB nodes, %.2f MB packed)\n",
+                used / 1048576.0, alc_->capacity() / 1048576.0, reachable / 1048576.0,
+                nodes * BLOCK / 1048576.0, (stats_.packed + stats_.packed_blocks) * BLOCK / 1048576.0);
+        printf("leaked: %.2f MB (%.1f%% of the handed out blocks, with the tails of pieces the allocator skipped)\n",
+                used > reachable ? (used - reachable) / 1048576.0 : 0, used > reachable ? 100.0 * (used - reachable) / used : 0);
+        uint64_t top_bytes = std::max(LARGE, uptree_->leaf_cnt_ * sizeof(typename uptree_t::LFNode))
+                            + std::max(LARGE, inner_alloc_ * sizeof(typename uptree_t::INNode)) + LARGE; // and the entrance
+        uint64_t restore_bytes = entrance_->restore == NULL ? 0 : std::max(LARGE, entrance_->restore_size * sizeof(Record));
+        printf("large allocations: %.2f MB of the top layer, %.2f MB of the restore array, %.2f MB of packed subtrees\n",
+                top_bytes / 1048576.0, restore_bytes / 1048576.0, stats_.packed_large / 1048576.0);
+    }
+
+private:
+    void analyze_top() {
+        uint32_t height = uptree_->height_, leaf_cnt = uptree_->leaf_cnt_;
+        inner_alloc_ = uptree_->level_offset_[height]; // a full INNER_CARD-ary tree of the height
+        for(uint64_t cnt = leaf_cnt, l = 0; l < height; l++) { // nodes in use of each level, from the bottom
+            cnt = (cnt + fixtree::INNER_CARD - 1) / fixtree::INNER_CARD;
+            inner_used_ += cnt;
+        }
+
+        for(uint32_t i = 0; i < leaf_cnt; i++) {
+            const typename uptree_t::LFNode & leaf = uptree_->leaf_nodes_[i];
+            int used = 0;
+            for(int j = 0; j < fixtree::LEAF_CARD; j++)
+                if(leaf.keys[j] != MAX_KEY) used++;
+            top_slots_ += fixtree::LEAF_CARD;
+            top_used_ += used;
+            if(used == 0) top_empty_leaves_++;
+        }
+    }
+
+    void analyze_chain() {
+        std::unordered_set<uint64_t> indexed; // relative addresses of the roots in the top layer
+        indexed.reserve(top_used_ * 2);
+        for(uint32_t i = 0; i < uptree_->leaf_cnt_; i++) {
+            const typename uptree_t::LFNode & leaf = uptree_->leaf_nodes_[i];
+            for(int j = 0; j < fixtree::LEAF_CARD; j++)
+                if(leaf.keys[j] != MAX_KEY) indexed.insert((uint64_t)leaf.vals[j]);
+        }
+
+        _key_t split_key;
+        Node ** sibling_ptr = (Node **)uptree_->find_first();
+        Node * cur = galc->absolute(*sibling_ptr);
+        uint64_t gap = 0, on_chain = 0;
+        while(cur != NULL) {
+            roots_.push_back(cur);
+            if(indexed.count((uint64_t)*sibling_ptr) == 0) {
+                unindexed_++;
+                longest_gap_ = std::max(longest_gap_, ++gap);
+            } else {
+                on_chain++;
+                gap = 0;
+            }
+            cur->get_sibling(split_key, sibling_ptr);
+            cur = galc->absolute(*sibling_ptr);
+        }
+        top_off_chain_ = indexed.size() - std::min((uint64_t)indexed.size(), on_chain);
+    }
+
+    void analyze_subtree(Node * root, stats_t & s) {
+        char * packed = DOWNTREE_NS::marked(root);
+        if(packed != NULL) {
+            PackedSubtree * block = (PackedSubtree *)galc->absolute(packed);
+            s.packed++;
+            s.packed_records += block->count();
+            if(block->size() >= LARGE) s.packed_large += block->size();
+            else s.packed_blocks += (block->size() + BLOCK - 1) / BLOCK;
+            return ;
+        }
+        if(root->state_.unpack.count == 0) s.empty++;
+        s.heights[std::min(visit(root, s), MAX_DEPTH)]++;
+    }
+
+    int visit(Node * n, stats_t & s) { // return the height of the subtree of n
+        DOWNTREE_NS::state_t st = n->state_;
+        int cnt = st.unpack.count;
+        if(n->leftmost_ptr_ == NULL) {
+            s.leaf_fill[cnt]++;
+            return 1;
+        }
+        s.inner_fill[cnt]++;
+        int height = visit(galc->absolute((Node *)n->leftmost_ptr_), s);
+        for(int i = 0; i < cnt; i++)
+            height = std::max(height, visit(galc->absolute((Node *)n->recs_[st.read(i)].val), s));
+        return height + 1;
+    }
+};
+
+} // namespace tlbtree
+
+#endif //__POOL_ANALYZER_H__
@@ -0,0 +1,203 @@
+/*  record_cache.h - A volatile cache of hot records in front of TLBtree
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __RECORDCACHE_H__
+#define __RECORDCACHE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <emmintrin.h>
+
+#include "common.h"
+
+/*
+    RecordCache: a set-associative DRAM table of key-value pairs, replaced by CLOCK within each set.
+
+    Each set (bucket) holds WAYS records and a seqlock version. Readers search a bucket without
+    writing it, except for setting the reference bit of a record they hit (once). Writers take
+    the bucket by making its version odd.
+
+    It is kept coherent with the tree in a look-aside way:
+        find:       lookup(); on a miss read the tree, then fill() with the version lookup() saw,
+                    which is dropped if any writer has touched the bucket in between
+        writes:     update or remove the tree first, then update() or invalidate() the cache
+    so a reader can never install a value older than the one a writer has left in the tree.
+*/
+class RecordCache {
+public:
+    static const int WAYS = 7; // 7 records and a header fit in two cache lines
+
+private:
+    struct bucket_t {
+        std::atomic<uint32_t> version; // odd while a writer is modifying the bucket
+        std::atomic<uint8_t> refs;     // CLOCK reference bits
+        uint8_t valid;                 // valid bits, written under the version
+        uint8_t hand;                  // CLOCK hand
+        _key_t keys[WAYS];
+        uint64_t vals[WAYS];
+
+        bucket_t(): version(0), refs(0), valid(0), hand(0) {}
+    } __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    static const int STRIPES = 16; // hit/miss counters are striped by thread to avoid a shared line
+
+    struct counter_t {
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        counter_t(): hits(0), misses(0) {}
+    } __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    bucket_t * buckets_;
+    uint64_t bucket_mask_;
+    counter_t counters_[STRIPES];
+
+public:
+    /*
+     *  @param budget   DRAM budget of the cache in bytes, rounded down to a power of two buckets
+     */
+    RecordCache(size_t budget) {
+        uint64_t cnt = 1;
+        while(cnt * 2 * sizeof(bucket_t) <= budget)
+            cnt *= 2;
+        buckets_ = new bucket_t[cnt];
+        bucket_mask_ = cnt - 1;
+    }
+
+    ~RecordCache() {
+        delete [] buckets_;
+    }
+
+    /* return true and the value if k is cached, otherwise ver is the version to fill() with */
+    bool lookup(const _key_t & k, uint64_t & v, uint32_t & ver) {
+        bucket_t & b = bucket(k);
+        counter_t & cnt = counters_[stripe()];
+
+        retry:
+        ver = b.version.load(std::memory_order_acquire);
+        if(ver % 2 != 0) { // a writer is modifying the bucket
+            _mm_pause();
+            goto retry;
+        }
+
+        int way = -1;
+        uint8_t valid = b.valid;
+        for(int i = 0; i < WAYS; i++) {
+            if((valid & (1 << i)) && b.keys[i] == k) {
+                way = i;
+                v = b.vals[i];
+                break;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(ver != b.version.load(std::memory_order_relaxed)) goto retry;
+
+        if(way < 0) {
+            cnt.misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if((b.refs.load(std::memory_order_relaxed) & (1 << way)) == 0)
+            b.refs.fetch_or(1 << way, std::memory_order_relaxed);
+        cnt.hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /* cache a record read from the tree, unless the bucket is changed since lookup() */
+    void fill(const _key_t & k, uint64_t v, uint32_t ver) {
+        bucket_t & b = bucket(k);
+        if(ver % 2 != 0 || !b.version.compare_exchange_strong(ver, ver + 1, std::memory_order_acquire))
+            return ;
+
+        int way = find(b, k);
+        if(way < 0) way = evict(b);
+        b.keys[way] = k;
+        b.vals[way] = v;
+        b.valid |= 1 << way;
+        b.refs.fetch_and(~(1 << way), std::memory_order_relaxed); // has to be hit once to survive a round
+
+        b.version.store(ver + 2, std::memory_order_release);
+    }
+
+    /* refresh the cached value of k, if it is cached */
+    void update(const _key_t & k, uint64_t v) {
+        bucket_t & b = bucket(k);
+        lock(b);
+        int way = find(b, k);
+        if(way >= 0) b.vals[way] = v;
+        unlock(b);
+    }
+
+    void invalidate(const _key_t & k) {
+        bucket_t & b = bucket(k);
+        lock(b);
+        int way = find(b, k);
+        if(way >= 0) b.valid &= ~(1 << way);
+        unlock(b);
+    }
+
+    inline size_t capacity() const { // in records
+        return (bucket_mask_ + 1) * WAYS;
+    }
+
+    void get_stats(uint64_t & hits, uint64_t & misses) const {
+        hits = misses = 0;
+        for(int i = 0; i < STRIPES; i++) {
+            hits += counters_[i].hits.load(std::memory_order_relaxed);
+            misses += counters_[i].misses.load(std::memory_order_relaxed);
+        }
+    }
+
+    double hit_rate() const {
+        uint64_t hits, misses;
+        get_stats(hits, misses);
+        return hits + misses == 0 ? 0 : (double)hits / (hits + misses);
+    }
+
+private:
+    inline bucket_t & bucket(const _key_t & k) const {
+        uint64_t h = (uint64_t)k * 0x9E3779B97F4A7C15ULL; // fibonacci hashing
+        return buckets_[(h >> 20) & bucket_mask_];
+    }
+
+    static inline int stripe() {
+        static thread_local int id = std::hash<std::thread::id>()(std::this_thread::get_id()) % STRIPES;
+        return id;
+    }
+
+    static inline int find(const bucket_t & b, const _key_t & k) {
+        for(int i = 0; i < WAYS; i++) {
+            if((b.valid & (1 << i)) && b.keys[i] == k)
+                return i;
+        }
+        return -1;
+    }
+
+    static inline int evict(bucket_t & b) { // CLOCK: the first free way, or the first way not referenced since the hand passed it
+        while(true) {
+            int way = b.hand;
+            b.hand = (b.hand + 1) % WAYS;
+            uint8_t bit = 1 << way;
+            if((b.valid & bit) == 0) return way;
+            if((b.refs.load(std::memory_order_relaxed) & bit) == 0) return way;
+            b.refs.fetch_and(~bit, std::memory_order_relaxed);
+        }
+    }
+
+    static inline void lock(bucket_t & b) {
+        uint32_t ver = b.version.load(std::memory_order_relaxed);
+        while(ver % 2 != 0 || !b.version.compare_exchange_weak(ver, ver + 1, std::memory_order_acquire)) {
+            _mm_pause();
+            ver = b.version.load(std::memory_order_relaxed);
+        }
+    }
+
+    static inline void unlock(bucket_t & b) {
+        b.version.fetch_add(1, std::memory_order_release);
+    }
+};
+
+#endif //__RECORDCACHE_H__
@@ -0,0 +1,522 @@
+/*  sharded_impl.h - A range-partitioned front end of TLBtree with thread-per-core shards
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __SHARDEDIMPL_H__
+#define __SHARDEDIMPL_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <pthread.h>
+#include <emmintrin.h>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "tlbtree_impl.h"
+#include "spinlock.h"
+
+namespace tlbtree {
+
+/*  ShardedTLBtreeImpl:
+        The key space is range-partitioned across N independent TLBtreeImpl shards, each with
+    its own pool file and allocator context. Each shard is owned by one (pinned) thread, the only
+    one that operates on it, so shards share no leaves, no mutable_ and no allocator, and are 
+    built with SingleOwnerPolicy: no latch, version or atomic is paid within a shard.
+        Clients route a request to its owner through a lock-free request queue and wait for it.
+    A request that reaches a shard which does not own its key any more (the boundaries moved while
+    it was queued) is forwarded to the current owner.
+        rebalance() moves the boundary between the most loaded shard and its less loaded neighbour
+    to the median of the keys it recently served, migrating the keys in between. Only the two
+    shards are paused while migrating, the others keep serving. A background thread calls it
+    every rebalance_ms. A scan walks the shards in key order, each owner scans the part of the
+    range it owns when it serves the request.
+*/
+template<int DOWNLEVEL, int REBUILD_THRESHOLD=2>
+class ShardedTLBtreeImpl {
+public:
+    typedef TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, SingleOwnerPolicy> ShardType;
+
+private:
+    enum ReqType {REQ_FIND = 0, REQ_INSERT, REQ_UPDATE, REQ_REMOVE, REQ_SCAN, REQ_PARK, REQ_STOP};
+
+    struct request_t {
+        std::atomic<request_t *> next; // link in the request queue
+        ReqType type;
+        _key_t key;
+        uint64_t val;
+        bool ret;
+        std::atomic<bool> done;
+        // of a scan: the records within [key, hi) are appended to out, up to end where the shard ends
+        _key_t hi;
+        _key_t end;
+        vector<Record> * out;
+
+        request_t(ReqType t = REQ_FIND, _key_t k = 0, uint64_t v = 0): next(NULL), type(t), key(k), val(v), ret(false), done(false),
+                                                                        hi(MAX_KEY), end(MAX_KEY), out(NULL) {}
+    };
+
+    /* intrusive, unbounded multi-producer single-consumer queue (Vyukov),
+       producers never wait on the consumer, so forwarding between owners can not deadlock */
+    class RequestQueue {
+    public:
+        RequestQueue(): head_(&stub_), tail_(&stub_) {}
+
+        void push(request_t * r) {
+            r->next.store(NULL, std::memory_order_relaxed);
+            request_t * prev = head_.exchange(r, std::memory_order_acq_rel);
+            prev->next.store(r, std::memory_order_release);
+        }
+
+        request_t * pop() { // only called by the owner
+            request_t * tail = tail_;
+            request_t * next = tail->next.load(std::memory_order_acquire);
+            if(tail == &stub_) {
+                if(next == NULL) return NULL;
+                tail_ = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if(next != NULL) {
+                tail_ = next;
+                return tail;
+            }
+            if(tail != head_.load(std::memory_order_acquire))
+                return NULL; // a producer is in the middle of push, try later
+            push(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if(next != NULL) {
+                tail_ = next;
+                return tail;
+            }
+            return NULL;
+        }
+
+    private:
+        std::atomic<request_t *> head_ __attribute__((aligned(CACHE_LINE_SIZE)));
+        request_t * tail_ __attribute__((aligned(CACHE_LINE_SIZE)));
+        request_t stub_;
+    };
+
+    struct route_t { // bounds[i] is the smallest key of shard i + 1
+        vector<_key_t> bounds;
+
+        inline int shard_of(const _key_t & k) const {
+            return std::upper_bound(bounds.begin(), bounds.end(), k) - bounds.begin();
+        }
+    };
+
+    static const int SAMPLE_SIZE = 1024;
+    static const uint32_t SPIN_LIMIT = 1024;
+
+    struct shard_t {
+        ShardType * tree;
+        RequestQueue queue;
+        std::thread owner;
+        std::atomic<uint64_t> served;  // operations served since last rebalance
+        std::atomic<bool> parked;      // the owner is paused by rebalance()
+        // reservoir of recently served keys, written by the owner only
+        _key_t samples[SAMPLE_SIZE];
+        uint64_t sample_seen;
+        uint32_t sample_seed;
+
+        shard_t(): tree(NULL), served(0), parked(false), sample_seen(0), sample_seed(0) {}
+    } __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    // volatile domain
+    string path_;
+    int shard_cnt_;
+    shard_t * shards_;
+    std::atomic<route_t *> route_;
+    vector<route_t *> retired_routes_; // freed on destruction, readers never block a reroute
+    std::atomic<int> ready_cnt_;
+    Spinlock rebalance_mtx_;
+    std::thread rebalancer_;
+    std::atomic<bool> rebalancer_stop_;
+
+public:
+    /*
+     *  @param path         shard i uses the pool file path.i, the boundaries are kept in path.route
+     *  @param shard_cnt    number of shards, i.e. owner threads
+     *  @param recover      recover the shards and boundaries from the files
+     *  @param pool_size    pool size of each shard
+     *  @param pin          pin the owner of shard i to core i
+     *  @param lo, hi       the key range to partition evenly at the beginning
+     *  @param rebalance_ms period of the background rebalancing, 0 to only rebalance on calls
+     */
+    ShardedTLBtreeImpl(string path, int shard_cnt, bool recover=true, uint64_t pool_size=10 * (1024UL * 1024 * 1024),
+                        bool pin=true, _key_t lo=0, _key_t hi=MAX_KEY, uint32_t rebalance_ms=100);
+
+    ~ShardedTLBtreeImpl();
+
+    void insert(const _key_t & k, uint64_t v) {
+        request_t r(REQ_INSERT, k, v);
+        execute(&r);
+    }
+
+    bool find(const _key_t & k, uint64_t & v) {
+        request_t r(REQ_FIND, k);
+        execute(&r);
+        v = r.val;
+        return r.ret;
+    }
+
+    bool update(const _key_t & k, const uint64_t & v) {
+        request_t r(REQ_UPDATE, k, v);
+        execute(&r);
+        return r.ret;
+    }
+
+    bool remove(const _key_t & k) {
+        request_t r(REQ_REMOVE, k);
+        execute(&r);
+        return r.ret;
+    }
+
+    void scan(const _key_t & lo, const _key_t & hi, vector<Record> & out) { // records within [lo, hi)
+        _key_t cur = lo;
+        while(cur < hi) { // one request per shard, the owner tells where its range ends
+            request_t r(REQ_SCAN, cur);
+            r.hi = hi;
+            r.out = &out;
+            execute(&r);
+            cur = r.end;
+        }
+    }
+
+    bool rebalance(double imbalance = 2.0); // return true if a boundary is moved
+
+    inline int shard_count() const { return shard_cnt_; }
+
+    vector<_key_t> boundaries() const { return route_.load(std::memory_order_acquire)->bounds; }
+
+private:
+    inline void execute(request_t * r) {
+        const route_t * route = route_.load(std::memory_order_acquire);
+        shards_[route->shard_of(r->key)].queue.push(r);
+        wait_until(r->done, true);
+    }
+
+    static inline void wait_until(const std::atomic<bool> & flag, bool val) {
+        // spin for a short while and then yield, owners may share cores with clients
+        for(uint32_t i = 0; flag.load(std::memory_order_acquire) != val; i++) {
+            if(i < SPIN_LIMIT) _mm_pause();
+            else std::this_thread::yield();
+        }
+    }
+
+    void serve(int id, bool recover, uint64_t pool_size, bool pin);
+
+    void handle(int id, request_t * r);
+
+    void park(int id);
+
+    void unpark(int id);
+
+    void purge(int id);
+
+    void persist_route(const route_t * route);
+
+    inline string shard_path(int id) const { return path_ + "." + std::to_string(id); }
+};
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::ShardedTLBtreeImpl(string path, int shard_cnt, bool recover,
+                                        uint64_t pool_size, bool pin, _key_t lo, _key_t hi, uint32_t rebalance_ms) {
+    path_ = path;
+    shard_cnt_ = shard_cnt;
+    shards_ = new shard_t[shard_cnt];
+    ready_cnt_.store(0);
+    rebalancer_stop_.store(false);
+
+    route_t * route = new route_t;
+    if(recover == false) {
+        // partition [lo, hi) evenly, the first and the last shard also take the keys out of it
+        _key_t step = hi / shard_cnt - lo / shard_cnt; // no overflow for wide ranges
+        for(int i = 1; i < shard_cnt; i++)
+            route->bounds.push_back(lo + step * i);
+        persist_route(route);
+    } else {
+        std::ifstream fin((path_ + ".route").c_str(), std::ios::binary);
+        if(!fin) {
+            printf("Route File Not Exist\n");
+            exit(-1);
+        }
+        int cnt = 0;
+        fin.read((char *)&cnt, sizeof(int));
+        route->bounds.resize(cnt);
+        fin.read((char *)route->bounds.data(), sizeof(_key_t) * cnt);
+        if(cnt != shard_cnt - 1) {
+            printf("the tree has %d shards\n", cnt + 1);
+            exit(-1);
+        }
+    }
+    route_.store(route, std::memory_order_release);
+
+    // each shard is created and operated by its owner
+    for(int i = 0; i < shard_cnt; i++)
+        shards_[i].owner = std::thread(&ShardedTLBtreeImpl::serve, this, i, recover, pool_size, pin);
+    while(ready_cnt_.load(std::memory_order_acquire) < shard_cnt)
+        std::this_thread::yield();
+
+    if(rebalance_ms > 0 && shard_cnt > 1) {
+        rebalancer_ = std::thread([this, rebalance_ms]() {
+            uint32_t slept = 0;
+            while(!rebalancer_stop_.load(std::memory_order_relaxed)) {
+                usleep(1000);
+                if(++slept < rebalance_ms) continue;
+                slept = 0;
+                rebalance();
+            }
+        });
+    }
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::~ShardedTLBtreeImpl() {
+    rebalancer_stop_.store(true);
+    if(rebalancer_.joinable()) rebalancer_.join();
+
+    vector<request_t> stops(shard_cnt_);
+    for(int i = 0; i < shard_cnt_; i++) {
+        stops[i].type = REQ_STOP;
+        shards_[i].queue.push(&stops[i]);
+    }
+    for(int i = 0; i < shard_cnt_; i++)
+        shards_[i].owner.join();
+
+    delete route_.load();
+    for(auto r : retired_routes_)
+        delete r;
+    delete [] shards_;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+void ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::serve(int id, bool recover, uint64_t pool_size, bool pin) {
+    shard_t & shard = shards_[id];
+    if(pin) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(id % std::thread::hardware_concurrency(), &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    }
+
+    shard.sample_seed = (uint32_t)id * 2654435761u + 1;
+    shard.tree = new ShardType(shard_path(id), recover, pool_size);
+    if(recover) purge(id);
+    ready_cnt_.fetch_add(1, std::memory_order_release);
+
+    uint32_t idle = 0;
+    while(true) {
+        request_t * r = shard.queue.pop();
+        if(r == NULL) { // poll the queue, and yield the core if it keeps empty
+            if(++idle < SPIN_LIMIT) _mm_pause();
+            else std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+
+        if(r->type == REQ_STOP) {
+            r->done.store(true, std::memory_order_release);
+            break;
+        }
+        handle(id, r);
+    }
+
+    delete shard.tree;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+void ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::handle(int id, request_t * r) {
+    shard_t & shard = shards_[id];
+    if(r->type == REQ_PARK) { // acknowledge, and wait until rebalance() finishes
+        shard.parked.store(true, std::memory_order_release);
+        r->done.store(true, std::memory_order_release);
+        wait_until(shard.parked, false);
+        return ;
+    }
+
+    const route_t * route = route_.load(std::memory_order_acquire);
+    int owner = route->shard_of(r->key);
+    if(owner != id) { // the boundaries have moved since the request was routed
+        shards_[owner].queue.push(r);
+        return ;
+    }
+
+    switch (r->type) {
+        case REQ_FIND:
+            r->ret = shard.tree->find(r->key, r->val);
+            break;
+        case REQ_INSERT:
+            shard.tree->insert(r->key, r->val);
+            r->ret = true;
+            break;
+        case REQ_UPDATE:
+            r->ret = shard.tree->update(r->key, r->val);
+            break;
+        case REQ_REMOVE:
+            r->ret = shard.tree->remove(r->key);
+            break;
+        case REQ_SCAN: // the route of this shard does not change while its owner serves
+            r->end = std::min(r->hi, id == shard_cnt_ - 1 ? MAX_KEY : route->bounds[id]);
+            shard.tree->scan(r->key, r->end, *r->out);
+            r->ret = true;
+            break;
+        default:
+            break;
+    }
+
+    // sample the served key into the reservoir, used to choose new boundaries
+    uint64_t seen = shard.sample_seen++;
+    if(seen < SAMPLE_SIZE) {
+        shard.samples[seen] = r->key;
+    } else {
+        uint32_t & x = shard.sample_seed;
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        if(x % seen < SAMPLE_SIZE) shard.samples[x % SAMPLE_SIZE] = r->key;
+    }
+    shard.served.fetch_add(1, std::memory_order_relaxed);
+
+    r->done.store(true, std::memory_order_release);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+bool ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::rebalance(double imbalance) {
+    if(shard_cnt_ < 2 || !rebalance_mtx_.trylock())
+        return false;
+
+    vector<uint64_t> loads(shard_cnt_);
+    uint64_t total = 0;
+    int hot = 0;
+    for(int i = 0; i < shard_cnt_; i++) {
+        loads[i] = shards_[i].served.exchange(0, std::memory_order_relaxed);
+        total += loads[i];
+        if(loads[i] > loads[hot]) hot = i;
+    }
+    if(total == 0 || loads[hot] < imbalance * total / shard_cnt_) {
+        rebalance_mtx_.unlock();
+        return false;
+    }
+
+    // give the keys on one side of the median to the less loaded neighbour
+    int to;
+    if(hot == 0) to = 1;
+    else if(hot == shard_cnt_ - 1) to = hot - 1;
+    else to = loads[hot - 1] < loads[hot + 1] ? hot - 1 : hot + 1;
+
+    park(hot);
+    park(to);
+
+    route_t * old_route = route_.load(std::memory_order_acquire);
+    _key_t lo = hot == 0 ? MIN_KEY : old_route->bounds[hot - 1];
+    _key_t hi = hot == shard_cnt_ - 1 ? MAX_KEY : old_route->bounds[hot];
+
+    // both owners are parked, so the two trees are operated exclusively here (the parked flags 
+    // hand them over with release/acquire, as single-owner trees require)
+    shard_t & shard = shards_[hot];
+    vector<_key_t> samples;
+    for(uint64_t i = 0; i < std::min(shard.sample_seen, (uint64_t)SAMPLE_SIZE); i++) {
+        if(shard.samples[i] > lo && shard.samples[i] < hi)
+            samples.push_back(shard.samples[i]);
+    }
+
+    bool moved = false;
+    if(samples.size() > 1) {
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        _key_t median = samples[samples.size() / 2];
+
+        // [lo, median) goes to the left neighbour, or [median, hi) to the right one
+        _key_t mlo = to < hot ? lo : median;
+        _key_t mhi = to < hot ? median : hi;
+        route_t * new_route = new route_t(*old_route);
+        new_route->bounds[to < hot ? hot - 1 : hot] = median;
+
+        /* copy the records first, then switch the boundaries and purge the old copies, a crash
+           in between leaves stale copies out of the range of a shard, which purge() removes
+           when the shards are recovered, and never loses a record */
+        vector<Record> recs;
+        shard.tree->scan(mlo, mhi, recs);
+        for(auto & r : recs)
+            shards_[to].tree->insert(r.key, (uint64_t)r.val);
+
+        persist_route(new_route);
+        route_.store(new_route, std::memory_order_release);
+        retired_routes_.push_back(old_route);
+
+        for(auto & r : recs)
+            shard.tree->remove(r.key);
+        moved = true;
+    }
+    shard.sample_seen = 0;
+
+    unpark(hot);
+    unpark(to);
+
+    rebalance_mtx_.unlock();
+    return moved;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+void ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::park(int id) {
+    request_t r(REQ_PARK);
+    shards_[id].queue.push(&r);
+    wait_until(r.done, true);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+void ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::unpark(int id) {
+    shards_[id].parked.store(false, std::memory_order_release);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+void ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::purge(int id) {
+    // remove the records out of the persisted range of the shard, left by a migration that crashed
+    const route_t * route = route_.load(std::memory_order_acquire);
+    _key_t lo = id == 0 ? MIN_KEY : route->bounds[id - 1];
+    _key_t hi = id == shard_cnt_ - 1 ? MAX_KEY : route->bounds[id];
+    ShardType * tree = shards_[id].tree;
+
+    vector<Record> stale;
+    if(lo > MIN_KEY) tree->scan(MIN_KEY, lo, stale);
+    if(hi < MAX_KEY) tree->scan(hi, MAX_KEY, stale);
+    for(auto & r : stale)
+        tree->remove(r.key);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD>
+void ShardedTLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::persist_route(const route_t * route) {
+    /* write a new route file and rename it, so a crash leaves either the old or the new boundaries.
+       The file is synced before the rename and the directory after it, so the new boundaries are
+       durable before the caller publishes them and removes the migrated records */
+    string tmp_path = path_ + ".route.tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int cnt = route->bounds.size();
+    if(fd < 0 || write(fd, &cnt, sizeof(int)) != sizeof(int)
+              || write(fd, route->bounds.data(), sizeof(_key_t) * cnt) != (ssize_t)(sizeof(_key_t) * cnt)
+              || fsync(fd) != 0 || close(fd) != 0) {
+        printf("Route File Not Written\n");
+        exit(-1);
+    }
+    if(std::rename(tmp_path.c_str(), (path_ + ".route").c_str()) != 0) {
+        printf("Route File Not Renamed\n");
+        exit(-1);
+    }
+
+    size_t slash = path_.rfind('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path_.substr(0, slash));
+    int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(dfd < 0 || fsync(dfd) != 0) {
+        printf("Route Directory Not Synced\n");
+        exit(-1);
+    }
+    close(dfd);
+}
+
+} // tlbtree namespace
+
+#endif //__SHARDEDIMPL_H__
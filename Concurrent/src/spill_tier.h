@@ -0,0 +1,335 @@
+/*  spill_tier.h - A file tier of cold sub-index trees behind the PM down layer
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __SPILLTIER_H__
+#define __SPILLTIER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "spinlock.h"
+
+/*
+    SpillTier: the records of cold sub-index trees, moved out of PM into fixed-size blocks of a
+    file (e.g. on an SSD), so that PM holds the working set and the top layer only.
+
+    A spilled sub-index tree stays on PM as a stub of its leftmost path without records, since its
+    subroot is referenced by the top layer and the sibling chain, and its leftmost node of each
+    level by the previous sub-index tree. The block starts with a header, the descriptor of the
+    spilled subtree, which holds the offset of its subroot in the pool: the headers are all that is
+    needed to find the spilled subtrees again when the tree is reopened.
+
+        mover:  begin_move    write the block (PREPARED)    publish the entry    wait for the readers
+                empty the PM subtree    commit the block (SPILLED)    end_move
+
+    with the writers kept out by a ColdGate, see cold_gate.h. A reader of a spilled subtree
+    searches its block, read into a bounded DRAM cache on a miss. A writer loads the block back
+    into PM and frees it before it writes, so a block never holds stale records. At recovery, the
+    PM subtree of a PREPARED or SPILLED block is emptied again.
+*/
+class SpillTier {
+public:
+    enum {MISS = 0, FOUND, ABSENT}; // results of find()
+
+private:
+    enum {FREE = 0, PREPARED, SPILLED};
+
+    struct header_t {
+        uint64_t state;
+        uint64_t root;      // offset of the subroot in the pool
+        uint64_t count;     // sorted records that follow the header
+        uint64_t padding;
+    };
+
+    typedef std::shared_ptr<const std::vector<Record>> block_t;
+
+    struct entry_t {
+        const void * root;
+        uint64_t block;
+        bool spilled;       // false once it is faulted back into PM
+        std::mutex io_mtx;  // reading the block and faulting it back
+        block_t cached;     // guarded by map_mtx_, NULL if not cached
+    };
+
+    int fd_;
+    size_t block_size_;
+    uint32_t cap_;
+    size_t cache_blocks_;
+    Spinlock map_mtx_;      // guards the maps and lists below
+    std::unordered_map<const void *, std::shared_ptr<entry_t>> entries_;
+    std::deque<const void *> cached_;                // cached blocks, evicted in the order of loading
+    std::vector<uint64_t> free_blocks_;
+    uint64_t block_cnt_;
+    std::unordered_map<uint64_t, uint64_t> pending_; // subroot offset => block, found at recovery
+    std::atomic<uint64_t> spills_, faults_, loads_;
+
+public:
+    /*
+     *  @param file         the file of the blocks, truncated unless recover
+     *  @param recover      keep the blocks of the file, see pending()
+     *  @param cap          the maximum records of a sub-index tree
+     *  @param cache_size   DRAM budget in bytes of the cached blocks
+     */
+    SpillTier(const char * file, bool recover, uint32_t cap, size_t cache_size): cap_(cap), block_cnt_(0),
+            spills_(0), faults_(0), loads_(0) {
+        block_size_ = (sizeof(header_t) + cap * sizeof(Record) + 4095) / 4096 * 4096;
+        cache_blocks_ = std::max((size_t)1, cache_size / block_size_);
+
+        fd_ = open(file, O_CREAT | O_RDWR | (recover ? 0 : O_TRUNC), S_IRUSR | S_IWUSR);
+        if(fd_ < 0) {
+            printf("can not open the spill file %s\n", file);
+            exit(-1);
+        }
+
+        struct stat st;
+        fstat(fd_, &st);
+        block_cnt_ = (st.st_size + block_size_ - 1) / block_size_; // the last block is not padded
+        for(uint64_t b = 0; b < block_cnt_; b++) {
+            header_t h;
+            if(pread(fd_, &h, sizeof(header_t), b * block_size_) != sizeof(header_t) || h.state == FREE)
+                free_blocks_.push_back(b);
+            else
+                pending_[h.root] = b;
+        }
+    }
+
+    ~SpillTier() {
+        close(fd_);
+    }
+
+    /* offsets of the subroots whose blocks were PREPARED or SPILLED when the file was opened,
+       each of them has to be emptied on PM again and then handed to adopt() */
+    std::vector<uint64_t> pending() const {
+        std::vector<uint64_t> roots;
+        for(auto & p : pending_)
+            roots.push_back(p.first);
+        return roots;
+    }
+
+    void adopt(const void * root, uint64_t root_off) {
+        uint64_t b = pending_[root_off];
+        pending_.erase(root_off);
+        write_header(b, SPILLED, root_off, -1);
+
+        std::shared_ptr<entry_t> e = std::make_shared<entry_t>();
+        e->root = root;
+        e->block = b;
+        e->spilled = true;
+        entries_[root] = e;
+    }
+
+    inline bool contains(const void * root) {
+        return get(root) != NULL;
+    }
+
+    /* write the records of the subtree into a block and publish it to the readers, false if they
+       do not fit in a block */
+    bool prepare(const void * root, uint64_t root_off, const std::vector<Record> & recs) {
+        if(recs.size() > cap_) return false;
+
+        map_mtx_.lock();
+        uint64_t b;
+        if(free_blocks_.empty()) {
+            b = block_cnt_++;
+        } else {
+            b = free_blocks_.back();
+            free_blocks_.pop_back();
+        }
+        map_mtx_.unlock();
+
+        std::vector<char> buf(sizeof(header_t) + recs.size() * sizeof(Record));
+        header_t * h = (header_t *)buf.data();
+        h->state = PREPARED;
+        h->root = root_off;
+        h->count = recs.size();
+        h->padding = 0;
+        std::copy(recs.begin(), recs.end(), (Record *)(h + 1));
+        if(pwrite(fd_, buf.data(), buf.size(), b * block_size_) != (ssize_t)buf.size() || fdatasync(fd_) != 0) {
+            printf("can not write the spill file\n");
+            exit(-1);
+        }
+
+        std::shared_ptr<entry_t> e = std::make_shared<entry_t>();
+        e->root = root;
+        e->block = b;
+        e->spilled = true;
+        map_mtx_.lock();
+        entries_[root] = e;
+        map_mtx_.unlock();
+        cache(e, std::make_shared<const std::vector<Record>>(recs)); // it is read first after the spill, if ever
+        return true;
+    }
+
+    /* the PM subtree of root is emptied, the block becomes the only copy of the records */
+    void commit(const void * root) {
+        std::shared_ptr<entry_t> e = get(root);
+        write_header(e->block, SPILLED, -1, -1);
+        spills_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* search the block of the subtree rooted at root, MISS if it is not spilled */
+    int find(const void * root, const _key_t & k, uint64_t & v) {
+        std::shared_ptr<entry_t> e = get(root);
+        if(e == NULL) return MISS;
+        block_t b = load(e);
+        if(b == NULL) return MISS;
+
+        auto it = std::lower_bound(b->begin(), b->end(), k, [](const Record & r, const _key_t & key) {
+            return r.key < key;
+        });
+        if(it == b->end() || it->key != k) return ABSENT;
+        v = (uint64_t)it->val;
+        return FOUND;
+    }
+
+    /* append the records within [lo, hi) of the block of root, false if it is not spilled */
+    bool scan(const void * root, const _key_t & lo, const _key_t & hi, std::vector<Record> & out) {
+        std::shared_ptr<entry_t> e = get(root);
+        if(e == NULL) return false;
+        block_t b = load(e);
+        if(b == NULL) return false;
+
+        for(const Record & r : *b) {
+            if(r.key >= hi) break;
+            if(r.key >= lo) out.push_back(r);
+        }
+        return true;
+    }
+
+    /* start reading the block of root ahead, false if it is not spilled or cached already */
+    bool prefetch(const void * root) {
+        std::shared_ptr<entry_t> e = get(root);
+        if(e == NULL) return false;
+        map_mtx_.lock();
+        bool cached = e->cached != NULL;
+        map_mtx_.unlock();
+        if(cached) return false;
+
+        posix_fadvise(fd_, e->block * block_size_, block_size_, POSIX_FADV_WILLNEED);
+        return true;
+    }
+
+    /* load the subtree rooted at root back into PM with fill(records), free its block */
+    template<typename F>
+    void fault(const void * root, F fill) {
+        std::shared_ptr<entry_t> e = get(root);
+        if(e == NULL) return ;
+
+        std::lock_guard<std::mutex> io(e->io_mtx);
+        if(!e->spilled) return ; // by another writer
+
+        map_mtx_.lock();
+        block_t b = e->cached;
+        map_mtx_.unlock();
+        if(b == NULL) b = read_block(e->block);
+
+        fill(*b);
+        write_header(e->block, FREE, -1, -1); // durable before the subtree is written
+        e->spilled = false;
+
+        map_mtx_.lock();
+        entries_.erase(root);
+        free_blocks_.push_back(e->block);
+        map_mtx_.unlock();
+        faults_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void get_stats(uint64_t & spills, uint64_t & faults, uint64_t & loads) const {
+        spills = spills_.load(std::memory_order_relaxed);
+        faults = faults_.load(std::memory_order_relaxed);
+        loads = loads_.load(std::memory_order_relaxed);
+    }
+
+    inline size_t size() { // in sub-index trees
+        map_mtx_.lock();
+        size_t ret = entries_.size();
+        map_mtx_.unlock();
+        return ret;
+    }
+
+private:
+    inline std::shared_ptr<entry_t> get(const void * root) {
+        map_mtx_.lock();
+        auto it = entries_.find(root);
+        std::shared_ptr<entry_t> e = it == entries_.end() ? NULL : it->second;
+        map_mtx_.unlock();
+        return e;
+    }
+
+    block_t load(const std::shared_ptr<entry_t> & e) { // NULL if faulted back
+        map_mtx_.lock();
+        block_t b = e->cached;
+        map_mtx_.unlock();
+        if(b != NULL) return b;
+
+        std::lock_guard<std::mutex> io(e->io_mtx);
+        if(!e->spilled) return NULL;
+        map_mtx_.lock();
+        b = e->cached; // by another reader meanwhile
+        map_mtx_.unlock();
+        if(b != NULL) return b;
+
+        b = read_block(e->block);
+        cache(e, b);
+        return b;
+    }
+
+    void cache(const std::shared_ptr<entry_t> & e, block_t b) {
+        map_mtx_.lock();
+        e->cached = b;
+        cached_.push_back(e->root);
+        while(cached_.size() > cache_blocks_) {
+            auto it = entries_.find(cached_.front());
+            if(it != entries_.end() && it->second != e) it->second->cached = NULL;
+            cached_.pop_front();
+        }
+        map_mtx_.unlock();
+    }
+
+    block_t read_block(uint64_t b) {
+        header_t h;
+        if(pread(fd_, &h, sizeof(header_t), b * block_size_) != sizeof(header_t) || h.count > cap_) {
+            printf("can not read the spill file\n");
+            exit(-1);
+        }
+        std::vector<Record> * recs = new std::vector<Record>(h.count);
+        ssize_t size = h.count * sizeof(Record);
+        if(pread(fd_, recs->data(), size, b * block_size_ + sizeof(header_t)) != size) {
+            printf("can not read the spill file\n");
+            exit(-1);
+        }
+        loads_.fetch_add(1, std::memory_order_relaxed);
+        return block_t(recs);
+    }
+
+    void write_header(uint64_t b, uint64_t state, uint64_t root_off, uint64_t count) { // -1 keeps a field
+        header_t h;
+        if(pread(fd_, &h, sizeof(header_t), b * block_size_) != sizeof(header_t)) {
+            printf("can not read the spill file\n");
+            exit(-1);
+        }
+        h.state = state;
+        if(root_off != (uint64_t)-1) h.root = root_off;
+        if(count != (uint64_t)-1) h.count = count;
+        if(pwrite(fd_, &h, sizeof(header_t), b * block_size_) != sizeof(header_t) || fdatasync(fd_) != 0) {
+            printf("can not write the spill file\n");
+            exit(-1);
+        }
+    }
+};
+
+#endif //__SPILLTIER_H__
@@ -5,9 +5,44 @@
 #define __SPINLOCK_H__
 
 #include <atomic>
+#include <cstdint>
 #include <emmintrin.h>
 #include <thread>
 
+/*
+    Bounded exponential backoff with jitter for contended latches.
+
+    Each failed attempt doubles the pause window (up to MAX_SPINS) and waits for a random
+    number of pauses within it, so that waiters spread out instead of re-reading the latch 
+    line in lockstep while the owner is still flushing it.
+*/
+class Backoff {
+public:
+    static const uint32_t MIN_SPINS = 4;
+    static const uint32_t MAX_SPINS = 1024;
+
+    Backoff(): limit_(MIN_SPINS) {}
+
+    inline void pause() {
+        uint32_t spins = (limit_ >> 1) + next_random() % (limit_ >> 1); // jitter in [limit/2, limit)
+        for(uint32_t i = 0; i < spins; i++)
+            _mm_pause();
+        if(limit_ < MAX_SPINS) limit_ <<= 1;
+    }
+
+    static inline uint32_t next_random() { // xorshift, one seed per thread
+        static thread_local uint32_t seed = 0;
+        if(seed == 0) seed = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+private:
+    uint32_t limit_;
+};
+
 class Spinlock {
 public:
     Spinlock() {
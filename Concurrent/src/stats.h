@@ -0,0 +1,174 @@
+/*  stats.h - Runtime statistics of TLBtree
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <atomic>
+#include <algorithm>
+
+#include "common.h"
+#include "thread_slots.h"
+
+/*
+    Events counted on the paths of the operations of a tree. The down layer does not know the tree
+    of its nodes, it counts into gstats, installed with galc by each operation of the tree.
+*/
+enum StatEvent {
+    ST_INSERT = 0, ST_FIND, ST_UPDATE, ST_REMOVE, ST_SCAN, // operations by type
+    ST_SPLIT,           // down layer nodes split
+    ST_MERGE,           // down layer nodes merged into their left neighbour
+    ST_TOP_FAIL,        // subtree roots the top layer had no room for, kept for the next rebuilding
+    ST_LATCH_RETRY,     // failed attempts to latch a down layer node
+    ST_VERSION_RETRY,   // get_child restarted because the node changed under it
+    ST_CHAIN_SUM,       // sibling chain steps of the point operations
+    ST_CHAIN,           // histogram of the steps per operation, the last bucket counts the longer walks
+    ST_EVENTS = ST_CHAIN + 9
+};
+
+/*
+    StatCounters: the counters of a tree, a slot for each thread slot (see thread_slots.h), which
+    its thread adds to with plain loads and stores of its own cache lines. A snapshot sums the
+    slots, reading the counts of the threads running at the moment without stopping them. A slot
+    is allocated by the first event of its thread and kept for the next thread of the index, so
+    the counts never drop and the slots are bounded by the threads alive at the same time.
+*/
+class StatCounters {
+public:
+    static const int CHAIN_BUCKETS = ST_EVENTS - ST_CHAIN;
+
+    StatCounters() {
+        for(int i = 0; i < ThreadSlots::MAX; i++)
+            slots_[i].store(NULL, std::memory_order_relaxed);
+    }
+
+    ~StatCounters() {
+        for(int i = 0; i < ThreadSlots::MAX; i++)
+            delete slots_[i].load(std::memory_order_relaxed);
+    }
+
+    inline void add(StatEvent e, uint64_t n = 1) {
+        std::atomic<uint64_t> & c = local()->cnt[e];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void chain(int steps) {
+        steps = std::max(0, std::min(steps, CHAIN_BUCKETS - 1)); // the last bucket counts the longer walks
+        add(ST_CHAIN_SUM, steps);
+        add((StatEvent)(ST_CHAIN + steps));
+    }
+
+    void sum(uint64_t out[ST_EVENTS]) const {
+        for(int e = 0; e < ST_EVENTS; e++) out[e] = 0;
+        int cnt = ThreadSlots::count();
+        for(int i = 0; i < cnt; i++) {
+            slot_t * s = slots_[i].load(std::memory_order_acquire);
+            if(s == NULL) continue;
+            for(int e = 0; e < ST_EVENTS; e++) out[e] += s->cnt[e].load(std::memory_order_relaxed);
+        }
+    }
+
+    /* count an event of the tree whose operation the thread runs, if any (e.g. not a bare down layer) */
+    static inline void count(StatEvent e, uint64_t n = 1);
+
+private:
+    struct alignas(CACHE_LINE_SIZE) slot_t {
+        std::atomic<uint64_t> cnt[ST_EVENTS] = {};
+    };
+
+    inline slot_t * local() {
+        std::atomic<slot_t *> & slot = slots_[ThreadSlots::id()];
+        slot_t * s = slot.load(std::memory_order_relaxed);
+        if(s == NULL) { // only this thread stores into its slot
+            s = new slot_t;
+            slot.store(s, std::memory_order_release);
+        }
+        return s;
+    }
+
+    std::atomic<slot_t *> slots_[ThreadSlots::MAX];
+};
+
+extern __thread StatCounters * gstats;
+
+inline void StatCounters::count(StatEvent e, uint64_t n) {
+    if(gstats != NULL) gstats->add(e, n);
+}
+
+/* a snapshot of TLBtreeImpl::stats() */
+struct TreeStats {
+    uint64_t events[ST_EVENTS];     // of this tree, see StatEvent
+    uint64_t rebuilds;              // of the top layer of this tree
+    double rebuild_seconds;         // spent in them
+    double rebuild_max_seconds;     // in the longest of them
+    uint64_t mutable_size;          // subtree roots waiting for the next rebuilding
+    uint64_t pm_used;               // bytes of the blocks the allocator handed out
+    uint64_t pm_capacity;
+};
+
+/*
+    The stats in the Prometheus text format, each metric named with prefix, e.g. for a metrics
+    agent that scrapes a file (see TLBtree::export_stats) or an endpoint. The counters only grow,
+    the agent derives the rates.
+*/
+inline std::string format_stats(const TreeStats & st, const std::string & prefix = "tlbtree") {
+    static const char * OPS[] = {"insert", "find", "update", "remove", "scan"};
+    std::string out;
+    char line[256];
+    auto metric = [&](const char * name, const char * type, const char * help) {
+        snprintf(line, sizeof(line), "# HELP %s_%s %s\n# TYPE %s_%s %s\n", prefix.c_str(), name, help, prefix.c_str(), name, type);
+        out += line;
+    };
+    auto value = [&](const char * name, const char * labels, double v) {
+        snprintf(line, sizeof(line), "%s_%s%s %.17g\n", prefix.c_str(), name, labels, v);
+        out += line;
+    };
+
+    metric("ops_total", "counter", "Operations by type");
+    for(int op = ST_INSERT; op <= ST_SCAN; op++) {
+        std::string label = std::string("{op=\"") + OPS[op] + "\"}";
+        value("ops_total", label.c_str(), st.events[op]);
+    }
+
+    metric("chain_steps", "histogram", "Sibling chain steps of the point operations past the subtree the top layer points to");
+    uint64_t cumulated = 0;
+    for(int b = 0; b < StatCounters::CHAIN_BUCKETS; b++) {
+        cumulated += st.events[ST_CHAIN + b];
+        std::string label = b < StatCounters::CHAIN_BUCKETS - 1 ? "{le=\"" + std::to_string(b) + "\"}" : "{le=\"+Inf\"}";
+        value("chain_steps_bucket", label.c_str(), cumulated);
+    }
+    value("chain_steps_sum", "", st.events[ST_CHAIN_SUM]);
+    value("chain_steps_count", "", cumulated);
+
+    metric("splits_total", "counter", "Down layer nodes split");
+    value("splits_total", "", st.events[ST_SPLIT]);
+    metric("merges_total", "counter", "Down layer nodes merged");
+    value("merges_total", "", st.events[ST_MERGE]);
+    metric("top_insert_failures_total", "counter", "Subtree roots the top layer had no room for");
+    value("top_insert_failures_total", "", st.events[ST_TOP_FAIL]);
+    metric("latch_retries_total", "counter", "Failed attempts to latch a down layer node");
+    value("latch_retries_total", "", st.events[ST_LATCH_RETRY]);
+    metric("version_retries_total", "counter", "Down layer reads restarted by a concurrent write");
+    value("version_retries_total", "", st.events[ST_VERSION_RETRY]);
+
+    metric("rebuilds_total", "counter", "Rebuildings of the top layer");
+    value("rebuilds_total", "", st.rebuilds);
+    metric("rebuild_seconds_total", "counter", "Time spent rebuilding the top layer");
+    value("rebuild_seconds_total", "", st.rebuild_seconds);
+    metric("rebuild_max_seconds", "gauge", "The longest rebuilding of the top layer");
+    value("rebuild_max_seconds", "", st.rebuild_max_seconds);
+    metric("mutable_size", "gauge", "Subtree roots waiting for the next rebuilding");
+    value("mutable_size", "", st.mutable_size);
+    metric("pm_used_bytes", "gauge", "Bytes of the pool handed out by the allocator");
+    value("pm_used_bytes", "", st.pm_used);
+    metric("pm_capacity_bytes", "gauge", "Bytes of the pool the allocator hands out blocks from");
+    value("pm_capacity_bytes", "", st.pm_capacity);
+    return out;
+}
+
+#endif //__STATS_H__
@@ -0,0 +1,72 @@
+/*  thread_slots.h - Small indexes of the live threads for per-thread state in fixed arrays
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __THREADSLOTS_H__
+#define __THREADSLOTS_H__
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+
+/*
+    ThreadSlots: a thread takes the lowest free index below MAX on its first call of id() and
+    gives it back when it exits, so the next thread reuses it. Per-thread state kept in an array
+    of MAX slots is thus bounded by the threads alive at the same time, not by all the threads
+    ever started (e.g. the detached rebuilding threads). A slot passes to its next thread under
+    the mutex, so its state is handed over like that of a single owner.
+*/
+class ThreadSlots {
+public:
+    static const int MAX = 1024;
+
+    static inline int id() {
+        static thread_local owner_t owner;
+        return owner.id;
+    }
+
+    /* the indexes handed out so far are below it */
+    static inline int count() {
+        return high().load(std::memory_order_acquire);
+    }
+
+private:
+    struct owner_t {
+        int id;
+        owner_t(): id(take()) {}
+        ~owner_t() { give(id); }
+    };
+
+    static int take() {
+        std::lock_guard<std::mutex> l(mtx());
+        int hi = high().load(std::memory_order_relaxed);
+        for(int i = 0; i < hi; i++) {
+            if(!used()[i]) {
+                used()[i] = true;
+                return i;
+            }
+        }
+        if(hi == MAX) {
+            printf("more than %d threads use the tree at the same time\n", MAX);
+            exit(-1);
+        }
+        used()[hi] = true;
+        high().store(hi + 1, std::memory_order_release);
+        return hi;
+    }
+
+    static void give(int id) {
+        std::lock_guard<std::mutex> l(mtx());
+        used()[id] = false;
+    }
+
+    static std::mutex & mtx() { static std::mutex m; return m; }
+
+    static bool * used() { static bool u[MAX] = {}; return u; }
+
+    static std::atomic<int> & high() { static std::atomic<int> h(0); return h; }
+};
+
+#endif //__THREADSLOTS_H__
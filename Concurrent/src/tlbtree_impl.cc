@@ -1,3 +1,4 @@
 #include "tlbtree_impl.h"
 
-PMAllocator * galc;
\ No newline at end of file
+__thread PMAllocator * galc;
+__thread StatCounters * gstats;
\ No newline at end of file
@@ -9,17 +9,28 @@
 #include <string>
 #include <thread>
 #include <algorithm>
+#include <functional>
 #include <unistd.h>
 
 #include "pmallocator.h"
 #include "fixtree.h"
 #include "spinlock.h"
 #include "wotree256.h"
-
-extern PMAllocator * galc;
+#include "coroutine.h"
+#include "policy.h"
+#include "record_cache.h"
+#include "dram_tier.h"
+#include "spill_tier.h"
+#include "packed_subtree.h"
+#include "cold_gate.h"
+#include "key_filter.h"
+#include "stats.h"
+#include "heatmap.h"
+#include "phase_timer.h"
 
 #define BACKGROUND_REBUILD
 // choose uptree type, providing interfaces: insert, remove, update, find, merge, free_uptree
+// (and root_index, descend, node_addr, leaf_lower for the asynchronous operations)
 #define UPTREE_NS   fixtree
 // choose downtree type, providing interfaces: insert, find_lower, remove_lower
 #define DOWNTREE_NS wotree256
@@ -28,12 +39,29 @@ namespace tlbtree {
 
 using std::string;
 using std::vector;
-using Node = DOWNTREE_NS::Node;
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD=2>
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+class PoolAnalyzer; // reads the persistent structures of a closed pool, see pool_analyzer.h
+
+/*  TLBtreeImpl:
+        Policy is ConcurrentPolicy for a tree shared by threads, or SingleOwnerPolicy for a tree 
+    used by one thread at a time, whose latches and versions are compiled out, see policy.h
+*/
+template<int DOWNLEVEL, int REBUILD_THRESHOLD=2, typename Policy=ConcurrentPolicy>
 class TLBtreeImpl {
 private:
-    typedef TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD> SelfType;
+    template<int, int, typename> friend class PoolAnalyzer;
+
+    typedef TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy> SelfType;
+    typedef DOWNTREE_NS::Node<Policy> Node;
+    typedef UPTREE_NS::uptree_t<Policy> uptree_t;
+    typedef EpochGuard<typename Policy::epoch_t> pin_t;
+
+#ifdef BACKGROUND_REBUILD
+    static const bool BACKGROUND = Policy::concurrent; // no one else could rebuild for a single owner
+#else
+    static const bool BACKGROUND = false;
+#endif
     
     // the entrance of TLBtree that stores its persistent tree metadata
     struct tlbtree_entrance_t {
@@ -45,12 +73,36 @@ private:
     };
     
     // volatile domain
-    UPTREE_NS::uptree_t * uptree_;
+    PMAllocator * alc_;            // the allocator context of this tree, installed into galc by each operation
+    mutable StatCounters counters_; // the events of this tree, installed into gstats with galc
+    uptree_t * uptree_;
     tlbtree_entrance_t * entrance_;
     vector<Record> * mutable_;
-    Spinlock rebuild_mtx_;
-    Spinlock mutable_mtx_;
+    typename Policy::mutex_t rebuild_mtx_;
+    typename Policy::mutex_t mutable_mtx_;
     bool is_rebuilding_;
+    mutable typename Policy::epoch_t top_epoch_; // pinned by the operations, a rebuilding frees the old top layer after them
+    std::function<void(bool)> rebuild_listener_; // told of the start (true) and end (false) of each rebuild, may be empty
+    typename Policy::counter_t rebuilds_, rebuild_ns_, rebuild_max_ns_;
+    RecordCache * cache_;          // optional DRAM cache of hot records, NULL if disabled
+    KeyFilter<Policy> * filter_;   // optional Bloom filter of the keys, NULL if disabled
+    size_t filter_keys_;           // keys in the down layer when the filter was last built
+    size_t filter_subroots_;       // and its sub-index trees
+    DramTier * tier_;              // optional DRAM replicas of read-hot sub-index trees, NULL if disabled
+    std::thread tier_mover_;       // promotes and demotes the replicas in the background
+    std::atomic<bool> movers_stop_;
+    SpillTier * spill_;            // optional file tier of cold sub-index trees, NULL if disabled
+    size_t spill_budget_;          // bytes of PM nodes above which subtrees are spilled
+    std::atomic<bool> compress_;   // whether cold subtrees are packed in PM
+    ColdGate * gate_;              // coldness and the writer gate of spilling and packing, NULL if neither
+    std::thread cold_mover_;       // spills or packs cold subtrees in the background
+    _key_t cold_hand_;             // where the next round of the mover starts
+    typename Policy::mutex_t unpack_mtx_;
+    vector<PackedSubtree *> retired_; // unpacked blocks, released by the next round of the mover
+    mutable typename Policy::epoch_t cold_epoch_; // pinned by the readers of subtrees, a mover empties or frees them after them
+    std::atomic<uint64_t> packs_, unpacks_;
+    bool recovered_;               // whether the tree was opened from an existing pool
+    KeyHeatmap * heat_;            // optional sampled access heat of the subtrees, NULL if disabled
 
 public:
     TLBtreeImpl(string path, bool recover=true, uint64_t pool_size=10 * (1024UL * 1024 * 1024));
@@ -65,22 +117,203 @@ public:
 
     bool remove(const _key_t & k);
 
+    void scan(const _key_t & lo, const _key_t & hi, vector<Record> & out) const; // records within [lo, hi)
+
     inline void printAll() { uptree_->printAll();}
 
+    /* cache hot records in DRAM with a budget of cache_size bytes, consulted by find before the 
+       tree. Call it before any concurrent operation; 0 disables the cache */
+    void enable_cache(size_t cache_size);
+
+    inline const RecordCache * cache() const { return cache_; }
+
+    inline bool rebuilding() const { return is_rebuilding_; } // the top layer is being rebuilt
+
+    /* call listener(true) when a rebuilding of the top layer starts and listener(false) when it
+       ends, from the thread that rebuilds. Call it before any concurrent operation */
+    inline void set_rebuild_listener(std::function<void(bool)> listener) { rebuild_listener_ = listener; }
+
+    /* sample the reads and writes of each sub-index tree, and count its splits, into a decaying
+       heatmap of the key space. Call it before any concurrent operation */
+    void enable_heatmap();
+
+    inline const KeyHeatmap * heatmap() const { return heat_; }
+
+    /* the heat of each sub-index tree in key order, the ranges cover the whole key space */
+    void heat_ranges(vector<HeatRange> & out);
+
+    /* a snapshot of the counters of the operations (see stats.h), the rebuildings and the space
+       of this tree, cheap enough to take every second */
+    TreeStats stats();
+
+    /* keep a Bloom filter of the keys, so that find returns "not found" for most absent keys 
+       before it searches the top layer. Inserts add their keys to the filter, which outlives the
+       rebuildings of the top layer. It is built from the down layer now, and rebuilt by the
+       rebuilding whose top layer has twice or half the sub-index trees of the last build, which
+       also forgets the removed keys. Call it before any concurrent operation */
+    void enable_filters();
+
+    /* keep DRAM replicas of the read-hot sub-index trees in a region of dram_size bytes mapped
+       from dram_file, find searches them instead of PM. PM stays the persistent copy, a write 
+       drops the replica of the subtree it writes. Call it before any concurrent operation */
+    void enable_tiering(const char * dram_file, size_t dram_size);
+
+    inline const DramTier * tier() const { return tier_; }
+
+    /* move the records of cold sub-index trees into blocks of spill_file (e.g. on an SSD) while
+       the PM nodes of the down layer take more than pm_budget bytes, the spilled subtrees stay on
+       PM as empty stubs. A reader of a spilled subtree searches its block, cached in DRAM with a
+       budget of cache_size bytes, a writer loads it back into PM. A tree with spilled subtrees
+       must be reopened with the same spill file. Call it before any concurrent operation */
+    void enable_spill(const char * spill_file, size_t pm_budget, size_t cache_size = 16 * (1024UL * 1024));
+
+    inline SpillTier * spill() const { return spill_; }
+
+    /* pack the records of cold sub-index trees into PackedSubtree blocks in PM, which take the 
+       place of their nodes. A reader of a packed subtree searches its block, a writer unpacks 
+       it back into nodes. A tree with packed subtrees must be reopened with compression (or 
+       spilling) enabled. Call it before any concurrent operation */
+    void enable_compression();
+
+    inline void get_compression_stats(uint64_t & packs, uint64_t & unpacks) const {
+        packs = packs_.load(std::memory_order_relaxed);
+        unpacks = unpacks_.load(std::memory_order_relaxed);
+    }
+
+#if defined(__cpp_impl_coroutine)
+    /* Asynchronous versions of find/insert/update. 
+       They prefetch the next node and suspend before touching it: at each level of the top layer, 
+       at each hop in the sibling chain and at each level of the sub-index tree. 
+       Writes descend asynchronously and then do the latched part synchronously on cached nodes,
+       so a task never suspends holding a latch. A task pins the top layer until it finishes, 
+       so a rebuilding waits for the tasks in flight before it frees the old one.
+       NOTICE: v must outlive the task */
+    coro::task<bool> find_async(_key_t k, uint64_t & v) const;
+
+    coro::task<void> insert_async(_key_t k, uint64_t v);
+
+    coro::task<bool> update_async(_key_t k, uint64_t v);
+#endif
+
 private:
+    inline void install() const { // the context of the down layer for an operation of this tree
+        galc = alc_;
+        gstats = &counters_;
+    }
+
+    void insert_subtree(Node ** root_ptr, const _key_t & k, uint64_t v, int goes_steps);
+
+#if defined(__cpp_impl_coroutine)
+    coro::task<Node **> locate_async(_key_t k, bool inclusive, uint64_t gen, int & goes_steps) const;
+
+    coro::task<Node *> descend_async(Node * root, _key_t k) const;
+
+    struct prefetch_t : public coro::prefetch { // re-install the context of the down layer when resumed
+        PMAllocator * alc_;
+        StatCounters * stats_;
+        prefetch_t(PMAllocator * alc, StatCounters * stats, const void * addr, int size = CACHE_LINE_SIZE): 
+            coro::prefetch(addr, size), alc_(alc), stats_(stats) {}
+        void await_resume() const noexcept { galc = alc_; gstats = stats_; }
+    };
+
+    inline prefetch_t touch(const void * addr, int size = CACHE_LINE_SIZE) const {
+        return prefetch_t(alc_, &counters_, addr, size);
+    }
+
+    /* a concurrent task pins the top layer across its suspensions. A single owner rebuilds in the 
+       foreground, within another task, and frees the old top layer at once: a task that was
+       suspended meanwhile locates its subtree again */
+    inline uint64_t top_gen() const { return rebuilds_.load(); }
+
+    inline bool top_moved(uint64_t gen) const { return !Policy::concurrent && rebuilds_.load() != gen; }
+#endif
+
     void rebuild_fast();
 
     void rebuild_recover();
+
+    void account_rebuild(double start); // a rebuilding started at seconds() start is ending
+
+    void build_filter(size_t expected_keys); // replace the filter by one of the keys now in the down layer
+
+    static inline uint32_t subtree_capacity() { // the records of a full sub-index tree
+        uint32_t cap = DOWNTREE_NS::CARDINALITY;
+        for(int l = 1; l < DOWNLEVEL; l++) cap *= DOWNTREE_NS::CARDINALITY + 1;
+        return cap;
+    }
+
+    inline size_t filter_capacity(size_t subtrees) const { // twice the keys expected in subtrees, at least half full
+        size_t per_subtree = filter_subroots_ > 0 ? filter_keys_ / filter_subroots_ : 0;
+        return 2 * subtrees * std::max(per_subtree, (size_t)subtree_capacity() / 2);
+    }
+
+    void migrate() const; // one round of promotions and demotions of the DRAM tier
+
+    void drop_replicas(Node ** root_ptr, const _key_t & k);
+
+    void start_cold_mover();
+
+    void cold_round(); // spill cold subtrees until the PM nodes fit in the budget, or pack some
+
+    bool spill_subtree(Node * root, Node * prev);
+
+    bool pack_subtree(Node * root, Node * prev);
+
+    void unpack_subtree(Node * root);
+
+    void release(PackedSubtree * block);
+
+    inline bool is_spilled(Node * root) const { // the block of a subtree being spilled is searched before its nodes are emptied
+        return spill_ != NULL && (root->state_.unpack.count == 0 || gate_->moving() == root) && spill_->contains(root);
+    }
+
+    inline bool is_cold(Node * root) const { // spilled, packed, or being moved
+        return gate_->moving() == root || DOWNTREE_NS::marked(root) != NULL || is_spilled(root);
+    }
+
+    bool cold_find(Node * root, const _key_t & k, uint64_t & v, bool & found) const; // false if root is resident
+
+    bool cold_scan(Node * root, const _key_t & lo, const _key_t & hi, vector<Record> & out) const;
+
+    /* return the stripe the writer announced itself on. A writer that does not wait gets MOVING
+       instead of waiting for a mover, e.g. a task whose thread runs readers pinned on cold_epoch_ */
+    int enter_subtree(Node ** root_ptr, const _key_t & k, bool wait = true);
+
+    bool fault_in(Node * root, bool wait); // false if it does not wait and root is being moved
+
+    static const int MOVING = -2;
+
+    template<typename F>
+    size_t for_each_record(F f); // return the number of sub-index trees
 };
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::TLBtreeImpl(string path, bool recover, uint64_t pool_size) {
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::TLBtreeImpl(string path, bool recover, uint64_t pool_size) {
     mutable_ = new vector<Record>();
     mutable_->reserve(0xfff);
-    bool is_rebuilding_ = false;
+    is_rebuilding_ = false;
+    rebuilds_.store(0);
+    rebuild_ns_.store(0);
+    rebuild_max_ns_.store(0);
+    cache_ = NULL;
+    filter_ = NULL;
+    filter_keys_ = 0;
+    filter_subroots_ = 0;
+    tier_ = NULL;
+    movers_stop_ = false;
+    spill_ = NULL;
+    spill_budget_ = 0;
+    compress_ = false;
+    gate_ = NULL;
+    cold_hand_ = MIN_KEY;
+    heat_ = NULL;
+    packs_ = 0;
+    unpacks_ = 0;
+    recovered_ = recover;
+    gstats = &counters_; // the down layer counts the events of this tree
     
     if(recover == false) {
-        galc = new PMAllocator(path.c_str(), false, "tlbtree", pool_size);
+        galc = alc_ = new PMAllocator(path.c_str(), false, "tlbtree", pool_size);
         // initialize entrance_
         entrance_ = (tlbtree_entrance_t *) galc->get_root(sizeof(tlbtree_entrance_t));
         entrance_->upent = NULL;
@@ -92,11 +325,11 @@ TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::TLBtreeImpl(string path, bool recover
         
         //allocate a entrance_ to the fixtree
         std::vector<Record> init = {Record(MIN_KEY, (char *)galc->relative(new Node()))}; 
-        uptree_ = new UPTREE_NS::uptree_t(init);
+        uptree_ = new uptree_t(init);
         persist_assign(&(entrance_->upent), galc->relative(UPTREE_NS::get_entrance(uptree_)));
         persist_assign(&(entrance_->use_rebuild_recover), false); // use fast rebuilding next time
     } else {
-        galc = new PMAllocator(path.c_str(), true, "tlbtree", pool_size);
+        galc = alc_ = new PMAllocator(path.c_str(), true, "tlbtree", pool_size);
 
         entrance_ = (tlbtree_entrance_t *) galc->get_root(sizeof(tlbtree_entrance_t));
         if(entrance_ == NULL || entrance_->upent == NULL) { // empty tree
@@ -120,14 +353,19 @@ TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::TLBtreeImpl(string path, bool recover
             }
         }
 
-        uptree_ = new UPTREE_NS::uptree_t (galc->absolute(entrance_->upent));
+        uptree_ = new uptree_t (galc->absolute(entrance_->upent));
     }
 
     persist_assign(&(entrance_->is_clean), false); // set the TLBtree state to be dirty
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::~TLBtreeImpl() {
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::~TLBtreeImpl() {
+    install();
+    movers_stop_ = true;
+    if(tier_mover_.joinable()) tier_mover_.join();
+    if(cold_mover_.joinable()) cold_mover_.join();
+    rebuild_mtx_.lock(); // wait for an on-going background rebuilding
     if(entrance_->use_rebuild_recover == false) { // fast rebuilding next time
         // save all subroots in mutable_ into PM
         Record * rec = (Record *) galc->malloc(std::max((size_t)4096, mutable_->size() * sizeof(Record)));
@@ -147,16 +385,30 @@ TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::~TLBtreeImpl() {
 
     delete uptree_;
     delete mutable_;
-    delete galc;
+    delete cache_;
+    delete filter_;
+    delete tier_;
+    delete spill_;
+    delete gate_;
+    delete heat_;
+    delete alc_;
+    galc = NULL;
+    gstats = NULL;
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::insert(const _key_t & k, uint64_t v) { 
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::insert(const _key_t & k, uint64_t v) { 
+    PHASE_OP(PT_INSERT);
+    install();
+    pin_t pin(&top_epoch_);
+    PHASE_BEGIN(t);
+    if(filter_ != NULL) filter_->add(k); // before the key is visible in the down layer
     Node ** root_ptr = (Node **)uptree_->find_lower(k);
+    PHASE_NEXT(PH_TOP, t);
     Node * downroot = (Node *)galc->absolute(*root_ptr);
 
     // travese in sibling chain
-    int8_t goes_steps = 0;
+    int goes_steps = 0;
     _key_t splitkey; Node ** sibling_ptr;
     downroot->get_sibling(splitkey, sibling_ptr);
     while(splitkey < k) { // the splitkey 
@@ -165,30 +417,404 @@ void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::insert(const _key_t & k, uint64_
         downroot->get_sibling(splitkey, sibling_ptr);
         goes_steps += 1;
     }
+    PHASE_NEXT(PH_CHAIN, t);
+    counters_.add(ST_INSERT);
+    counters_.chain(goes_steps);
+    if(heat_ != NULL) heat_->access(downroot, true);
+    
+    int stripe = gate_ != NULL ? enter_subtree(root_ptr, k) : -1;
+    insert_subtree(root_ptr, k, v, goes_steps);
+    if(stripe >= 0) gate_->leave(stripe);
+    if(tier_ != NULL) drop_replicas(root_ptr, k);
+    if(cache_ != NULL) cache_->update(k, v);
+    if(gate_ != NULL && !BACKGROUND && gate_->tick()) cold_round();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enable_cache(size_t cache_size) {
+    delete cache_;
+    cache_ = cache_size > 0 ? new RecordCache(cache_size) : NULL;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enable_filters() {
+    install();
+    rebuild_mtx_.lock();
+    if(filter_ == NULL) {
+        filter_keys_ = 0;
+        filter_subroots_ = for_each_record([&](const Record &) { filter_keys_++; });
+        build_filter(filter_capacity(filter_subroots_));
+    }
+    rebuild_mtx_.unlock();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enable_tiering(const char * dram_file, size_t dram_size) {
+    if(tier_ != NULL) return ;
+    tier_ = new DramTier(dram_file, dram_size, subtree_capacity());
+
+    if(BACKGROUND) {
+        tier_mover_ = std::thread([this]() {
+            while(!movers_stop_) {
+                usleep(1000);
+                migrate();
+            }
+        });
+    }
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::migrate() const {
+    install();
+    vector<const void *> hot;
+    tier_->round(hot);
+
+    vector<Record> records;
+    for(const void * r : hot) {
+        int id = tier_->begin_promote(r);
+        if(id < 0) break; // the DRAM tier is full
+
+        // the subtree spans from its leftmost leaf up to its split key
+        Node * root = (Node *)r;
+        _key_t hi; Node ** sibling_ptr;
+        root->get_sibling(hi, sibling_ptr);
+        Node * root_off = galc->relative(root);
+        records.clear();
+        pin_t cold_pin(gate_ != NULL ? &cold_epoch_ : NULL);
+        DOWNTREE_NS::scan(&root_off, MIN_KEY, hi, records);
+        if(gate_ != NULL && is_cold(root)) tier_->invalidate(root); // the scan may have missed its records
+        tier_->end_promote(id, records);
+    }
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::drop_replicas(Node ** root_ptr, const _key_t & k) {
+    Node * downroot = (Node *)galc->absolute(*root_ptr);
+    tier_->invalidate(downroot);
+
+    // writers stop at the subtree whose split key equals k, find goes on to its sibling
+    _key_t splitkey; Node ** sibling_ptr;
+    downroot->get_sibling(splitkey, sibling_ptr);
+    if(splitkey == k) tier_->invalidate(galc->absolute(*sibling_ptr));
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enable_spill(const char * spill_file, size_t pm_budget, size_t cache_size) {
+    if(spill_ != NULL) return ;
+    install();
+    spill_ = new SpillTier(spill_file, recovered_, subtree_capacity(), cache_size);
+    spill_budget_ = pm_budget;
+
+    // a crash may have left a spill uncommitted or a fault unfinished, empty their PM subtrees again
+    for(uint64_t root_off : spill_->pending()) {
+        Node * root = (Node *)root_off;
+        vector<Node *> freed;
+        DOWNTREE_NS::empty_subtree(&root, freed);
+        for(Node * n : freed) alc_->recycle<Policy>(n);
+        spill_->adopt(galc->absolute(root), root_off);
+    }
+
+    start_cold_mover();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enable_compression() {
+    compress_ = true;
+    start_cold_mover();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::start_cold_mover() {
+    if(gate_ != NULL) return ;
+    gate_ = new ColdGate();
+
+    if(BACKGROUND) {
+        cold_mover_ = std::thread([this]() {
+            while(!movers_stop_) {
+                usleep(10000);
+                cold_round();
+            }
+        });
+    }
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::cold_round() {
+    install();
+
+    // the blocks unpacked since the last round
+    unpack_mtx_.lock();
+    vector<PackedSubtree *> retired;
+    retired.swap(retired_);
+    unpack_mtx_.unlock();
+    if(!retired.empty()) {
+        cold_epoch_.synchronize(); // readers that found the blocks marked have left them
+        for(PackedSubtree * block : retired) release(block);
+    }
+
+    bool over = spill_ != NULL && alc_->used() > spill_budget_;
+    if(!over && !compress_) return ;
+    size_t low_mark = spill_budget_ - spill_budget_ / 16; // spill a bit more than needed for the next rounds
+
+    rebuild_mtx_.lock(); // the top layer is not freed under us
+    Node * root = (Node *)galc->absolute(*(Node **)uptree_->find_lower(cold_hand_));
+    rebuild_mtx_.unlock();
+    _key_t lo = cold_hand_, hi;
+    Node ** sibling_ptr;
+    root->get_sibling(hi, sibling_ptr);
+    while(hi <= cold_hand_ && *sibling_ptr != NULL) {
+        lo = hi;
+        root = (Node *)galc->absolute(*sibling_ptr);
+        root->get_sibling(hi, sibling_ptr);
+    }
+
+    // a clock over the sibling chain: a subtree used since the last visit is spared once. A round 
+    // goes on from the subtree the last one stopped at, which is only the prev of the next one
+    Node * prev = NULL;
+    bool skip = cold_hand_ != MIN_KEY;
+    int visits = 0;
+    while(root != NULL && (over ? alc_->used() > low_mark : visits < ColdGate::ROUND_VISITS)) {
+        root->get_sibling(hi, sibling_ptr);
+        Node * next = (Node *)galc->absolute(*sibling_ptr);
+
+        if(!skip) {
+            if(!gate_->second_chance(root)) {
+                if(over) spill_subtree(root, prev);
+                else pack_subtree(root, prev);
+            }
+            cold_hand_ = lo;
+            visits++;
+        }
+
+        skip = false;
+        lo = hi;
+        prev = root;
+        root = next;
+    }
+    if(root == NULL) cold_hand_ = MIN_KEY;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::spill_subtree(Node * root, Node * prev) {
+    // only full height subtrees with records: the leftmost path of a lower one is not linked at each level
+    int height = 1;
+    for(Node * n = root; n->leftmost_ptr_ != NULL; n = (Node *)galc->absolute(n->leftmost_ptr_)) height++;
+    if(height != DOWNLEVEL || root->state_.unpack.count == 0 || spill_->contains(root))
+        return false;
+
+    // writers of the split key of prev may go on into this subtree
+    gate_->begin_move(root);
+    if(BACKGROUND && !gate_->drain(root, prev)) {
+        gate_->end_move();
+        return false;
+    }
+
+    _key_t hi; Node ** sibling_ptr;
+    root->get_sibling(hi, sibling_ptr);
+    Node * root_off = galc->relative(root);
+    vector<Record> records;
+    DOWNTREE_NS::scan(&root_off, MIN_KEY, hi, records);
+    if(!spill_->prepare(root, (uint64_t)root_off, records)) {
+        gate_->end_move();
+        return false;
+    }
+
+    cold_epoch_.synchronize(); // readers that found it resident have left the PM subtree
+    vector<Node *> freed;
+    DOWNTREE_NS::empty_subtree(&root_off, freed);
+    spill_->commit(root);
+    gate_->end_move();
+    if(tier_ != NULL) tier_->invalidate(root);
+
+    // the readers pinned since found it spilled, none of them reaches the nodes freed
+    for(Node * n : freed) alc_->recycle<Policy>(n);
+    return true;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::pack_subtree(Node * root, Node * prev) {
+    // only full height subtrees with records and a free slot in the root for the mark
+    int height = 1;
+    for(Node * n = root; n->leftmost_ptr_ != NULL; n = (Node *)galc->absolute(n->leftmost_ptr_)) height++;
+    int8_t count = root->state_.unpack.count;
+    if(height != DOWNLEVEL || count == 0 || count == DOWNTREE_NS::CARDINALITY)
+        return false;
+
+    // writers of the split key of prev may go on into this subtree
+    gate_->begin_move(root);
+    if(BACKGROUND && !gate_->drain(root, prev)) {
+        gate_->end_move();
+        return false;
+    }
+
+    _key_t hi; Node ** sibling_ptr;
+    root->get_sibling(hi, sibling_ptr);
+    Node * root_off = galc->relative(root);
+    vector<Record> records;
+    DOWNTREE_NS::scan(&root_off, MIN_KEY, hi, records);
+
+    // worth it only if the block is smaller than the nodes it frees, all but the leftmost path
+    size_t nodes = 0;
+    for(Node * anchor = root; anchor != NULL; anchor = (Node *)galc->absolute(anchor->leftmost_ptr_)) {
+        _key_t k; Node ** p;
+        for(Node * n = anchor; ; n = (Node *)galc->absolute(*p), nodes++) {
+            n->get_sibling(k, p);
+            if(k >= hi || *p == NULL) break;
+        }
+    }
+    size_t size = PackedSubtree::packed_size(records);
+    if(size >= nodes * sizeof(Node)) {
+        gate_->end_move();
+        return false;
+    }
+
+    PackedSubtree * block = PackedSubtree::pack(galc->malloc<Policy>(size), records);
+    clwb(block, size);
+    mfence(); // the block is persisted before it is linked
+    if(!DOWNTREE_NS::mark_subtree(&root_off, (char *)galc->relative(block))) {
+        release(block);
+        gate_->end_move();
+        return false;
+    }
+
+    cold_epoch_.synchronize(); // readers that found it resident have left the PM subtree
+    vector<Node *> freed;
+    DOWNTREE_NS::empty_subtree(&root_off, freed);
+    gate_->end_move();
+    if(tier_ != NULL) tier_->invalidate(root);
+    packs_.fetch_add(1, std::memory_order_relaxed);
+
+    // the readers pinned since found it marked, none of them reaches the nodes freed
+    for(Node * n : freed) alc_->recycle<Policy>(n);
+    return true;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::unpack_subtree(Node * root) {
+    unpack_mtx_.lock();
+    char * packed = DOWNTREE_NS::marked(root);
+    if(packed != NULL) { // not unpacked by another writer meanwhile
+        PackedSubtree * block = (PackedSubtree *)galc->absolute(packed);
+        vector<Record> records;
+        block->unpack(records);
+
+        // a crash may have left the packing unfinished, with nodes below the marked root
+        Node * root_off = galc->relative(root);
+        vector<Node *> freed;
+        DOWNTREE_NS::empty_subtree(&root_off, freed);
+        for(Node * n : freed) alc_->recycle<Policy>(n);
+        if(!DOWNTREE_NS::fill_subtree(&root_off, records)) {
+            printf("a packed subtree does not fit in PM\n");
+            exit(-1);
+        }
+
+        if(BACKGROUND) retired_.push_back(block); // readers may still search it
+        else release(block);
+        unpacks_.fetch_add(1, std::memory_order_relaxed);
+    }
+    unpack_mtx_.unlock();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::release(PackedSubtree * block) {
+    if(block->size() < 4096) alc_->recycle<Policy>(block, block->size());
+    else alc_->free(block);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::cold_find(Node * root, const _key_t & k, uint64_t & v, bool & found) const {
+    char * packed = DOWNTREE_NS::marked(root);
+    if(packed != NULL) {
+        found = ((PackedSubtree *)galc->absolute(packed))->find(k, v);
+        return true;
+    }
+
+    int res = is_spilled(root) ? spill_->find(root, k, v) : SpillTier::MISS;
+    found = res == SpillTier::FOUND;
+    return res != SpillTier::MISS;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::cold_scan(Node * root, const _key_t & lo, const _key_t & hi, vector<Record> & out) const {
+    char * packed = DOWNTREE_NS::marked(root);
+    if(packed != NULL) {
+        ((PackedSubtree *)galc->absolute(packed))->scan(lo, hi, out);
+        return true;
+    }
+    return is_spilled(root) && spill_->scan(root, lo, hi, out);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+int TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enter_subtree(Node ** root_ptr, const _key_t & k, bool wait) {
+    Node * downroot = (Node *)galc->absolute(*root_ptr);
+    gate_->touch(downroot);
+
+    // writers stop at the subtree whose split key equals k, and go on to its sibling below the root
+    _key_t splitkey; Node ** sibling_ptr;
+    downroot->get_sibling(splitkey, sibling_ptr);
+    Node * next = splitkey == k ? (Node *)galc->absolute(*sibling_ptr) : NULL;
+
+    while(true) {
+        int stripe = BACKGROUND ? gate_->enter(downroot) : -1;
+        if(!is_cold(downroot) && (next == NULL || !is_cold(next)))
+            return stripe;
+
+        if(stripe >= 0) gate_->leave(stripe); // the mover may be waiting for us
+        if(!fault_in(downroot, wait) || (next != NULL && !fault_in(next, wait)))
+            return MOVING;
+    }
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::fault_in(Node * root, bool wait) {
+    if(!wait && gate_->moving() == root)
+        return false;
+    gate_->wait_moving(root);
+    if(DOWNTREE_NS::marked(root) != NULL) {
+        unpack_subtree(root);
+        return true;
+    }
+    if(spill_ == NULL) return true;
+
+    Node * root_off = galc->relative(root);
+    spill_->fault(root, [&](const vector<Record> & records) {
+        if(!DOWNTREE_NS::fill_subtree(&root_off, records)) {
+            printf("a spilled subtree does not fit in PM\n");
+            exit(-1);
+        }
+    });
+    return true;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::insert_subtree(Node ** root_ptr, const _key_t & k, uint64_t v, int goes_steps) { 
     res_t insert_res = DOWNTREE_NS::insert(root_ptr, k, v, DOWNLEVEL);
 
     // we rebuild if the searching in the linklist is too long 
     if(goes_steps > REBUILD_THRESHOLD && rebuild_mtx_.trylock()) {
         if(entrance_->use_rebuild_recover == true) {
-            #ifdef BACKGROUND_REBUILD
+            if(BACKGROUND) {
                 std::thread rebuild_thread(&SelfType::rebuild_recover, this);
                 rebuild_thread.detach();
-            #else
+            } else {
                 rebuild_recover();
-            #endif
+            }
         } else {
-            #ifdef BACKGROUND_REBUILD
+            if(BACKGROUND) {
                 std::thread rebuild_thread(&SelfType::rebuild_fast, this);
                 rebuild_thread.detach();
-            #else
+            } else {
                 rebuild_fast();
-            #endif
+            }
         } 
     }
 
     if(insert_res.flag == true) { // a sub-index tree is splitted
+        if(heat_ != NULL) heat_->split(galc->absolute(*root_ptr));
+        PHASE_BEGIN(save_start);
         // try save the sub-indices root into the top layer
         bool succ = uptree_->insert(insert_res.rec.key, (uint64_t)galc->relative(insert_res.rec.val));
+        if(succ == false) counters_.add(ST_TOP_FAIL);
         
         // save these records into mutable_
         if(is_rebuilding_ == true || succ == false) {
@@ -196,68 +822,328 @@ void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::insert(const _key_t & k, uint64_
                 mutable_->push_back({insert_res.rec.key, (char *)galc->relative(insert_res.rec.val)});
             mutable_mtx_.unlock();
         }
+        PHASE_END(PH_SPLIT, save_start);
     }
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::find(const _key_t & k, uint64_t & v) const {
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::find(const _key_t & k, uint64_t & v) const {
+    PHASE_OP(PT_FIND);
+    counters_.add(ST_FIND);
+    uint32_t cache_ver = 0;
+    if(cache_ != NULL && cache_->lookup(k, v, cache_ver))
+        return true;
+
+    install();
+    pin_t pin(&top_epoch_);
+    PHASE_BEGIN(t);
+    if(filter_ != NULL && !filter_->may_contain(k)) {
+        PHASE_NEXT(PH_TOP, t);
+        return false;
+    }
     Node ** root_ptr = (Node **)uptree_->find_lower(k);
+    PHASE_NEXT(PH_TOP, t);
     Node * downroot = (Node *)galc->absolute(*root_ptr);
 
     // traverse in sibling chain
+    int steps = 0;
     _key_t splitkey; Node ** sibling_ptr;
     downroot->get_sibling(splitkey, sibling_ptr);
     while(splitkey <= k) { // the splitkey 
         root_ptr = sibling_ptr; // where is current root store
         downroot = (Node *)galc->absolute(*root_ptr);
         downroot->get_sibling(splitkey, sibling_ptr);
+        steps++;
+    }
+    PHASE_NEXT(PH_CHAIN, t);
+    counters_.chain(steps);
+    if(heat_ != NULL) heat_->access(downroot, false);
+
+    pin_t cold_pin(gate_ != NULL ? &cold_epoch_ : NULL); // the subtree is not emptied under us
+    if(gate_ != NULL) {
+        gate_->touch(downroot);
+        bool found;
+        if(cold_find(downroot, k, v, found)) {
+            if(found && cache_ != NULL) cache_->fill(k, v, cache_ver);
+            return found;
+        }
+    }
+
+    if(tier_ != NULL) {
+        if(tier_->record(downroot) && !BACKGROUND) migrate();
+        int res = tier_->lookup(downroot, k, v);
+        if(res != DramTier::MISS) {
+            if(res == DramTier::FOUND && cache_ != NULL) cache_->fill(k, v, cache_ver);
+            return res == DramTier::FOUND;
+        }
+    }
+
+    bool found = DOWNTREE_NS::find(root_ptr, k, v);
+    if(found && cache_ != NULL) cache_->fill(k, v, cache_ver);
+    return found;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::scan(const _key_t & lo, const _key_t & hi, vector<Record> & out) const {
+    counters_.add(ST_SCAN);
+    install();
+    pin_t pin(&top_epoch_);
+    Node ** root_ptr = (Node **)uptree_->find_lower(lo);
+    Node * downroot = (Node *)galc->absolute(*root_ptr);
+
+    // traverse in sibling chain
+    _key_t splitkey; Node ** sibling_ptr;
+    downroot->get_sibling(splitkey, sibling_ptr);
+    while(splitkey <= lo) { // the splitkey 
+        root_ptr = sibling_ptr; // where is current root store
+        downroot = (Node *)galc->absolute(*root_ptr);
+        downroot->get_sibling(splitkey, sibling_ptr);
+    }
+
+    if(gate_ == NULL) {
+        DOWNTREE_NS::scan(root_ptr, lo, hi, out);
+        return ;
     }
 
-    return DOWNTREE_NS::find(root_ptr, k, v);
+    // spilled and packed subtrees keep their records out of the nodes, collect the records subtree by subtree
+    pin_t cold_pin(&cold_epoch_);
+    _key_t cur_lo = lo;
+    while(true) {
+        downroot = (Node *)galc->absolute(*root_ptr);
+        downroot->get_sibling(splitkey, sibling_ptr);
+        _key_t cur_hi = std::min(hi, splitkey);
+        if(!cold_scan(downroot, cur_lo, cur_hi, out))
+            DOWNTREE_NS::scan(root_ptr, cur_lo, cur_hi, out);
+
+        if(splitkey >= hi || *sibling_ptr == NULL) break;
+        cur_lo = splitkey;
+        root_ptr = sibling_ptr;
+    }
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::remove(const _key_t & k) {
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::remove(const _key_t & k) {
+    PHASE_OP(PT_REMOVE);
+    counters_.add(ST_REMOVE);
+    install();
+    pin_t pin(&top_epoch_);
+    PHASE_BEGIN(t);
     Node ** root_ptr = (Node **)uptree_->find_lower(k);
+    PHASE_NEXT(PH_TOP, t);
     Node ** last_root_ptr = NULL; // record the last root ptr for laster use
     Node *downroot = (Node *)galc->absolute(*root_ptr);
 
     // travese in sibling chain
+    int steps = 0;
     _key_t splitkey; Node ** sibling_ptr;
     downroot->get_sibling(splitkey, sibling_ptr);
-    while(splitkey < k) { // the splitkey 
+    while(splitkey <= k) { // stop at the subtree holding k, whose root the merges below must be
         root_ptr = sibling_ptr; // where is current root store
         downroot = (Node *)galc->absolute(*root_ptr);
         downroot->get_sibling(splitkey, sibling_ptr);
+        steps++;
     }
+    PHASE_NEXT(PH_CHAIN, t);
+    counters_.chain(steps);
+    if(heat_ != NULL) heat_->access(downroot, true);
     
+    int stripe = gate_ != NULL ? enter_subtree(root_ptr, k) : -1;
     bool emptyif = DOWNTREE_NS::remove(root_ptr, k);
+    if(stripe >= 0) gate_->leave(stripe);
     if(emptyif) { // the DOWNTREE_NS is empty now
         uptree_->try_remove(k); // TODO: rebuilding should also be triggered when the top layer is too empty
     }
+    if(tier_ != NULL) drop_replicas(root_ptr, k);
+    if(cache_ != NULL) cache_->invalidate(k);
 
     return true;
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::update(const _key_t & k, const uint64_t & v) {
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+bool TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::update(const _key_t & k, const uint64_t & v) {
+    PHASE_OP(PT_UPDATE);
+    counters_.add(ST_UPDATE);
+    install();
+    pin_t pin(&top_epoch_);
+    PHASE_BEGIN(t);
     Node ** root_ptr = (Node **)uptree_->find_lower(k);
+    PHASE_NEXT(PH_TOP, t);
     Node * downroot = (Node *)galc->absolute(*root_ptr);
 
     // travese in sibling chain
+    int steps = 0;
     _key_t splitkey; Node ** sibling_ptr;
     downroot->get_sibling(splitkey, sibling_ptr);
     while(splitkey < k) { // the splitkey 
         root_ptr = sibling_ptr; // where is current root store
         downroot = (Node *)galc->absolute(*root_ptr);
         downroot->get_sibling(splitkey, sibling_ptr);
+        steps++;
+    }
+    PHASE_NEXT(PH_CHAIN, t);
+    counters_.chain(steps);
+    if(heat_ != NULL) heat_->access(downroot, true);
+
+    int stripe = gate_ != NULL ? enter_subtree(root_ptr, k) : -1;
+    bool found = DOWNTREE_NS::update(root_ptr, k, v);
+    if(stripe >= 0) gate_->leave(stripe);
+    if(tier_ != NULL) drop_replicas(root_ptr, k);
+    if(cache_ != NULL) cache_->update(k, v);
+    return found;
+}
+
+#if defined(__cpp_impl_coroutine)
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+auto TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::locate_async(_key_t k, bool inclusive, uint64_t gen, int & goes_steps) const -> coro::task<Node **> {
+    // the top layer, one level per suspension. Return NULL if it is rebuilt under a single owner meanwhile
+    const uptree_t * uptree = uptree_;
+    goes_steps = 0;
+    uint32_t idx = uptree->root_index();
+    for(int l = 0; l < uptree->height_; l++) {
+        co_await touch(uptree->node_addr(l, idx), sizeof(typename uptree_t::INNode));
+        if(top_moved(gen)) co_return NULL;
+        idx = uptree->descend(l, idx, k);
+    }
+    co_await touch(uptree->node_addr(uptree->height_, idx), sizeof(typename uptree_t::LFNode));
+    if(top_moved(gen)) co_return NULL;
+    Node ** root_ptr = (Node **)uptree->leaf_lower(idx, k);
+
+    // the sibling chain, the header of each subroot holds its sibling
+    Node * downroot = (Node *)galc->absolute(*root_ptr);
+    co_await touch(downroot);
+    if(top_moved(gen)) co_return NULL;
+
+    _key_t splitkey; Node ** sibling_ptr;
+    downroot->get_sibling(splitkey, sibling_ptr);
+    while(splitkey < k || (inclusive && splitkey == k)) {
+        root_ptr = sibling_ptr; // where is current root store
+        downroot = (Node *)galc->absolute(*root_ptr);
+        co_await touch(downroot);
+        downroot->get_sibling(splitkey, sibling_ptr);
+        goes_steps += 1;
+    }
+
+    co_return root_ptr;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+auto TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::descend_async(Node * root, _key_t k) const -> coro::task<Node *> {
+    // bring the path to the leaf into cache, one level per suspension
+    Node * cur = root;
+    co_await touch(cur, sizeof(Node));
+    while(cur->leftmost_ptr_ != NULL) {
+        cur = (Node *)galc->absolute(cur->get_child(k));
+        co_await touch(cur, sizeof(Node));
+    }
+    co_return cur;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+coro::task<bool> TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::find_async(_key_t k, uint64_t & v) const {
+    counters_.add(ST_FIND);
+    uint32_t cache_ver = 0;
+    if(cache_ != NULL && cache_->lookup(k, v, cache_ver))
+        co_return true;
+
+    install();
+    pin_t pin(&top_epoch_);
+    if(filter_ != NULL && !filter_->may_contain(k))
+        co_return false;
+    int goes_steps;
+    Node ** root_ptr;
+    while((root_ptr = co_await locate_async(k, true, top_gen(), goes_steps)) == NULL);
+    counters_.chain(goes_steps);
+    Node * downroot = (Node *)galc->absolute(*root_ptr); // root_ptr may be in the top layer, not used after a suspension
+    if(heat_ != NULL) heat_->access(downroot, false);
+
+    pin_t cold_pin(gate_ != NULL ? &cold_epoch_ : NULL);
+    if(gate_ != NULL) {
+        gate_->touch(downroot);
+        char * packed = DOWNTREE_NS::marked(downroot);
+        if(packed != NULL)
+            co_await touch(galc->absolute(packed)); // the header and the first group headers
+        else if(is_spilled(downroot) && spill_->prefetch(downroot))
+            co_await touch(downroot); // let other tasks run while the block is read ahead
+        bool found;
+        if(cold_find(downroot, k, v, found)) {
+            if(found && cache_ != NULL) cache_->fill(k, v, cache_ver);
+            co_return found;
+        }
+    }
+
+    if(tier_ != NULL) {
+        if(tier_->record(downroot) && !BACKGROUND) migrate();
+        int res = tier_->lookup(downroot, k, v);
+        if(res != DramTier::MISS) {
+            if(res == DramTier::FOUND && cache_ != NULL) cache_->fill(k, v, cache_ver);
+            co_return res == DramTier::FOUND;
+        }
+    }
+
+    Node * leaf = co_await descend_async(downroot, k);
+
+    v = (uint64_t)leaf->get_child(k);
+    if((char *)v != NULL && cache_ != NULL) cache_->fill(k, v, cache_ver);
+    co_return (char *)v != NULL;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+coro::task<void> TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::insert_async(_key_t k, uint64_t v) {
+    install();
+    pin_t pin(&top_epoch_);
+    int goes_steps;
+    Node ** root_ptr = NULL;
+    for(uint64_t gen = top_gen(); root_ptr == NULL; gen = top_gen()) { // the last suspension is in the descent
+        root_ptr = co_await locate_async(k, false, gen, goes_steps);
+        if(root_ptr != NULL) co_await descend_async((Node *)galc->absolute(*root_ptr), k);
+        if(top_moved(gen)) root_ptr = NULL;
     }
+    counters_.add(ST_INSERT);
+    counters_.chain(goes_steps);
+    if(heat_ != NULL) heat_->access(galc->absolute(*root_ptr), true);
 
-    return DOWNTREE_NS::update(root_ptr, k, v);
+    if(filter_ != NULL) filter_->add(k); // the pin holds a rebuilt filter back until the key is visible
+    int stripe = -1;
+    while(gate_ != NULL && (stripe = enter_subtree(root_ptr, k, false)) == MOVING)
+        co_await touch(galc->absolute(*root_ptr)); // other tasks of the thread may pin what the mover waits for
+    insert_subtree(root_ptr, k, v, goes_steps);
+    if(stripe >= 0) gate_->leave(stripe);
+    if(tier_ != NULL) drop_replicas(root_ptr, k);
+    if(cache_ != NULL) cache_->update(k, v);
+    if(gate_ != NULL && !BACKGROUND && gate_->tick()) cold_round();
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::rebuild_fast() { // fast rebuilding function
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+coro::task<bool> TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::update_async(_key_t k, uint64_t v) {
+    install();
+    pin_t pin(&top_epoch_);
+    int goes_steps;
+    Node ** root_ptr = NULL;
+    for(uint64_t gen = top_gen(); root_ptr == NULL; gen = top_gen()) {
+        root_ptr = co_await locate_async(k, false, gen, goes_steps);
+        if(root_ptr != NULL) co_await descend_async((Node *)galc->absolute(*root_ptr), k);
+        if(top_moved(gen)) root_ptr = NULL;
+    }
+    counters_.add(ST_UPDATE);
+    counters_.chain(goes_steps);
+    if(heat_ != NULL) heat_->access(galc->absolute(*root_ptr), true);
+
+    int stripe = -1;
+    while(gate_ != NULL && (stripe = enter_subtree(root_ptr, k, false)) == MOVING)
+        co_await touch(galc->absolute(*root_ptr));
+    bool found = DOWNTREE_NS::update(root_ptr, k, v);
+    if(stripe >= 0) gate_->leave(stripe);
+    if(tier_ != NULL) drop_replicas(root_ptr, k);
+    if(cache_ != NULL) cache_->update(k, v);
+    co_return found;
+}
+#endif // __cpp_impl_coroutine
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::rebuild_fast() { // fast rebuilding function
+    install();
+    if(rebuild_listener_) rebuild_listener_(true);
+    double start = seconds();
     // switch the restore to be immutable
     vector<Record> * new_mutable = new vector<Record>;
     new_mutable->reserve(0xffff);
@@ -276,36 +1162,43 @@ void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::rebuild_fast() { // fast rebuild
     uptree_->merge(*immutable, subroots);
 
     /* rebuild the top layer with immutable */  
-    UPTREE_NS::uptree_t * old_tree = uptree_;
+    uptree_t * old_tree = uptree_;
     UPTREE_NS::entrance_t * old_upent = galc->absolute(entrance_->upent);
-    UPTREE_NS::uptree_t * new_tree = new UPTREE_NS::uptree_t(subroots);
+    uptree_t * new_tree = new uptree_t(subroots);
     UPTREE_NS::entrance_t * new_upent = UPTREE_NS::get_entrance(new_tree);
     
     // install the new top layer
     persist_assign(&(entrance_->upent), galc->relative(new_upent));
     uptree_ = new_tree;
     
-    /* free the old top layer */
-    #ifdef BACKGROUND_REBUILD
-        usleep(50); // TODO: unsafe memory reclamation
-    #endif
+    /* free the old top layer, once the operations that may search it have left */
+    top_epoch_.synchronize();
     UPTREE_NS::free(old_tree); // free the old_tree
 
+    // rescan the down layer only when it has grown or shrunk a lot since the last build
+    if(filter_ != NULL && (subroots.size() >= 2 * filter_subroots_ || 2 * subroots.size() <= filter_subroots_))
+        build_filter(filter_capacity(subroots.size()));
+
     is_rebuilding_ = false;
+    account_rebuild(start);
+    if(rebuild_listener_) rebuild_listener_(false); // before the unlock, the tree may be closed after it
     asm volatile("" ::: "memory");
     rebuild_mtx_.unlock();
 
     delete immutable;
 }
 
-template<int DOWNLEVEL, int REBUILD_THRESHOLD>
-void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::rebuild_recover() { // slow rebuilding function 
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::rebuild_recover() { // slow rebuilding function 
+    install();
+    if(rebuild_listener_) rebuild_listener_(true);
+    double start = seconds();
     is_rebuilding_ = true;
     // get the snapshot of all sub-index trees by traverse in the down layer
     std::vector<Record> subroots;
     subroots.reserve(0x2fffff);
     
-    _key_t split_key = 0; 
+    _key_t split_key = MIN_KEY; // the leftmost subroot takes all the keys below the first split key
     Node ** sibling_ptr = (Node **)uptree_->find_first();
     Node * cur_root = (Node *)galc->absolute(*sibling_ptr);
     while (cur_root != NULL) {
@@ -316,26 +1209,132 @@ void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD>::rebuild_recover() { // slow rebu
     }
 
     /* rebuild the top layer with immutable */  
-    UPTREE_NS::uptree_t * old_tree = uptree_;
+    uptree_t * old_tree = uptree_;
     UPTREE_NS::entrance_t * old_upent = galc->absolute(entrance_->upent);
-    UPTREE_NS::uptree_t * new_tree = new UPTREE_NS::uptree_t(subroots);
+    uptree_t * new_tree = new uptree_t(subroots);
     UPTREE_NS::entrance_t * new_upent = UPTREE_NS::get_entrance(new_tree);
     
     // install the new top layer
     persist_assign(&(entrance_->upent), galc->relative(new_upent));
     uptree_ = new_tree;
     
-    /* free the old top layer */
-    #ifdef BACKGROUND_REBUILD
-        usleep(50); // TODO: unsafe memory reclamation
-    #endif
+    /* free the old top layer, once the operations that may search it have left */
+    top_epoch_.synchronize();
     UPTREE_NS::free(old_tree); // free the old_tree
 
+    // rescan the down layer only when it has grown or shrunk a lot since the last build
+    if(filter_ != NULL && (subroots.size() >= 2 * filter_subroots_ || 2 * subroots.size() <= filter_subroots_))
+        build_filter(filter_capacity(subroots.size()));
+
+    persist_assign(&(entrance_->use_rebuild_recover), false); // use fast rebuilding next time
+
     is_rebuilding_ = false;
+    account_rebuild(start);
+    if(rebuild_listener_) rebuild_listener_(false); // before the unlock, the tree may be closed after it
     asm volatile("" ::: "memory");
     rebuild_mtx_.unlock();
+}
 
-    persist_assign(&(entrance_->use_rebuild_recover), false); // use fast rebuilding next time
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::account_rebuild(double start) {
+    // rebuildings are serialized by rebuild_mtx_, so only readers race with these updates
+    uint64_t ns = (seconds() - start) * 1e9;
+    rebuilds_.store(rebuilds_.load() + 1);
+    rebuild_ns_.store(rebuild_ns_.load() + ns);
+    if(ns > rebuild_max_ns_.load()) rebuild_max_ns_.store(ns);
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::enable_heatmap() {
+    if(heat_ == NULL) heat_ = new KeyHeatmap();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::heat_ranges(vector<HeatRange> & out) {
+    if(heat_ == NULL) return ;
+    install();
+    rebuild_mtx_.lock(); // the top layer is not freed under us
+    HeatRange r;
+    r.lo = MIN_KEY;
+    Node ** root_ptr = (Node **)uptree_->find_first();
+    Node * cur_root = (Node *)galc->absolute(*root_ptr);
+    while(cur_root != NULL) {
+        Node ** sibling_ptr;
+        cur_root->get_sibling(r.hi, sibling_ptr);
+        heat_->heat(cur_root, r);
+        out.push_back(r);
+
+        r.lo = r.hi;
+        root_ptr = sibling_ptr;
+        cur_root = (Node *)galc->absolute(*root_ptr);
+    }
+    rebuild_mtx_.unlock();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+TreeStats TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::stats() {
+    TreeStats st;
+    counters_.sum(st.events);
+    st.rebuilds = rebuilds_.load();
+    st.rebuild_seconds = rebuild_ns_.load() / 1e9;
+    st.rebuild_max_seconds = rebuild_max_ns_.load() / 1e9;
+    mutable_mtx_.lock();
+        st.mutable_size = mutable_->size();
+    mutable_mtx_.unlock();
+    st.pm_used = alc_->used();
+    st.pm_capacity = alc_->capacity();
+    return st;
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+void TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::build_filter(size_t expected_keys) {
+    // called under rebuild_mtx_. Writers add their keys to the new filter from now on, the ones 
+    // still adding to the old filter finish their inserts before synchronize() returns, so the 
+    // scan below sees their keys. Readers take the new filter as "maybe" until it is built
+    KeyFilter<Policy> * old_filter = filter_;
+    KeyFilter<Policy> * new_filter = new KeyFilter<Policy>(expected_keys);
+    filter_ = new_filter;
+    top_epoch_.synchronize();
+    delete old_filter;
+
+    size_t cnt = 0;
+    filter_subroots_ = for_each_record([&](const Record & rec) {
+        new_filter->add(rec.key);
+        cnt++;
+    });
+    filter_keys_ = cnt;
+
+    new_filter->set_built();
+}
+
+template<int DOWNLEVEL, int REBUILD_THRESHOLD, typename Policy>
+template<typename F>
+size_t TLBtreeImpl<DOWNLEVEL, REBUILD_THRESHOLD, Policy>::for_each_record(F f) {
+    // scan the sub-index trees one by one, under rebuild_mtx_
+    vector<Record> records;
+    size_t subtrees = 0;
+    _key_t lo = MIN_KEY, hi;
+    Node ** root_ptr = (Node **)uptree_->find_first();
+    Node * cur_root = (Node *)galc->absolute(*root_ptr);
+    while (cur_root != NULL) {
+        Node ** sibling_ptr;
+        cur_root->get_sibling(hi, sibling_ptr);
+
+        records.clear();
+        {
+            pin_t cold_pin(gate_ != NULL ? &cold_epoch_ : NULL);
+            if(gate_ == NULL || !cold_scan(cur_root, lo, hi, records))
+                DOWNTREE_NS::scan(root_ptr, lo, hi, records);
+        }
+        for(auto & rec : records)
+            f(rec);
+
+        lo = hi;
+        root_ptr = sibling_ptr;
+        cur_root = (Node *)galc->absolute(*root_ptr);
+        subtrees++;
+    }
+    return subtrees;
 }
 
 } // tlbtree namespace
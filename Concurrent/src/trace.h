@@ -0,0 +1,185 @@
+/*  trace.h - Operation traces of TLBtree, recorded per thread and replayed
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+/*
+    A trace is a set of files <prefix>.<thread>, one for each thread that operated on the traced
+    tree, each a header followed by the operations of its thread in the order they were issued:
+
+        | TraceHeader (32B) | TraceRecord[] |
+
+    The records keep a digest of the values instead of the values. A SCAN keeps the upper bound
+    of its range in the place of the digest.
+*/
+struct TraceHeader {
+    static const uint64_t MAGIC = 0x4543415254424c54ULL; // "TLBTRACE"
+    static const uint32_t VERSION = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t thread;      // the order in which the thread first operated on the tree
+    uint64_t start_ns;    // steady clock of the start of the trace, the same in all the files
+    uint32_t record_size; // sizeof(TraceRecord) of the writer
+    uint32_t padding;
+};
+static_assert(sizeof(TraceHeader) == 32, "the records follow a 32B header");
+
+struct TraceRecord {
+    uint64_t ts_ns;       // since the start of the trace
+    uint32_t thread;
+    uint32_t op;          // OperationType
+    int64_t key;
+    uint64_t digest;      // of the value written or read (0 if absent), the hi of a SCAN
+};
+
+inline uint64_t trace_digest(uint64_t v) { // a bijection keeping 0, so absence stays visible
+    v ^= v >> 33; v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33; v *= 0xc4ceb9fe1a85ec53ULL;
+    v ^= v >> 33;
+    return v;
+}
+
+inline uint64_t trace_clock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+    TraceRecorder: each thread appends its records to a buffer of its own, written out to its file
+    when full, so recording costs a clock read and a store on the path of an operation. The files
+    are complete once the recorder is destroyed.
+*/
+class TraceRecorder {
+    static const int BUFFER = 4096; // records, 96KB
+
+    struct writer_t {
+        FILE * file;
+        uint32_t thread;
+        int cnt;
+        TraceRecord buf[BUFFER];
+
+        void flush() {
+            if(cnt > 0 && fwrite(buf, sizeof(TraceRecord), cnt, file) != (size_t)cnt) {
+                printf("can not write the trace file\n");
+                exit(-1);
+            }
+            cnt = 0;
+        }
+    };
+
+    std::string prefix_;
+    uint64_t id_;         // tells the recorders apart in the writer cache of a thread
+    uint64_t start_ns_;
+    std::mutex mtx_;
+    std::vector<writer_t *> writers_;
+
+public:
+    TraceRecorder(const std::string & prefix): prefix_(prefix), start_ns_(trace_clock()) {
+        static std::atomic<uint64_t> recorders(0);
+        id_ = recorders.fetch_add(1) + 1;
+    }
+
+    ~TraceRecorder() {
+        for(writer_t * w : writers_) {
+            w->flush();
+            fclose(w->file);
+            delete w;
+        }
+    }
+
+    inline void record(OperationType op, _key_t key, uint64_t digest) {
+        writer_t * w = writer();
+        TraceRecord & r = w->buf[w->cnt];
+        r.ts_ns = trace_clock() - start_ns_;
+        r.thread = w->thread;
+        r.op = op;
+        r.key = key;
+        r.digest = digest;
+        if(++w->cnt == BUFFER) w->flush();
+    }
+
+private:
+    inline writer_t * writer() { // of this thread
+        static thread_local std::vector<std::pair<uint64_t, writer_t *>> cached; // by recorder id
+        for(auto & c : cached)
+            if(c.first == id_) return c.second;
+        cached.push_back({id_, open_writer()});
+        return cached.back().second;
+    }
+
+    writer_t * open_writer() {
+        std::lock_guard<std::mutex> l(mtx_);
+        writer_t * w = new writer_t;
+        w->thread = writers_.size();
+        w->cnt = 0;
+        std::string path = prefix_ + "." + std::to_string(w->thread);
+        w->file = fopen(path.c_str(), "wb");
+        TraceHeader header = {TraceHeader::MAGIC, TraceHeader::VERSION, w->thread, start_ns_, sizeof(TraceRecord), 0};
+        if(w->file == NULL || fwrite(&header, sizeof(header), 1, w->file) != 1) {
+            printf("can not write the trace file %s\n", path.c_str());
+            exit(-1);
+        }
+        writers_.push_back(w);
+        return w;
+    }
+};
+
+/* a trace file mapped for replaying */
+class TraceFile {
+    int fd_;
+    char * map_;
+    size_t size_;
+    const TraceHeader * header_;
+
+public:
+    TraceFile(const char * path) {
+        fd_ = open(path, O_RDONLY);
+        struct stat st;
+        if(fd_ < 0 || fstat(fd_, &st) != 0) {
+            printf("trace file %s not openned\n", path);
+            exit(-1);
+        }
+        size_ = st.st_size;
+        map_ = size_ < sizeof(TraceHeader) ? (char *)MAP_FAILED : (char *)mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        header_ = (const TraceHeader *)map_;
+        if(map_ == MAP_FAILED || header_->magic != TraceHeader::MAGIC || header_->version != TraceHeader::VERSION
+            || header_->record_size != sizeof(TraceRecord)) {
+            printf("%s is not a trace file of this version\n", path);
+            exit(-1);
+        }
+        madvise(map_, size_, MADV_SEQUENTIAL);
+    }
+
+    ~TraceFile() {
+        munmap(map_, size_);
+        close(fd_);
+    }
+
+    inline const TraceHeader & header() const { return *header_; }
+
+    inline size_t size() const { return (size_ - sizeof(TraceHeader)) / sizeof(TraceRecord); } // a partly written record is ignored
+
+    inline const TraceRecord * records() const { return (const TraceRecord *)(header_ + 1); }
+};
+
+#endif //__TRACE_H__
@@ -2,15 +2,19 @@
 
 namespace wotree256 {
 
-bool insert_recursive(Node * n, _key_t k, uint64_t v, _key_t &split_k, Node * &split_node, int8_t &level) {
+HotNodes hot_nodes;
+PubLists pub_lists;
+
+template<typename Policy>
+bool insert_recursive(Node<Policy> * n, _key_t k, uint64_t v, _key_t &split_k, Node<Policy> * &split_node, int8_t &level) {
     if(n->leftmost_ptr_ == NULL) {
         return n->store(k, v, split_k, split_node);
     } else {
         level++;
-        Node * child = (Node *) galc->absolute(n->get_child(k));
+        Node<Policy> * child = (Node<Policy> *) galc->absolute(n->get_child(k));
         
         _key_t split_k_child;
-        Node * split_node_child;
+        Node<Policy> * split_node_child;
         bool splitIf = insert_recursive(child, k, v, split_k_child, split_node_child, level);
 
         if(splitIf) { 
@@ -20,32 +24,32 @@ bool insert_recursive(Node * n, _key_t k, uint64_t v, _key_t &split_k, Node * &s
     }
 }
 
-bool remove_recursive(Node * n, _key_t k) {
+template<typename Policy>
+bool remove_recursive(Node<Policy> * n, _key_t k) {
     if(n->leftmost_ptr_ == NULL) {
         n->remove(k);
         return n->state_.unpack.count < UNDERFLOW_CARD;
     }
     else {
-        Node * child = (Node *) galc->absolute(n->get_child(k));
+        Node<Policy> * child = (Node<Policy> *) galc->absolute(n->get_child(k));
 
         bool shouldMrg = remove_recursive(child, k);
 
         if(shouldMrg) {
-            Node *leftsib = NULL, *rightsib = NULL;
-            n->get_lrchild(k, leftsib, rightsib);
+            Node<Policy> *leftsib = NULL, *rightsib = NULL;
+            _key_t right_key;
+            n->get_lrchild(k, leftsib, rightsib, right_key);
 
             if(leftsib != NULL && (child->state_.unpack.count + leftsib->state_.unpack.count) < CARDINALITY) {
                 // merge with left node
-                int8_t slotid = child->state_.read(0);
-                n->remove(child->recs_[slotid].key);
-                Node::merge(leftsib, child);
+                n->remove(k); // child is not the leftmost one, its keys may all be gone
+                Node<Policy>::merge(leftsib, child);
 
                 return n->state_.unpack.count < UNDERFLOW_CARD;
             } else if (rightsib != NULL && (child->state_.unpack.count + rightsib->state_.unpack.count) < CARDINALITY) {
                 // merge with right node
-                int8_t slotid = rightsib->state_.read(0);
-                n->remove(rightsib->recs_[slotid].key);
-                Node::merge(child, rightsib);
+                n->remove(right_key);
+                Node<Policy>::merge(child, rightsib);
 
                 return n->state_.unpack.count < UNDERFLOW_CARD;
             }
@@ -54,11 +58,12 @@ bool remove_recursive(Node * n, _key_t k) {
     }
 }
 
-bool find(Node ** rootPtr, _key_t key, uint64_t &val) {
-    Node * cur = galc->absolute(*rootPtr);
+template<typename Policy>
+bool find(Node<Policy> ** rootPtr, _key_t key, uint64_t &val) {
+    Node<Policy> * cur = galc->absolute(*rootPtr);
     while(cur->leftmost_ptr_ != NULL) { // no prefetch here
         char * child_ptr = cur->get_child(key);
-        cur = (Node *)galc->absolute(child_ptr);
+        cur = (Node<Policy> *)galc->absolute(child_ptr);
     }
 
     val = (uint64_t) cur->get_child(key);
@@ -69,17 +74,18 @@ bool find(Node ** rootPtr, _key_t key, uint64_t &val) {
         return true;
 }
 
-res_t insert(Node ** rootPtr, _key_t key, uint64_t val, int threshold) {
-    Node *root_= galc->absolute(*rootPtr);
+template<typename Policy>
+res_t insert(Node<Policy> ** rootPtr, _key_t key, uint64_t val, int threshold) {
+    Node<Policy> *root_= galc->absolute(*rootPtr);
     
     int8_t level = 1;
     _key_t split_k;
-    Node * split_node;
+    Node<Policy> * split_node;
     bool splitIf = insert_recursive(root_, key, val, split_k, split_node, level);
 
     if(splitIf) {
         if(level < threshold) {
-            Node *new_root = new Node;
+            Node<Policy> *new_root = new Node<Policy>;
             new_root->leftmost_ptr_ = (char *)galc->relative(root_);
             new_root->append({split_k, (char *)galc->relative(split_node)}, 0, 0);
             new_root->state_.unpack.count = 1;
@@ -87,7 +93,7 @@ res_t insert(Node ** rootPtr, _key_t key, uint64_t val, int threshold) {
             clwb(new_root, 64);
 
             mfence(); // a barrier to make sure the new node is persisted
-            persist_assign(rootPtr, (Node *)galc->relative(new_root));
+            persist_assign(rootPtr, (Node<Policy> *)galc->relative(new_root));
 
             return res_t(false, {0, NULL});
         } else {
@@ -99,62 +105,240 @@ res_t insert(Node ** rootPtr, _key_t key, uint64_t val, int threshold) {
     }
 }
 
-bool update(Node ** rootPtr, _key_t key, uint64_t val) {
-    Node * cur = galc->absolute(*rootPtr);
+template<typename Policy>
+bool update(Node<Policy> ** rootPtr, _key_t key, uint64_t val) {
+    Node<Policy> * cur = galc->absolute(*rootPtr);
     while(cur->leftmost_ptr_ != NULL) { // no prefetch here
         char * child_ptr = cur->get_child(key);
-        cur = (Node *)galc->absolute(child_ptr);
+        cur = (Node<Policy> *)galc->absolute(child_ptr);
     }
 
     val = (uint64_t) cur->update(key, val);
     return true;
 }
 
-bool remove(Node ** rootPtr, _key_t key) {   
-    Node *root_= galc->absolute(*rootPtr);
+template<typename Policy>
+bool remove(Node<Policy> ** rootPtr, _key_t key) {   
+    Node<Policy> *root_= galc->absolute(*rootPtr);
     if(root_->leftmost_ptr_ == NULL) {
         root_->remove(key);
 
         return root_->state_.unpack.count == 0;
     }
     else {
-        Node * child = (Node *) galc->absolute(root_->get_child(key));
+        Node<Policy> * child = (Node<Policy> *) galc->absolute(root_->get_child(key));
 
         bool shouldMrg = remove_recursive(child, key);
 
         if(shouldMrg) {
-            Node *leftsib = NULL, *rightsib = NULL;
-            root_->get_lrchild(key, leftsib, rightsib);
+            Node<Policy> *leftsib = NULL, *rightsib = NULL;
+            _key_t right_key;
+            root_->get_lrchild(key, leftsib, rightsib, right_key);
 
             if(leftsib != NULL && (child->state_.unpack.count + leftsib->state_.unpack.count) < CARDINALITY) {
                 // merge with left node
-                int8_t slotid = child->state_.read(0);
-                root_->remove(child->recs_[slotid].key);
-                Node::merge(leftsib, child);
+                root_->remove(key); // child is not the leftmost one, its keys may all be gone
+                Node<Policy>::merge(leftsib, child);
             } 
             else if (rightsib != NULL && (child->state_.unpack.count + rightsib->state_.unpack.count) < CARDINALITY) {
                 // merge with right node
-                int8_t slotid = rightsib->state_.read(0);
-                root_->remove(rightsib->recs_[slotid].key);
-                Node::merge(child, rightsib);
-            }
-            
-            if(root_->state_.unpack.count == 0) { // the root is empty
-                Node * old_root = root_;
-
-                persist_assign(rootPtr, (Node *)root_->leftmost_ptr_);
-
-                galc->free(old_root);
+                root_->remove(right_key);
+                Node<Policy>::merge(child, rightsib);
             }
+            /* an empty root is kept with its leftmost child: the roots of the sub-index trees are
+               chained by their siblings, replacing one by its child would link a lower level into 
+               the chain */
         }
 
         return false;
     } 
 }
 
-void printAll(Node ** rootPtr) {
-    Node *root= galc->absolute(*rootPtr);
+template<typename Policy>
+void scan(Node<Policy> ** rootPtr, _key_t lo, _key_t hi, std::vector<Record> & out) {
+    // leaves of all sub-index trees are chained by their siblings, walk the chain from lo up to hi
+    Node<Policy> * cur = galc->absolute(*rootPtr);
+    while(cur->leftmost_ptr_ != NULL) {
+        char * child_ptr = cur->get_child(lo);
+        cur = (Node<Policy> *)galc->absolute(child_ptr);
+    }
+
+    while(cur != NULL) {
+        _key_t sib_key; Node<Policy> * sib_node;
+        cur->collect(lo, hi, out, sib_key, sib_node);
+        if(sib_key >= hi) break;
+        cur = sib_node;
+    }
+}
+
+template<typename Policy>
+void printAll(Node<Policy> ** rootPtr) {
+    Node<Policy> *root= galc->absolute(*rootPtr);
     root->print("", true);
 }
 
+/*
+    A tree emptied down to its leftmost path (root included), whose nodes are referenced from
+    outside: the root by the top layer and the sibling chain, the leftmost node of each level by the
+    last node of that level in the previous tree. The nodes of the path keep no record and each of
+    them links to the sibling of the last node of its level, the other nodes are unlinked into 
+    freed. The root is emptied first so that nothing below it is reachable from the root any more,
+    and redoing it after a crash finishes the work.
+*/
+template<typename Policy>
+void empty_subtree(Node<Policy> ** rootPtr, std::vector<Node<Policy> *> & freed) {
+    Node<Policy> * root = galc->absolute(*rootPtr);
+    _key_t hi = root->siblings_[root->state_.unpack.sibling_version].key;
+
+    for(Node<Policy> * anchor = root; anchor != NULL; anchor = (Node<Policy> *)galc->absolute(anchor->leftmost_ptr_)) {
+        Node<Policy> * last = anchor; // the last node of this level in the tree
+        if(anchor != root) { // the sibling of the root is the next tree already
+            while(true) {
+                Record & sib = last->siblings_[last->state_.unpack.sibling_version];
+                if(sib.key >= hi || sib.val == NULL) break;
+                last = (Node<Policy> *)galc->absolute(sib.val);
+                freed.push_back(last);
+            }
+        }
+
+        anchor->latch();
+        state_t new_state = anchor->state_;
+        new_state.unpack.count = 0;
+        if(last != anchor) {
+            anchor->siblings_[(new_state.unpack.sibling_version + 1) % 2] = last->siblings_[last->state_.unpack.sibling_version];
+            new_state.unpack.sibling_version = (new_state.unpack.sibling_version + 1) % 2;
+            mfence();
+        }
+        persist_assign(&(anchor->state_.pack), new_state.pack);
+        anchor->unlock();
+    }
+}
+
+/*
+    Bulk load the sorted recs into a tree emptied by empty_subtree, reusing its leftmost path and
+    allocating full nodes for the rest. The new nodes are persisted before any of them is linked,
+    then the nodes of the path are filled bottom up with the root last, which drops the mark of
+    mark_subtree: a reader that still finds the root empty reaches every record through the
+    siblings of its leftmost child. Return false if recs do not fit in a tree of this height.
+*/
+template<typename Policy>
+bool fill_subtree(Node<Policy> ** rootPtr, const std::vector<Record> & recs) {
+    std::vector<Node<Policy> *> path; // the leftmost path, from the root down
+    for(Node<Policy> * n = galc->absolute(*rootPtr); n != NULL; n = (Node<Policy> *)galc->absolute(n->leftmost_ptr_))
+        path.push_back(n);
+
+    size_t cap = CARDINALITY;
+    for(size_t l = 1; l < path.size(); l++) cap *= CARDINALITY + 1;
+    if(recs.size() > cap) return false;
+
+    std::vector<state_t> states(path.size());
+    std::vector<std::vector<Record>> path_recs(path.size()); // written into the path in the second pass
+    std::vector<Record> items = recs, nodes; // the entries of a level, and the (first key, node) of its nodes
+    for(int l = path.size() - 1; l >= 0; l--) {
+        Node<Policy> * anchor = path[l];
+        bool is_leaf = anchor->leftmost_ptr_ == NULL;
+        size_t fanout = is_leaf ? CARDINALITY : CARDINALITY + 1;
+
+        nodes.clear();
+        for(size_t i = 0; i == 0 || i < items.size(); i += fanout) {
+            Node<Policy> * n = (i == 0) ? anchor : new Node<Policy>;
+            state_t st = n->state_;
+            st.unpack.count = 0;
+            size_t first = i;
+            if(!is_leaf) { // an inner node keeps its first child in leftmost_ptr_, the anchor below for the first node
+                if(i > 0) n->leftmost_ptr_ = items[i].val;
+                first += 1;
+            }
+            for(size_t j = first; j < std::min(items.size(), i + fanout); j++) {
+                if(i == 0) path_recs[l].push_back(items[j]);
+                else n->recs_[j - first] = items[j];
+                st.pack = st.add(j - first, j - first);
+            }
+            if(i == 0) states[l] = st;
+            else n->state_ = st;
+            nodes.push_back({i < items.size() ? items[i].key : MIN_KEY, (char *)n});
+        }
+
+        // chain the nodes of this level, the last one takes the sibling of the anchor
+        Node<Policy> * tail = (Node<Policy> *)nodes.back().val;
+        if(tail != anchor) {
+            Record & old_sib = anchor->siblings_[anchor->state_.unpack.sibling_version];
+            tail->siblings_[0] = old_sib;
+            for(size_t i = 1; i + 1 < nodes.size(); i++)
+                ((Node<Policy> *)nodes[i].val)->siblings_[0] = {nodes[i + 1].key, (char *)galc->relative(nodes[i + 1].val)};
+            for(size_t i = 1; i < nodes.size(); i++)
+                clwb((Node<Policy> *)nodes[i].val, sizeof(Node<Policy>));
+
+            int8_t v = (states[l].unpack.sibling_version + 1) % 2;
+            anchor->siblings_[v] = {nodes[1].key, (char *)galc->relative(nodes[1].val)};
+            states[l].unpack.sibling_version = v;
+        }
+
+        for(auto & n : nodes)
+            n.val = (char *)galc->relative(n.val);
+        items.swap(nodes);
+    }
+    mfence(); // the new nodes are persisted before any of them is linked
+
+    for(int l = path.size() - 1; l >= 0; l--) {
+        Node<Policy> * anchor = path[l];
+        anchor->latch();
+        if(marked(anchor) != NULL) { // drop the mark before its slot may be overwritten
+            anchor->recs_[anchor->state_.read(0)].key = MIN_KEY;
+            mfence();
+        }
+        for(size_t j = 0; j < path_recs[l].size(); j++)
+            anchor->recs_[j] = path_recs[l][j];
+        clwb(anchor, sizeof(Node<Policy>));
+        mfence();
+
+        state_t new_state = anchor->state_;
+        new_state.unpack.slotArray = states[l].unpack.slotArray;
+        new_state.unpack.count = states[l].unpack.count;
+        new_state.unpack.sibling_version = states[l].unpack.sibling_version;
+        persist_assign(&(anchor->state_.pack), new_state.pack);
+        anchor->unlock();
+    }
+    return true;
+}
+
+template<typename Policy>
+bool mark_subtree(Node<Policy> ** rootPtr, char * ptr) {
+    Node<Policy> * root = galc->absolute(*rootPtr);
+    root->latch();
+    state_t new_state = root->state_;
+    if(new_state.unpack.count == CARDINALITY) {
+        root->unlock();
+        return false;
+    }
+
+    int8_t slotid = new_state.alloc();
+    root->recs_[slotid] = {MAX_KEY, ptr};
+    clwb(&root->recs_[slotid], sizeof(Record));
+    mfence();
+
+    new_state.unpack.count = 0;
+    new_state.pack = new_state.add(0, slotid);
+    new_state.unpack.count = 0; // the slot is at the first position, but out of the records
+    persist_assign(&(root->state_.pack), new_state.pack);
+    root->unlock();
+    return true;
+}
+
+#define INSTANTIATE_WOTREE(Policy) \
+    template bool insert_recursive<Policy>(Node<Policy> *, _key_t, uint64_t, _key_t &, Node<Policy> * &, int8_t &); \
+    template bool remove_recursive<Policy>(Node<Policy> *, _key_t); \
+    template bool find<Policy>(Node<Policy> **, _key_t, uint64_t &); \
+    template res_t insert<Policy>(Node<Policy> **, _key_t, uint64_t, int); \
+    template bool update<Policy>(Node<Policy> **, _key_t, uint64_t); \
+    template bool remove<Policy>(Node<Policy> **, _key_t); \
+    template void scan<Policy>(Node<Policy> **, _key_t, _key_t, std::vector<Record> &); \
+    template void printAll<Policy>(Node<Policy> **); \
+    template void empty_subtree<Policy>(Node<Policy> **, std::vector<Node<Policy> *> &); \
+    template bool fill_subtree<Policy>(Node<Policy> **, const std::vector<Record> &); \
+    template bool mark_subtree<Policy>(Node<Policy> **, char *);
+
+INSTANTIATE_WOTREE(ConcurrentPolicy)
+INSTANTIATE_WOTREE(SingleOwnerPolicy)
+
 } // namespace wotree256
\ No newline at end of file
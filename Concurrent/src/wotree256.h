@@ -11,9 +11,16 @@
 #include <string>
 #include <cstdio>
 #include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 
 #include "flush.h"
 #include "pmallocator.h"
+#include "spinlock.h"
+#include "policy.h"
+#include "stats.h"
+#include "phase_timer.h"
 
 namespace wotree256 {
 
@@ -56,7 +63,7 @@ public:
         return CARDINALITY; // never be here
     }
     
-    void lock(bool change_version = true) {
+    uint32_t lock(bool change_version = true) { // return the number of failed attempts
         state_t new_state = pack;
         new_state.unpack.latch = 0;
         uint64_t old = new_state.pack;
@@ -64,24 +71,37 @@ public:
         if(change_version) new_state.unpack.node_version++;
         uint64_t desired = new_state.pack;
 
+        Backoff backoff;
+        uint32_t retries = 0;
         while(!__atomic_compare_exchange(&(this->pack), &old, &desired,
                 false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
             // the latch is hold by other thread or the state is changed
-            while(1) { // if the latch is not released, wait it
-                _mm_pause(); // delay for 140 cycle
-                if(unpack.latch == 0) // check if the latch is released
-                    break;
-            }
+            retries++;
+            do { // back off instead of spinning on the line the owner is flushing
+                backoff.pause();
+                new_state.pack = __atomic_load_n(&(this->pack), __ATOMIC_RELAXED);
+            } while(new_state.unpack.latch == 1);
 
-            state_t new_state = pack;
-            new_state.unpack.latch = 0;
             old = new_state.pack;
             new_state.unpack.latch = 1;
             if(change_version) new_state.unpack.node_version++;
             desired = new_state.pack;
         }
+        return retries;
     }
     
+    bool try_lock(bool change_version = true) { // a single attempt, fail if the latch is taken
+        state_t new_state = __atomic_load_n(&(this->pack), __ATOMIC_RELAXED);
+        if(new_state.unpack.latch == 1) return false;
+
+        uint64_t old = new_state.pack;
+        new_state.unpack.latch = 1;
+        if(change_version) new_state.unpack.node_version++;
+        uint64_t desired = new_state.pack;
+        return __atomic_compare_exchange(&(this->pack), &old, &desired,
+                false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
     void unlock(bool change_version = true) {
         state_t new_state = pack;
         new_state.unpack.latch = 0;
@@ -130,6 +150,104 @@ public:
     }
 };
 
+static inline uint32_t node_hash(const void * node) { // nodes are 256B aligned
+    uint64_t x = (uint64_t)node >> 8;
+    return x ^ (x >> 12);
+}
+
+/*
+    Contention detector of down-layer nodes. 
+    
+    Node latches that have to be retried heat up a counter hashed by the node address, 
+    uncontended acquisitions cool it down now and then. Writers may take a hot node as a hint 
+    to combine their operations instead of queueing on its latch. The counters are volatile
+    and only written on contention, so cold nodes never share a written line here. An
+    uncontended latch only counts a thread local tick, one of COOL_PERIOD of them looks at
+    the counter of its node.
+*/
+class HotNodes {
+public:
+    static const int SLOTS = 4096;
+    static const uint8_t HOT_THRESHOLD = 16;
+    static const uint8_t MAX_HEAT = 64;
+    static const uint32_t COOL_PERIOD = 16; // cool down once per COOL_PERIOD uncontended latches
+
+    inline void record(const void * node, uint32_t retries) {
+        if(retries == 0) {
+            static thread_local uint32_t tick = 0;
+            if(++tick % COOL_PERIOD != 0) return ;
+        }
+        std::atomic<uint8_t> & h = heat_[slot(node)];
+        uint8_t cur = h.load(std::memory_order_relaxed);
+        if(retries > 0) {
+            uint8_t next = std::min<uint32_t>(MAX_HEAT, cur + retries);
+            if(next != cur) h.store(next, std::memory_order_relaxed);
+        } else if(cur > 0) {
+            h.store(cur - 1, std::memory_order_relaxed);
+        }
+    }
+
+    inline bool is_hot(const void * node) const {
+        return heat_[slot(node)].load(std::memory_order_relaxed) >= HOT_THRESHOLD;
+    }
+
+private:
+    static inline uint32_t slot(const void * node) {
+        return node_hash(node) % SLOTS;
+    }
+
+    std::atomic<uint8_t> heat_[SLOTS] = {};
+};
+
+extern HotNodes hot_nodes;
+
+/*
+    Publication records for flat combining on hot leaves.
+
+    Instead of queueing on the latch of a hot leaf, a writer publishes its insert or update in 
+    a record of the bucket hashed by the leaf address. The first of them to get the latch applies
+    all the operations published for that leaf, persists them with a single fence and hands back 
+    the results. An operation that needs a split or belongs to the sibling is handed back 
+    undone, and its writer withdraws to the normal path.
+*/
+struct pubrec_t {
+    enum {FREE = 0, CLAIMED, PENDING, DONE, RETRY};
+
+    std::atomic<uint32_t> status;
+    bool is_update;
+    bool ret;
+    void * node;
+    _key_t key;
+    uint64_t val;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+class PubLists {
+public:
+    static const int BUCKETS = 256;
+    static const int RECORDS = 8; // records per bucket, shared by the leaves hashed to it
+
+    inline pubrec_t * bucket(const void * node) {
+        return records_[node_hash(node) % BUCKETS];
+    }
+
+    inline pubrec_t * claim(const void * node) { // NULL if all the records of the bucket are taken
+        pubrec_t * b = bucket(node);
+        for(int i = 0; i < RECORDS; i++) {
+            uint32_t expected = pubrec_t::FREE;
+            if(b[i].status.load(std::memory_order_relaxed) == pubrec_t::FREE &&
+                b[i].status.compare_exchange_strong(expected, pubrec_t::CLAIMED, std::memory_order_acquire))
+                return &b[i];
+        }
+        return NULL;
+    }
+
+private:
+    pubrec_t records_[BUCKETS][RECORDS] = {};
+};
+
+extern PubLists pub_lists;
+
+template<typename Policy>
 class Node {
 public:
     // First Cache Line
@@ -148,22 +266,44 @@ public:
     }
 
     void *operator new(size_t size) {
-        void * ret = galc->malloc(size);
+        void * ret = galc->template malloc<Policy>(size);
         return ret;
     }
 
+    inline void latch(bool change_version = true) {
+        uint32_t retries = Policy::lock(state_, change_version);
+        if(Policy::concurrent) {
+            hot_nodes.record(this, retries);
+            if(retries > 0) StatCounters::count(ST_LATCH_RETRY, retries);
+        }
+    }
+
+    inline void unlock(bool change_version = true) {
+        Policy::unlock(state_, change_version);
+    }
+
+    inline bool is_hot() const { // never for a single-owner tree, there is nobody to combine with
+        return Policy::concurrent && hot_nodes.is_hot(this);
+    }
+
     bool store(_key_t k, uint64_t v, _key_t & split_k, Node * & split_node) {
+        bool ret;
+        if(leftmost_ptr_ == NULL && is_hot() && combine(false, k, v, ret))
+            return false; // a combined insert never splits the leaf
+
         // there is one exclusive writer 
-        state_.lock();
+        latch();
 
         Record &sibling = siblings_[state_.unpack.sibling_version]; // the sibling is updated atomically, we are safe here
         if(k >= sibling.key) { // if the node has splitted and k to find is in next node 
             Node * sib_node = (Node *)galc->absolute(sibling.val);
-            state_.unlock();
+            unlock();
             return sib_node->store(k, v, split_k, split_node);
         }
 
         if(state_.unpack.count == CARDINALITY) { // should split the node
+            StatCounters::count(ST_SPLIT);
+            PHASE_BEGIN(split_start);
             uint64_t m = state_.unpack.count / 2;
             split_k = recs_[state_.read(m)].key;
 
@@ -172,7 +312,7 @@ public:
             state_t new_state = state_;
             if(leftmost_ptr_ == NULL) {
                 split_node = new Node;
-                split_node->state_.lock();
+                Policy::lock(split_node->state_, true);
                 for(int i = m; i < state_.unpack.count; i++) {
                     int8_t slotid = state_.read(i);
                     split_node->append(recs_[slotid], j, j);
@@ -183,7 +323,7 @@ public:
             } else {
                 int8_t slotid = state_.read(m);
                 split_node = new Node();
-                split_node->state_.lock();
+                Policy::lock(split_node->state_, true);
                 split_node->leftmost_ptr_ = recs_[slotid].val;
 
                 for(int i = m + 1; i < state_.unpack.count; i++) {
@@ -215,13 +355,14 @@ public:
             } else {
                 split_node->insertone(k, (char *)v);                
             }
-            split_node->state_.unlock();
-            state_.unlock();
+            split_node->unlock();
+            unlock();
+            PHASE_END(PH_SPLIT, split_start);
             return true;
         } else {
             insertone(k, (char *)v);
 
-            state_.unlock();
+            unlock();
             return false;
         }
     }
@@ -238,6 +379,7 @@ public:
             
             barrier();
             if(old_version != state_.unpack.node_version || old_version % 2 != 0) {
+                StatCounters::count(ST_VERSION_RETRY);
                 goto get_retry;
             }
             return sib_node->get_child(k);
@@ -260,6 +402,7 @@ public:
             
             barrier();
             if(old_version != state_.unpack.node_version || old_version % 2 != 0) {
+                StatCounters::count(ST_VERSION_RETRY);
                 goto get_retry;
             }
             return ret;
@@ -281,6 +424,7 @@ public:
             
             barrier();
             if(old_version != state_.unpack.node_version || old_version % 2 != 0) {
+                StatCounters::count(ST_VERSION_RETRY);
                 goto get_retry;
             }
             return ret;
@@ -288,12 +432,16 @@ public:
     }
 
     bool update(_key_t k, uint64_t v) {
-        state_.lock(false);
+        bool ret;
+        if(leftmost_ptr_ == NULL && is_hot() && combine(true, k, v, ret))
+            return ret;
+
+        latch(false);
 
         Record &sibling = siblings_[state_.unpack.sibling_version]; // the sibling is updated atomically, we are safe here
         if(k >= sibling.key) { // if the node has splitted and k to find is in next node 
             Node * sib_node = (Node *)galc->absolute(sibling.val);
-            state_.unlock(false);
+            unlock(false);
             return sib_node->update(k, v);
         }
 
@@ -312,35 +460,35 @@ public:
             found = true;
         }
 
-        state_.unlock(false);
+        unlock(false);
         return found;
     }
 
     bool remove(_key_t k) {
         // Non-SMO delete takes only one clwb 
-        state_.lock();
+        latch();
         Record &sibling = siblings_[state_.unpack.sibling_version];
         if(k >= sibling.key) { // if the node has splitted and k to find is in next node 
             Node * sib_node = (Node *)galc->absolute(sibling.val);
-            state_.unlock();
+            unlock();
             return sib_node->remove(k);
         }
 
         if(leftmost_ptr_ == NULL) {
-            int8_t idx, slotid;
+            int8_t idx, slotid = 0;
             for(idx = 0; idx < state_.unpack.count; idx++) {
                 slotid = state_.read(idx);
                 if(recs_[slotid].key >= k)
                     break;
             }
 
-            if(recs_[slotid].key == k) {
+            if(idx < state_.unpack.count && recs_[slotid].key == k) { // an empty leaf has no slot to read
                 uint64_t newpack = state_.remove(idx);
                 persist_assign(&(state_.pack), newpack);
-                state_.unlock();
+                unlock();
                 return true;
             } else {
-                state_.unlock();
+                unlock();
                 return false;
             }
         } else {
@@ -357,7 +505,7 @@ public:
             uint64_t newpack = state_.remove(idx - 1);
             persist_assign(&(state_.pack), newpack);
             
-            state_.unlock();
+            unlock();
             return true;
         }
     }
@@ -386,6 +534,113 @@ public:
         }
     }
 
+    void collect(_key_t lo, _key_t hi, std::vector<Record> & out, _key_t & sib_key, Node * & sib_node) {
+        // append the records of a leaf within [lo, hi) to out in key order, and return its sibling
+        size_t base = out.size();
+
+        get_retry:
+        out.resize(base);
+        uint64_t old_version = state_.unpack.node_version;
+        barrier();
+
+        state_t state = state_;
+        for(int i = 0; i < state.unpack.count; i++) {
+            Record & rec = recs_[state.read(i)];
+            if(rec.key >= lo && rec.key < hi)
+                out.push_back(rec);
+        }
+        Record & sibling = siblings_[state.unpack.sibling_version];
+        sib_key = sibling.key;
+        sib_node = (Node *)galc->absolute(sibling.val);
+
+        barrier();
+        if(old_version != state_.unpack.node_version || old_version % 2 != 0) {
+            goto get_retry;
+        }
+    }
+
+    bool combine(bool is_update, _key_t k, uint64_t v, bool & ret) {
+        // return false if the operation is not done by combining, and should take the normal path
+        pubrec_t * r = pub_lists.claim(this);
+        if(r == NULL) return false;
+
+        r->is_update = is_update;
+        r->node = this;
+        r->key = k;
+        r->val = v;
+        r->status.store(pubrec_t::PENDING, std::memory_order_release);
+
+        Backoff backoff;
+        uint32_t status;
+        while((status = r->status.load(std::memory_order_acquire)) == pubrec_t::PENDING) {
+            if(Policy::try_lock(state_, true)) { // become the combiner, our own record is applied as well
+                combine_published();
+                unlock();
+            } else {
+                hot_nodes.record(this, 1); // keep the leaf hot while there are waiters
+                backoff.pause();
+            }
+        }
+
+        ret = r->ret;
+        r->status.store(pubrec_t::FREE, std::memory_order_release);
+        return status == pubrec_t::DONE;
+    }
+
+    void combine_published() { // apply the operations published for this leaf, the latch is held
+        pubrec_t * bucket = pub_lists.bucket(this);
+        Record & sibling = siblings_[state_.unpack.sibling_version];
+        state_t new_state = state_;
+        uint32_t applied = 0, applied_cnt = 0;
+
+        for(int i = 0; i < PubLists::RECORDS; i++) {
+            pubrec_t & r = bucket[i];
+            if(r.status.load(std::memory_order_acquire) != pubrec_t::PENDING || r.node != this)
+                continue;
+            if(r.key >= sibling.key || (!r.is_update && new_state.unpack.count == CARDINALITY)) {
+                r.status.store(pubrec_t::RETRY, std::memory_order_release);
+                continue;
+            }
+
+            int8_t idx, slotid = 0;
+            for(idx = 0; idx < new_state.unpack.count; idx++) {
+                slotid = new_state.read(idx);
+                if(recs_[slotid].key >= r.key)
+                    break;
+            }
+
+            if(r.is_update) {
+                r.ret = new_state.unpack.count > 0 && recs_[slotid].key == r.key;
+                if(r.ret) {
+                    recs_[slotid].val = (char *)r.val;
+                    clwb(&recs_[slotid], sizeof(Record));
+                }
+            } else {
+                while(idx < new_state.unpack.count && recs_[new_state.read(idx)].key == r.key) 
+                    idx++; // same position as insertone
+                slotid = new_state.alloc();
+                recs_[slotid] = {r.key, (char *)r.val};
+                clwb(&recs_[slotid], sizeof(Record));
+                new_state.pack = new_state.add(idx, slotid);
+                r.ret = true;
+            }
+            applied |= 1u << i;
+            applied_cnt++;
+        }
+        if(applied == 0) return ;
+
+        mfence(); // one fence for the whole batch
+        if(new_state.unpack.count != state_.unpack.count)
+            persist_assign(&(state_.pack), new_state.pack);
+        
+        for(int i = 0; i < PubLists::RECORDS; i++) {
+            if(applied & (1u << i))
+                bucket[i].status.store(pubrec_t::DONE, std::memory_order_release);
+        }
+        if(applied_cnt == 1) // nothing to combine with, let the leaf cool down
+            hot_nodes.record(this, 0);
+    }
+
     void get_sibling(_key_t & k, Node ** &sibling) {
         Record &sib = siblings_[state_.unpack.sibling_version];
         k = sib.key;
@@ -419,8 +674,10 @@ public:
     }
 
     static void merge(Node * left, Node * right) {
-        left->state_.lock();
-        right->state_.lock();
+        StatCounters::count(ST_MERGE);
+        PHASE_BEGIN(merge_start);
+        left->latch();
+        right->latch();
 
         Record & sibling = left->siblings_[left->state_.unpack.sibling_version];
 
@@ -446,12 +703,13 @@ public:
         left->state_.pack = new_state.pack;
         clwb(left, 64);
 
-        left->state_.unlock();
+        left->unlock();
 
         galc->free(right); // WARNING: persistent memory leak here
+        PHASE_END(PH_SPLIT, merge_start);
     }
 
-    void get_lrchild(_key_t k, Node * & left, Node * & right) {
+    void get_lrchild(_key_t k, Node * & left, Node * & right, _key_t & right_key) { // right_key separates right
         get_retry:
         uint64_t old_version = state_.unpack.node_version;
         barrier();
@@ -476,8 +734,10 @@ public:
 
         if(i == state_.unpack.count) {
             right = NULL;
+            right_key = MAX_KEY;
         } else {
             right = (Node *)galc->absolute(recs_[state_.read(i)].val);
+            right_key = recs_[state_.read(i)].key;
         }
 
         barrier();
@@ -488,14 +748,42 @@ public:
     }
 };
 
-extern bool insert_recursive(Node * n, _key_t k, uint64_t v, _key_t &split_k, 
-                                Node * &split_node, int8_t &level);
-extern bool remove_recursive(Node * n, _key_t k);
-extern bool find(Node ** rootPtr, _key_t key, uint64_t &val);
-extern res_t insert(Node ** rootPtr, _key_t key, uint64_t val, int threshold);
-extern bool update(Node ** rootPtr, _key_t key, uint64_t val);
-extern bool remove(Node ** rootPtr, _key_t key);
-extern void printAll(Node ** rootPtr);
+/*
+    A tree kept in another form (e.g. compressed) is marked by mark_subtree: its root keeps no record
+    and the slot of its first position holds {MAX_KEY, ptr}, which no record of a root can hold.
+    The mark and the emptying of the root are a single atomic write of its state.
+*/
+template<typename Policy>
+inline char * marked(const Node<Policy> * root) { // ptr of the mark, NULL if not marked
+    state_t st = root->state_;
+    if(st.unpack.count != 0) return NULL;
+    const Record & r = root->recs_[st.read(0)];
+    return r.key == MAX_KEY ? r.val : NULL;
+}
+
+template<typename Policy>
+extern bool insert_recursive(Node<Policy> * n, _key_t k, uint64_t v, _key_t &split_k, 
+                                Node<Policy> * &split_node, int8_t &level);
+template<typename Policy>
+extern bool remove_recursive(Node<Policy> * n, _key_t k);
+template<typename Policy>
+extern bool find(Node<Policy> ** rootPtr, _key_t key, uint64_t &val);
+template<typename Policy>
+extern res_t insert(Node<Policy> ** rootPtr, _key_t key, uint64_t val, int threshold);
+template<typename Policy>
+extern bool update(Node<Policy> ** rootPtr, _key_t key, uint64_t val);
+template<typename Policy>
+extern bool remove(Node<Policy> ** rootPtr, _key_t key);
+template<typename Policy>
+extern void scan(Node<Policy> ** rootPtr, _key_t lo, _key_t hi, std::vector<Record> & out);
+template<typename Policy>
+extern void printAll(Node<Policy> ** rootPtr);
+template<typename Policy>
+extern void empty_subtree(Node<Policy> ** rootPtr, std::vector<Node<Policy> *> & freed);
+template<typename Policy>
+extern bool fill_subtree(Node<Policy> ** rootPtr, const std::vector<Record> & recs);
+template<typename Policy>
+extern bool mark_subtree(Node<Policy> ** rootPtr, char * ptr);
 
 } // namespace wotree256
 
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+#include "tlbtree.h"
+#include "../src/pool_analyzer.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+int main(int argc, char ** argv) {
+    string opt_pool = "/mnt/pmem/tlbtree.pool";
+    int opt_num_thread = std::thread::hardware_concurrency();
+
+    static const char * optstr = "f:t:h";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'f':
+            opt_pool = string(optarg);
+            break;
+        case 't':
+            if(atoi(optarg) > 0)
+                opt_num_thread = atoi(optarg);
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -f: " << "The pool file of a closed TLBtree, which is only read" << endl;
+            cout << "\t -t: " << "Number of threads to traverse the subtrees with" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    double start = seconds();
+    tlbtree::PoolAnalyzer<2, 2> analyzer(opt_pool.c_str());
+    analyzer.run(opt_num_thread);
+    double elapsed = seconds() - start;
+
+    analyzer.report();
+    printf("\nanalyzed in %.3f s with %d threads\n", elapsed, opt_num_thread);
+    return 0;
+}
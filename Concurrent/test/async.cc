@@ -0,0 +1,141 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+
+#include "tlbtree.h"
+#include "workload.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+    Run a workload with the asynchronous interface: each thread keeps a group of operations in 
+    flight and resumes them round-robin, so that their PM misses overlap.
+*/
+
+template<typename BtreeType>
+coro::task<void> run_query(BtreeType & tree, QueryType q, int small_noise, _key_t key_gap, int & notfound) {
+    uint64_t val = (uint64_t)q.key;
+    switch (q.op) {
+        case OperationType::READ: {
+            bool found = co_await tree.lookup_async(q.key, val);
+            if(!found) notfound++;
+            break;
+        }
+        case OperationType::INSERT:
+            co_await tree.insert_async(q.key + small_noise, val + small_noise);
+            break;
+        case OperationType::UPDATE:
+            co_await tree.update_async(q.key, val);
+            break;
+        case OperationType::DELETE:
+            tree.remove(q.key); // no asynchronous remove
+            break;
+        case OperationType::SCAN: { // no asynchronous scan
+            std::vector<Record> out;
+            _key_t span = key_gap * q.len;
+            tree.scan(q.key, q.key < MAX_KEY - span ? q.key + span : MAX_KEY, out);
+            break;
+        }
+        default:
+            cout << "Error: unknown operation!" << endl;
+            exit(0);
+    }
+}
+
+template<typename BtreeType>
+void run_group(BtreeType & tree, const QueryType * querys, size_t cnt, int group_size, int small_noise, _key_t key_gap, int & notfound) {
+    std::vector<coro::task<void>> inflight;
+    inflight.reserve(group_size);
+
+    size_t next = 0;
+    while(next < cnt && (int)inflight.size() < group_size)
+        inflight.push_back(run_query(tree, querys[next++], small_noise, key_gap, notfound));
+
+    while(!inflight.empty()) {
+        for(size_t i = 0; i < inflight.size(); ) {
+            if(inflight[i].resume()) {
+                i++;
+            } else if(next < cnt) { // finished, start the next query in its slot
+                inflight[i] = run_query(tree, querys[next++], small_noise, key_gap, notfound);
+                i++;
+            } else {
+                std::swap(inflight[i], inflight.back());
+                inflight.pop_back();
+            }
+        }
+    }
+}
+
+template<typename BtreeType>
+double run_test(const WorkloadFile & workload, int thread_cnt, int group_size) {
+    BtreeType tree("/mnt/pmem/tlbtree.pool");
+    // each time we run, we will insert different keys, but the reads of LATEST look the inserted keys up
+    int small_noise = workload.header().dist == LATEST ? 0 : getRandom() & 0xff;
+    _key_t key_gap = workload.header().key_gap;
+    std::vector<int> notfound(thread_cnt, 0);
+
+    auto start = seconds();
+    std::vector<std::thread> workers;
+    for(int t = 0; t < thread_cnt; t++) {
+        size_t cnt;
+        const QueryType * querys = workload.chunk(t, thread_cnt, cnt);
+        workers.emplace_back([&, t, querys, cnt]() {
+            run_group(tree, querys, cnt, group_size, small_noise, key_gap, notfound[t]);
+        });
+    }
+    for(auto & w : workers) w.join();
+    auto end = seconds();
+
+    int total_notfound = 0;
+    for(int n : notfound) total_notfound += n;
+    if(total_notfound > 0) cout << total_notfound << " keys not found" << endl;
+
+    return end - start;
+}
+
+int main(int argc, char ** argv) {
+    string opt_fname = "../build/workload.dat";
+    int opt_num_thread = 1;
+    int opt_group = 8;
+
+    static const char * optstr = "f:t:g:h";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'f':
+            opt_fname = string(optarg);
+            break;
+        case 't':
+            if(atoi(optarg) > 0)
+                opt_num_thread = atoi(optarg);
+            break;
+        case 'g':
+            if(atoi(optarg) > 0)
+                opt_group = atoi(optarg);
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -f: " << "Filename of the workload" << endl;
+            cout << "\t -t: " << "Number of Threads to excute the workload" << endl;
+            cout << "\t -g: " << "Number of in-flight operations per thread" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    WorkloadFile workload(opt_fname.c_str());
+    double time = run_test<TLBtree>(workload, opt_num_thread, opt_group);
+
+    cout << time << endl;
+
+    return 0;
+}
@@ -0,0 +1,294 @@
+/*  baselines.h - Baseline indexes of the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __BASELINES_H__
+#define __BASELINES_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "tlbtree.h"
+
+/*
+    Indexes that run_test of main compares TLBtree with, behind the interface of TLBtree: a
+    constructor taking the pool file, insert, update, lookup (0 if absent), remove and scan of
+    [lo, hi). They start empty, main loads the dataset into them before running the workload.
+    As with TLBtree, update and remove return true whether the key was there or not (a workload
+    may remove a key twice), so that the same workload files run on each of them.
+
+    LockedMap:      std::map behind a reader-writer lock, in DRAM
+    DramBtree:      a plain B+-tree behind a reader-writer lock, in DRAM
+    WotreeOnly:     a single wotree256 in PM without the top layer, as concurrent as TLBtree
+*/
+
+class LockedMap {
+public:
+    LockedMap(std::string) {} // in DRAM, no pool
+
+    inline void insert(_key_t key, uint64_t val) {
+        std::unique_lock<std::shared_mutex> l(mtx_);
+        map_[key] = val;
+    }
+
+    inline bool update(_key_t key, uint64_t val) {
+        std::unique_lock<std::shared_mutex> l(mtx_);
+        auto it = map_.find(key);
+        if(it != map_.end()) it->second = val;
+        return true;
+    }
+
+    inline uint64_t lookup(_key_t key) {
+        std::shared_lock<std::shared_mutex> l(mtx_);
+        auto it = map_.find(key);
+        return it == map_.end() ? 0 : it->second;
+    }
+
+    inline bool remove(_key_t key) {
+        std::unique_lock<std::shared_mutex> l(mtx_);
+        map_.erase(key);
+        return true;
+    }
+
+    inline void scan(_key_t lo, _key_t hi, std::vector<Record> & out) {
+        std::shared_lock<std::shared_mutex> l(mtx_);
+        for(auto it = map_.lower_bound(lo); it != map_.end() && it->first < hi; ++it)
+            out.push_back(Record(it->first, (char *)it->second));
+    }
+
+private:
+    std::map<_key_t, uint64_t> map_;
+    std::shared_mutex mtx_;
+};
+
+/*
+    A B+-tree of FANOUT keys per node, leaves are chained for scans. A node takes one key more
+    than FANOUT before it splits, so that an insert never splits before inserting. Removes do not
+    merge underflowed nodes.
+*/
+class DramBtree {
+    static const int FANOUT = 64;
+
+    struct BNode {
+        bool leaf;
+        int count;
+        _key_t keys[FANOUT + 1];
+        union {
+            uint64_t vals[FANOUT + 1];      // of a leaf
+            BNode * children[FANOUT + 2];   // of an inner node, children[i] holds the keys below keys[i]
+        };
+        BNode * next;                       // the right sibling of a leaf
+
+        BNode(bool isleaf): leaf(isleaf), count(0), next(NULL) {}
+    };
+
+public:
+    DramBtree(std::string): root_(new BNode(true)) {} // in DRAM
+
+    ~DramBtree() {
+        release(root_);
+    }
+
+    inline void insert(_key_t key, uint64_t val) {
+        std::unique_lock<std::shared_mutex> l(mtx_);
+        _key_t split_k;
+        BNode * split_node = insert_recursive(root_, key, val, split_k);
+        if(split_node != NULL) { // grow a new root
+            BNode * new_root = new BNode(false);
+            new_root->keys[0] = split_k;
+            new_root->children[0] = root_;
+            new_root->children[1] = split_node;
+            new_root->count = 1;
+            root_ = new_root;
+        }
+    }
+
+    inline bool update(_key_t key, uint64_t val) {
+        std::unique_lock<std::shared_mutex> l(mtx_);
+        BNode * leaf = find_leaf(key);
+        int pos = lower_bound(leaf, key);
+        if(pos < leaf->count && leaf->keys[pos] == key) leaf->vals[pos] = val;
+        return true;
+    }
+
+    inline uint64_t lookup(_key_t key) {
+        std::shared_lock<std::shared_mutex> l(mtx_);
+        BNode * leaf = find_leaf(key);
+        int pos = lower_bound(leaf, key);
+        return pos < leaf->count && leaf->keys[pos] == key ? leaf->vals[pos] : 0;
+    }
+
+    inline bool remove(_key_t key) {
+        std::unique_lock<std::shared_mutex> l(mtx_);
+        BNode * leaf = find_leaf(key);
+        int pos = lower_bound(leaf, key);
+        if(pos == leaf->count || leaf->keys[pos] != key) return true;
+        for(int i = pos; i < leaf->count - 1; i++) {
+            leaf->keys[i] = leaf->keys[i + 1];
+            leaf->vals[i] = leaf->vals[i + 1];
+        }
+        leaf->count--;
+        return true;
+    }
+
+    inline void scan(_key_t lo, _key_t hi, std::vector<Record> & out) {
+        std::shared_lock<std::shared_mutex> l(mtx_);
+        BNode * leaf = find_leaf(lo);
+        for(int pos = lower_bound(leaf, lo); leaf != NULL; leaf = leaf->next, pos = 0) {
+            for(; pos < leaf->count; pos++) {
+                if(leaf->keys[pos] >= hi) return ;
+                out.push_back(Record(leaf->keys[pos], (char *)leaf->vals[pos]));
+            }
+        }
+    }
+
+private:
+    static inline int lower_bound(const BNode * n, _key_t key) {
+        return std::lower_bound(n->keys, n->keys + n->count, key) - n->keys;
+    }
+
+    static inline int child_of(const BNode * n, _key_t key) {
+        return std::upper_bound(n->keys, n->keys + n->count, key) - n->keys;
+    }
+
+    inline BNode * find_leaf(_key_t key) const {
+        BNode * cur = root_;
+        while(!cur->leaf) cur = cur->children[child_of(cur, key)];
+        return cur;
+    }
+
+    /* insert into the subtree of n, return the new right sibling of n if n splits */
+    BNode * insert_recursive(BNode * n, _key_t key, uint64_t val, _key_t & split_k) {
+        if(n->leaf) {
+            int pos = lower_bound(n, key);
+            if(pos < n->count && n->keys[pos] == key) { // an existing key
+                n->vals[pos] = val;
+                return NULL;
+            }
+            for(int i = n->count; i > pos; i--) {
+                n->keys[i] = n->keys[i - 1];
+                n->vals[i] = n->vals[i - 1];
+            }
+            n->keys[pos] = key;
+            n->vals[pos] = val;
+            if(++n->count <= FANOUT) return NULL;
+
+            BNode * right = new BNode(true);
+            int m = n->count / 2;
+            right->count = n->count - m;
+            std::copy(n->keys + m, n->keys + n->count, right->keys);
+            std::copy(n->vals + m, n->vals + n->count, right->vals);
+            n->count = m;
+            right->next = n->next;
+            n->next = right;
+            split_k = right->keys[0];
+            return right;
+        } else {
+            int idx = child_of(n, key);
+            _key_t child_split_k;
+            BNode * child_split = insert_recursive(n->children[idx], key, val, child_split_k);
+            if(child_split == NULL) return NULL;
+
+            for(int i = n->count; i > idx; i--) {
+                n->keys[i] = n->keys[i - 1];
+                n->children[i + 1] = n->children[i];
+            }
+            n->keys[idx] = child_split_k;
+            n->children[idx + 1] = child_split;
+            if(++n->count <= FANOUT) return NULL;
+
+            BNode * right = new BNode(false); // keys[m] moves up
+            int m = n->count / 2;
+            right->count = n->count - m - 1;
+            std::copy(n->keys + m + 1, n->keys + n->count, right->keys);
+            std::copy(n->children + m + 1, n->children + n->count + 1, right->children);
+            n->count = m;
+            split_k = n->keys[m];
+            return right;
+        }
+    }
+
+    static void release(BNode * n) {
+        if(!n->leaf) {
+            for(int i = 0; i <= n->count; i++) release(n->children[i]);
+        }
+        delete n;
+    }
+
+    BNode * root_;
+    std::shared_mutex mtx_;
+};
+
+/*
+    The down layer of TLBtree alone, one wotree256 grown to any height, in a pool created afresh
+    (an existing pool file is removed). Without the top layer every operation descends from the
+    single root.
+
+    A thread whose split reaches the root it started from grows a new root over it and swaps it in
+    with a CAS. If another thread swapped a root in meanwhile, the new root is dropped: the nodes
+    it points to stay reachable through the sibling chain of their level.
+*/
+class WotreeOnly {
+    typedef wotree256::Node<ConcurrentPolicy> Node;
+    static const int MAX_HEIGHT = 64;
+
+public:
+    WotreeOnly(std::string path, uint64_t pool_size = POOL_SIZE) {
+        ::remove(path.c_str());
+        galc = alc_ = new PMAllocator(path.c_str(), false, "wotree", pool_size);
+        root_ = (Node **)galc->get_root(sizeof(Node *));
+        persist_assign(root_, galc->relative(new Node()));
+    }
+
+    ~WotreeOnly() {
+        delete alc_;
+    }
+
+    inline void insert(_key_t key, uint64_t val) {
+        galc = alc_;
+        Node * root = __atomic_load_n(root_, __ATOMIC_ACQUIRE);
+        Node * local = root;
+        wotree256::insert(&local, key, val, MAX_HEIGHT);
+        if(local != root && __atomic_compare_exchange_n(root_, &root, local, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            clwb(root_, sizeof(Node *));
+    }
+
+    inline bool update(_key_t key, uint64_t val) {
+        galc = alc_;
+        Node * root = __atomic_load_n(root_, __ATOMIC_ACQUIRE);
+        return wotree256::update(&root, key, val);
+    }
+
+    inline uint64_t lookup(_key_t key) {
+        galc = alc_;
+        Node * root = __atomic_load_n(root_, __ATOMIC_ACQUIRE);
+        uint64_t val;
+        return wotree256::find(&root, key, val) ? val : 0;
+    }
+
+    inline bool remove(_key_t key) {
+        galc = alc_;
+        Node * root = __atomic_load_n(root_, __ATOMIC_ACQUIRE);
+        wotree256::remove(&root, key); // tells whether the tree is empty
+        return true;
+    }
+
+    inline void scan(_key_t lo, _key_t hi, std::vector<Record> & out) {
+        galc = alc_;
+        Node * root = __atomic_load_n(root_, __ATOMIC_ACQUIRE);
+        wotree256::scan(&root, lo, hi, out);
+    }
+
+private:
+    PMAllocator * alc_;
+    Node ** root_; // relative pointer to the root, in the pool
+};
+
+#endif //__BASELINES_H__
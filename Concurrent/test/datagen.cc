@@ -1,55 +1,85 @@
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <random>
+#include <vector>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
 #include <algorithm>
+#include <omp.h>
 
 #include "common.h"
 #include "zipfian.h"
+#include "workload.h"
+#include "sosd.h"
 
 using std::cout;
 using std::endl;
 using std::string;
-using std::ofstream;
-using std::ifstream;
 
-enum DistributionType {RAND = 0, ZIPFIAN};
+static const char * DIST_NAMES[] = {"random", "zipfian", "latest", "hotspot", "sequential", "scrambled"};
+static const char * SCAN_NAMES[] = {"uniform", "zipfian", "fixed"};
+
+static const uint64_t BLOCK = MILLION; // queries generated from one seed, the unit of parallelism
 
 struct WorkloadType {
-    int operations = MILLION;
+    uint64_t operations = MILLION;
+    uint64_t scale = LOADSCALE * MILLION; // keys of the dataset
     float read = 1.0;
     float insert = 0;
     float update = 0;
     float remove = 0;
+    float scan = 0;
     DistributionType dist = RAND;
     float skewness = 0.8;
+    float hot_set = 0.2;    // fraction of the keys that are hot
+    float hot_ops = 0.8;    // fraction of the operations on the hot keys
+    ScanLengthType scan_dist = SCAN_UNIFORM;
+    uint32_t max_scan = 100;
+    uint64_t seed = 0;
     bool valid() {
-        return read + insert + update + remove == 1.0 && skewness > 0 && skewness < 1.0;
+        return std::fabs(read + insert + update + remove + scan - 1.0) < 1e-6 && skewness > 0 && skewness < 1.0
+            && hot_set > 0 && hot_set < 1.0 && hot_ops >= 0 && hot_ops <= 1.0 && max_scan > 0 && scale > 1;
     }
     void print() {
         cout << "=========WORKLOAD TYPE=========" << endl;
         cout << "Operations  : " << operations << endl;
+        cout << "Dataset keys: " << scale << endl;
         cout << "Read Ratio  : " << read << endl;
         cout << "Insert Ratio: " << insert << endl;
         cout << "Update Ratio: " << update << endl;
         cout << "Remove Ratio: " << remove << endl;
-        cout << "Distribution: " << (dist == RAND ? "random" : "Zipfian") << endl;
-        if (dist == ZIPFIAN) {
+        cout << "Scan Ratio  : " << scan << endl;
+        if (scan > 0) {
+            cout << "Scan Length : " << SCAN_NAMES[scan_dist] << " up to " << max_scan << endl;
+        }
+        cout << "Distribution: " << DIST_NAMES[dist] << endl;
+        if (dist == ZIPFIAN || dist == LATEST || dist == SCRAMBLED) {
             cout << "Skewness " << skewness << endl;
         }
+        if (dist == HOTSPOT) {
+            cout << "Hotspot     : " << hot_ops << " of the operations on " << hot_set << " of the keys" << endl;
+        }
+        cout << "Seed        : " << seed << endl;
         cout << "===============================" << endl;
     }
 };
 
+inline uint64_t mix(uint64_t x) { // splitmix64
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
 class OperationGenerator {
 public :
     OperationType mappings_[100];
-    std::default_random_engine gen_;
-    std::uniform_int_distribution<uint32_t> dist_;
 
-    OperationGenerator(WorkloadType &w) : gen_(getRandom()) {
+    OperationGenerator(WorkloadType &w) {
         int read_end = 100 * w.read;
         int insert_end = read_end + 100 * w.insert;
         int update_end = insert_end + 100 * w.update;
@@ -66,71 +96,301 @@ public :
 
         for(int i = update_end; i < remove_end; i++)
             mappings_[i] = OperationType::DELETE;
+
+        for(int i = remove_end; i < 100; i++)
+            mappings_[i] = OperationType::SCAN;
     }
 
-    OperationType next() {
-        return mappings_[dist_(gen_) % 100];
+    template<typename G>
+    OperationType next(G & gen) const {
+        return mappings_[gen() % 100];
     }
 };
 
-// try not to generate duplicate keys, because some tree indices may not get used to it
-
-void gen_dataset(int64_t *arr, uint64_t scale, bool random) {
-    std::mt19937 gen(10007);
-    if(random) {
-        uint64_t step = MAX_KEY / scale;
-        std::uniform_int_distribution<int64_t> dist(0, MAX_KEY);
-        for(int64_t i = 0; i < scale; i++) {
-            #ifdef DEBUG
-                arr[i] = i + 1;
-            #else  
-                arr[i] = i * step + 1; // non duplicated keys, and no zero key 
-            #endif
+/*
+    KeySpace: the dataset of scale evenly spaced keys, the key of rank r (in key order) is
+    r * step + 1. The keys are loaded in a pseudo-random order, item i (the i-th loaded key) is of
+    rank permute(i), a Feistel network over [0, scale), so that neither the keys nor their order
+    are kept in memory, at any scale.
+
+    Inserted keys never collide with each other or with the dataset: the j-th insert takes the gap
+    after the key of rank permute(j % scale), at offset j / scale + 1 from it.
+
+    A KeySpace of real keys (e.g. of a SOSD file) keeps them sorted instead, and holds a fraction
+    of them out of the dataset: the items are permute(i) over all the keys, the first scale of them
+    are loaded, and the j-th insert takes the key of item scale + j.
+*/
+class KeySpace {
+    static const int ROUNDS = 4;
+    static const uint64_t SEED = 10007; // the dataset does not depend on the seed of a workload
+
+    uint64_t scale_;
+    uint64_t step_;
+    uint64_t domain_;           // of the permutation
+    int half_bits_;
+    uint64_t half_mask_;
+    uint64_t round_keys_[ROUNDS];
+    std::vector<_key_t> keys_;  // all the real keys, in key order
+    std::vector<_key_t> loaded_, fresh_; // the loaded and held out ones, in key order
+
+public:
+    KeySpace(uint64_t scale): scale_(scale), step_(MAX_KEY / scale) {
+        init(scale);
+    }
+
+    KeySpace(std::vector<_key_t> && keys, double holdout, int thread_cnt): keys_(std::move(keys)) {
+        uint64_t n = keys_.size();
+        scale_ = std::max((uint64_t)1, std::min(n, (uint64_t)(n * (1 - holdout))));
+        init(n);
+
+        std::vector<char> is_loaded(n, 0);
+        #pragma omp parallel for schedule(static) num_threads(thread_cnt)
+        for(uint64_t i = 0; i < scale_; i++)
+            is_loaded[permute(i)] = 1;
+        loaded_.reserve(scale_);
+        fresh_.reserve(n - scale_);
+        for(uint64_t r = 0; r < n; r++)
+            (is_loaded[r] ? loaded_ : fresh_).push_back(keys_[r]);
+        step_ = std::max((uint64_t)1, (uint64_t)(loaded_.back() - loaded_.front()) / scale_);
+    }
+
+    inline uint64_t scale() const { return scale_; }
+
+    inline uint64_t step() const { return step_; } // the average gap of real keys
+
+    inline uint64_t capacity() const { // of the inserted keys
+        return keys_.empty() ? scale_ * (step_ - 1) : fresh_.size();
+    }
+
+    inline _key_t key_of_rank(uint64_t r) const {
+        return keys_.empty() ? (_key_t)(r * step_ + 1) : loaded_[r];
+    }
+
+    inline uint64_t permute(uint64_t i) const {
+        do {
+            i = feistel(i);
+        } while(i >= domain_); // cycle walking keeps it a permutation of [0, domain)
+        return i;
+    }
+
+    inline _key_t key_of_item(uint64_t i) const {
+        return keys_.empty() ? key_of_rank(permute(i)) : keys_[permute(i)];
+    }
+
+    /* the key of the j-th insert, in key order of j if in_order */
+    inline _key_t fresh_key(uint64_t j, bool in_order) const {
+        if(!keys_.empty()) return in_order ? fresh_[j] : keys_[permute(scale_ + j)];
+        uint64_t r = j % scale_;
+        return key_of_rank(in_order ? r : permute(r)) + (_key_t)(j / scale_ + 1);
+    }
+
+private:
+    void init(uint64_t domain) {
+        domain_ = domain;
+        int bits = 2;
+        while(bits < 64 && (1ULL << bits) < domain) bits += 2; // an even number of bits, less than 4 * domain values
+        half_bits_ = bits / 2;
+        half_mask_ = (1ULL << half_bits_) - 1;
+        for(int k = 0; k < ROUNDS; k++)
+            round_keys_[k] = mix(SEED + k);
+    }
+
+    inline uint64_t feistel(uint64_t x) const {
+        uint64_t l = x >> half_bits_, r = x & half_mask_;
+        for(int k = 0; k < ROUNDS; k++) {
+            uint64_t t = l ^ (mix(r ^ round_keys_[k]) & half_mask_);
+            l = r;
+            r = t;
         }
-        std::shuffle(arr, arr + scale - 1, gen);
-    } else {
-        std::normal_distribution<double> dist(MAX_KEY / 2, MAX_KEY / 8);
-        int64_t i = 0;
-        while (i < scale) {
-            double val = (uint64_t)dist(gen);
-            if(val < 0 || val > (double) MAX_KEY) {
-                continue;
-            } else {
-                arr[i++] = (int64_t)std::round(val);
+        return (l << half_bits_) | r;
+    }
+};
+
+/* the zeta constant of a zipfian distribution over n items, which takes O(n) to compute, so it is
+   computed once in parallel and kept in zeta.cache */
+double cached_zeta(uint64_t n, double theta, int thread_cnt) {
+    FILE * f = fopen("zeta.cache", "r");
+    if(f != NULL) {
+        unsigned long long cn;
+        double ctheta, czeta;
+        while(fscanf(f, "%llu %lf %lf", &cn, &ctheta, &czeta) == 3) {
+            if(cn == n && ctheta == theta) {
+                fclose(f);
+                return czeta;
             }
         }
+        fclose(f);
+    }
+
+    // partial sums of fixed blocks, added in order, so the result does not depend on the threads
+    uint64_t blocks = (n + BLOCK - 1) / BLOCK;
+    std::vector<double> sums(blocks, 0);
+    #pragma omp parallel for schedule(dynamic) num_threads(thread_cnt)
+    for(uint64_t b = 0; b < blocks; b++) {
+        uint64_t end = std::min(n, (b + 1) * BLOCK);
+        for(uint64_t i = b * BLOCK + 1; i <= end; i++)
+            sums[b] += std::pow(1.0 / i, theta);
+    }
+    double zeta = 0;
+    for(double s : sums) zeta += s;
+
+    f = fopen("zeta.cache", "a");
+    if(f != NULL) {
+        fprintf(f, "%llu %.17g %.17g\n", (unsigned long long)n, theta, zeta);
+        fclose(f);
     }
-    return ;
+    return zeta;
 }
 
-void gen_workload(int64_t *arr, uint64_t scale, QueryType * querys, WorkloadType w) {
-    std::mt19937 gen(getRandom());
-    std::uniform_int_distribution<int64_t> idx1_dist(0, scale - 1);
-    zipfian_int_distribution<int64_t> idx2_dist(0, scale - 1, w.skewness);
+// the keys of the items in load order, written in parallel
+void gen_dataset(const KeySpace & ks, const char * path, int thread_cnt) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(fd < 0) {
+        cout << "can not write the dataset file" << endl;
+        exit(-1);
+    }
+    uint64_t blocks = (ks.scale() + BLOCK - 1) / BLOCK;
+    bool failed = false;
+    #pragma omp parallel for schedule(dynamic) num_threads(thread_cnt)
+    for(uint64_t b = 0; b < blocks; b++) {
+        uint64_t end = std::min(ks.scale(), (b + 1) * BLOCK);
+        std::vector<int64_t> keys;
+        keys.reserve(end - b * BLOCK);
+        for(uint64_t i = b * BLOCK; i < end; i++)
+            keys.push_back(ks.key_of_item(i));
+        ssize_t size = keys.size() * sizeof(int64_t);
+        if(pwrite(fd, keys.data(), size, b * BLOCK * sizeof(int64_t)) != size)
+            failed = true;
+    }
+    if(failed || close(fd) != 0) {
+        cout << "can not write the dataset file" << endl;
+        exit(-1);
+    }
+}
+
+/*
+    The queries are generated in blocks of BLOCK, each from its own seed, so the workload only
+    depends on the seed and not on the number of threads. A first pass draws the operations and
+    counts the inserts of each block, the second one the keys, as the j-th insert of the workload
+    takes the j-th fresh key, and LATEST reads the keys inserted before.
+*/
+void gen_workload(const KeySpace & ks, QueryType * querys, WorkloadType w, int thread_cnt) {
+    uint64_t blocks = (w.operations + BLOCK - 1) / BLOCK;
     OperationGenerator op_gen(w);
 
-    for(int i = 0; i < w.operations; i++) {
-        OperationType op = op_gen.next();
-        int idx = (w.dist == RAND ? idx1_dist(gen) : idx2_dist(gen));
-        // for insert operations, we should make sure the key does not exist in the dataset
-        _key_t key = (op == OperationType::INSERT ? arr[idx] + getRandom(): arr[idx]); 
+    std::vector<uint64_t> inserted(blocks + 1, 0); // inserts before each block
+    #pragma omp parallel for schedule(dynamic) num_threads(thread_cnt)
+    for(uint64_t b = 0; b < blocks; b++) {
+        std::mt19937_64 gen(mix(w.seed ^ mix(2 * b)));
+        uint64_t end = std::min(w.operations, (b + 1) * BLOCK), cnt = 0;
+        for(uint64_t i = b * BLOCK; i < end; i++) {
+            querys[i].op = op_gen.next(gen);
+            querys[i].len = 0;
+            if(querys[i].op == OperationType::INSERT) cnt++;
+        }
+        inserted[b + 1] = cnt;
+    }
+    for(uint64_t b = 0; b < blocks; b++)
+        inserted[b + 1] += inserted[b];
+    if(inserted[blocks] > ks.capacity()) {
+        cout << "too many inserts for the dataset" << endl;
+        exit(-1);
+    }
+
+    uint64_t scale = ks.scale();
+    bool skewed = w.dist == ZIPFIAN || w.dist == LATEST || w.dist == SCRAMBLED;
+    zipfian_int_distribution<int64_t>::param_type zipf_param(0, scale - 1, w.skewness,
+                                                    skewed ? cached_zeta(scale, w.skewness, thread_cnt) : 1);
+    zipfian_int_distribution<int64_t>::param_type len_param(1, w.max_scan, w.skewness,
+                                                    cached_zeta(w.max_scan, w.skewness, thread_cnt));
+    uint64_t hot_cnt = std::max((uint64_t)1, (uint64_t)(w.hot_set * scale));
+    uint64_t hot_begin = mix(w.seed) % (scale - hot_cnt + 1); // the hot keys are a range of ranks
+
+    #pragma omp parallel for schedule(dynamic) num_threads(thread_cnt)
+    for(uint64_t b = 0; b < blocks; b++) {
+        std::mt19937_64 gen(mix(w.seed ^ mix(2 * b + 1)));
+        std::uniform_int_distribution<uint64_t> item_dist(0, scale - 1);
+        std::uniform_int_distribution<uint64_t> hot_dist(0, hot_cnt - 1);
+        std::uniform_int_distribution<uint64_t> cold_dist(0, std::max((uint64_t)1, scale - hot_cnt) - 1);
+        std::uniform_real_distribution<double> coin(0, 1);
+        std::uniform_int_distribution<uint32_t> len_dist(1, w.max_scan);
+        zipfian_int_distribution<int64_t> zipf(zipf_param);
+        zipfian_int_distribution<int64_t> len_zipf(len_param);
+
+        uint64_t j = inserted[b];
+        uint64_t end = std::min(w.operations, (b + 1) * BLOCK);
+        for(uint64_t i = b * BLOCK; i < end; i++) {
+            QueryType & q = querys[i];
+            if(q.op == OperationType::INSERT) {
+                q.key = ks.fresh_key(j++, w.dist == SEQUENTIAL);
+                continue;
+            }
 
-        querys[i] = {op, key};
+            switch(w.dist) {
+                case RAND:
+                    q.key = ks.key_of_item(item_dist(gen));
+                    break;
+                case ZIPFIAN: // the hot items are the first loaded ones, scattered over the key space
+                    q.key = ks.key_of_item(zipf(gen));
+                    break;
+                case SCRAMBLED: // the popularity is hashed over the items, as YCSB does
+                    q.key = ks.key_of_item(mix(zipf(gen)) % scale);
+                    break;
+                case LATEST: { // the hot keys are the latest inserted ones, then the last loaded ones
+                    uint64_t z = zipf(gen);
+                    q.key = z < j ? ks.fresh_key(j - 1 - z, false) : ks.key_of_item(scale - 1 - (z - j));
+                    break;
+                }
+                case HOTSPOT: {
+                    uint64_t r;
+                    if(coin(gen) < w.hot_ops || hot_cnt == scale) {
+                        r = hot_begin + hot_dist(gen);
+                    } else {
+                        r = cold_dist(gen);
+                        if(r >= hot_begin) r += hot_cnt;
+                    }
+                    q.key = ks.key_of_rank(r);
+                    break;
+                }
+                case SEQUENTIAL:
+                    q.key = ks.key_of_rank(i % scale);
+                    break;
+            }
+
+            if(q.op == OperationType::SCAN) {
+                switch(w.scan_dist) {
+                    case SCAN_UNIFORM: q.len = len_dist(gen); break;
+                    case SCAN_ZIPFIAN: q.len = len_zipf(gen); break; // mostly short
+                    case SCAN_FIXED: q.len = w.max_scan; break;
+                }
+            }
+        }
     }
 }
 
+int find_name(const char * name, const char * const * names, int cnt) {
+    for(int i = 0; i < cnt; i++)
+        if(strcmp(name, names[i]) == 0) return i;
+    return -1;
+}
+
 int main(int argc, char ** argv) {
-    static const bool DATASET_RANDOM = true;
-    bool opt_zipfian  = false;
     WorkloadType w;
+    w.seed = getRandom();
+    int thread_cnt = omp_get_max_threads();
+    string opt_keys;
+    double opt_holdout = 0.1;
 
-    static const char * optstr = "r:i:u:d:o:s:hz"; 
+    static const char * optstr = "r:i:u:d:q:o:n:s:e:D:H:p:l:L:t:k:x:hz";
     opterr = 0;
     char opt;
     while((opt = getopt(argc, argv, optstr)) != -1) {
         switch(opt) {
         case 'o':
-            w.operations = atoi(optarg) * MILLION;
+            w.operations = atof(optarg) * MILLION;
+            break;
+        case 'n':
+            w.scale = atof(optarg) * MILLION;
             break;
         case 's':
             w.skewness = atof(optarg);
@@ -147,65 +407,128 @@ int main(int argc, char ** argv) {
         case 'u':
             w.update = atof(optarg);
             break;
+        case 'q':
+            w.scan = atof(optarg);
+            break;
+        case 'e':
+            w.seed = strtoull(optarg, NULL, 10);
+            break;
         case 'z':
-            opt_zipfian = true;
+            w.dist = ZIPFIAN;
+            break;
+        case 'D': {
+            int d = find_name(optarg, DIST_NAMES, sizeof(DIST_NAMES) / sizeof(DIST_NAMES[0]));
+            if(d < 0) {
+                cout << "unknown distribution " << optarg << endl;
+                exit(-1);
+            }
+            w.dist = (DistributionType)d;
+            break;
+        }
+        case 'H':
+            w.hot_set = atof(optarg);
+            break;
+        case 'p':
+            w.hot_ops = atof(optarg);
+            break;
+        case 'l':
+            w.max_scan = atoi(optarg);
+            break;
+        case 'L': {
+            int d = find_name(optarg, SCAN_NAMES, sizeof(SCAN_NAMES) / sizeof(SCAN_NAMES[0]));
+            if(d < 0) {
+                cout << "unknown scan length distribution " << optarg << endl;
+                exit(-1);
+            }
+            w.scan_dist = (ScanLengthType)d;
+            break;
+        }
+        case 't':
+            if(atoi(optarg) > 0)
+                thread_cnt = atoi(optarg);
+            break;
+        case 'k':
+            opt_keys = string(optarg);
+            break;
+        case 'x':
+            opt_holdout = atof(optarg);
             break;
         case '?':
         case 'h':
         default:
             cout << "USAGE: "<< argv[0] << "[option]" << endl;
             cout << "\t -h: " << "Print the USAGE" << endl;
-            cout << "\t -z: " << "Use zipfian distribution (Not specified: random distribution)" << endl;
-            cout << "\t -o: " << "The number of operations" << endl;
+            cout << "\t -D: " << "Distribution of the keys: random, zipfian, latest, hotspot, sequential, scrambled (Not specified: random)" << endl;
+            cout << "\t -z: " << "Use zipfian distribution, the same as -D zipfian" << endl;
+            cout << "\t -o: " << "The number of operations (million)" << endl;
+            cout << "\t -n: " << "The number of keys of the dataset (million, Not specified: " << LOADSCALE << ")" << endl;
             cout << "\t -s: " << "The skewness of query workload(0 - 1)" << endl;
+            cout << "\t -H: " << "Fraction of the keys in the hot range of hotspot (Not specified: 0.2)" << endl;
+            cout << "\t -p: " << "Fraction of the operations on the hot range of hotspot (Not specified: 0.8)" << endl;
             cout << "\t -r: " << "Read ratio" << endl;
             cout << "\t -i: " << "Insert ratio" << endl;
             cout << "\t -u: " << "update ratio" << endl;
             cout << "\t -d: " << "Delete ratio" << endl;
+            cout << "\t -q: " << "Scan ratio" << endl;
+            cout << "\t -l: " << "Maximum records of a scan (Not specified: 100)" << endl;
+            cout << "\t -L: " << "Distribution of the scan lengths: uniform, zipfian, fixed (Not specified: uniform)" << endl;
+            cout << "\t -e: " << "Seed of the generator, the same seed makes the same workload (Not specified: random)" << endl;
+            cout << "\t -t: " << "Number of threads to generate with" << endl;
+            cout << "\t -k: " << "Use the keys of a SOSD key file (uint64 count then the keys) instead of synthetic ones, -n is ignored" << endl;
+            cout << "\t -x: " << "Fraction of the keys of -k held out of the dataset for the inserts (Not specified: 0.1)" << endl;
             exit(-1);
         }
     }
 
+    if(opt_holdout < 0 || opt_holdout >= 1.0) {
+        cout << "Invalid fraction of held out keys" << endl;
+        exit(-1);
+    }
+    KeySpace * keyspace = opt_keys.empty() ? new KeySpace(w.scale)
+                            : new KeySpace(load_sosd(opt_keys.c_str()), opt_holdout, thread_cnt);
+    KeySpace & ks = *keyspace;
+    w.scale = ks.scale();
+
     if(!w.valid()) {
         cout << "Invalid workload configuration" << endl;
         exit(-1);
     }
-    if(opt_zipfian == true) {
-        w.dist = ZIPFIAN;
-    }
 
     w.print();
 
-    #ifdef DEBUG
-        uint64_t scale = LOADSCALE * KILO;
-    #else
-        uint64_t scale = LOADSCALE * MILLION;
-    #endif
-
-    int64_t * arr = new int64_t[scale];
-    if(!file_exist("dataset.dat")) {
-        gen_dataset(arr, scale, DATASET_RANDOM);
-        ofstream fout("dataset.dat", std::ios::binary);
-        fout.write((char *) arr, sizeof(int64_t) * scale);
-        fout.close();
+    // the keys of a file may differ with the same count, so their dataset is always written
+    struct stat st;
+    if(!opt_keys.empty() || stat("dataset.dat", &st) != 0 || (uint64_t)st.st_size != w.scale * sizeof(int64_t)) {
+        gen_dataset(ks, "dataset.dat", thread_cnt);
         cout << "generate a dataset file" << endl;
-    } else {
-        ifstream fin("dataset.dat", std::ios::binary);
-        fin.read((char *)arr, sizeof(int64_t) * scale);
-        fin.close();
     }
 
-    QueryType * querys = new QueryType[w.operations];
-    gen_workload(arr, scale, querys, w);
-    
-    ofstream fout("workload.txt");
-    for(int i = 0; i < w.operations; i++) {
-        fout << querys[i].op << " " << querys[i].key << endl;
-    }
-    fout.close();
+    WorkloadHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = WorkloadHeader::MAGIC;
+    header.version = WorkloadHeader::VERSION;
+    header.dist = w.dist;
+    header.count = w.operations;
+    header.seed = w.seed;
+    header.read = w.read;
+    header.insert = w.insert;
+    header.update = w.update;
+    header.remove = w.remove;
+    header.scan = w.scan;
+    header.skewness = w.skewness;
+    header.hot_set = w.hot_set;
+    header.hot_ops = w.hot_ops;
+    header.query_size = sizeof(QueryType);
+    header.scan_dist = w.scan_dist;
+    header.max_scan = w.max_scan;
+    header.scale = w.scale;
+    header.key_gap = ks.step();
+
+    QueryType * querys = WorkloadFile::create("workload.dat", header);
+    gen_workload(ks, querys, w, thread_cnt);
+    WorkloadFile::finish(querys, w.operations);
     cout << "generate a query workload file" << endl;
 
-    delete [] arr;
-    delete [] querys;
+    delete keyspace;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,88 @@
+/*  histogram.h - A latency histogram for the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+/*
+    Histogram: counts of latencies in nanoseconds, exact below 128ns and with 64 buckets per power
+    of two above, so a percentile is off by less than 1/64. A thread records into its own
+    histogram, which are merged after the run.
+*/
+class Histogram {
+public:
+    static const int SUB_BITS = 6;
+    static const int LINEAR = 2 << SUB_BITS;
+    static const int BUCKETS = LINEAR + (64 - SUB_BITS - 1) * (1 << SUB_BITS);
+
+private:
+    uint64_t counts_[BUCKETS];
+    uint64_t cnt_;
+    uint64_t sum_;
+    uint64_t max_;
+
+public:
+    Histogram() { clear(); }
+
+    void clear() {
+        memset(counts_, 0, sizeof(counts_));
+        cnt_ = sum_ = max_ = 0;
+    }
+
+    inline void record(uint64_t ns) {
+        counts_[bucket_of(ns)]++;
+        cnt_++;
+        sum_ += ns;
+        max_ = std::max(max_, ns);
+    }
+
+    void merge(const Histogram & other) {
+        for(int i = 0; i < BUCKETS; i++)
+            counts_[i] += other.counts_[i];
+        cnt_ += other.cnt_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    inline uint64_t count() const { return cnt_; }
+
+    inline double mean() const { return cnt_ == 0 ? 0 : (double)sum_ / cnt_; }
+
+    inline uint64_t max() const { return max_; }
+
+    /* the latency below which p percent (0 - 100) of the records are */
+    uint64_t percentile(double p) const {
+        if(cnt_ == 0) return 0;
+        uint64_t rank = std::max((uint64_t)1, (uint64_t)(p / 100 * cnt_ + 0.5));
+        uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+            if(seen >= rank) return std::min(max_, value_of(i));
+        }
+        return max_;
+    }
+
+private:
+    static inline int bucket_of(uint64_t ns) {
+        if(ns < LINEAR) return ns;
+        int e = 63 - __builtin_clzll(ns); // SUB_BITS + 1 or more
+        int sub = (ns >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+        return LINEAR + (e - SUB_BITS - 1) * (1 << SUB_BITS) + sub;
+    }
+
+    static inline uint64_t value_of(int bucket) { // the middle of the bucket
+        if(bucket < LINEAR) return bucket;
+        int e = (bucket - LINEAR) / (1 << SUB_BITS) + SUB_BITS + 1;
+        uint64_t sub = (bucket - LINEAR) % (1 << SUB_BITS);
+        uint64_t width = 1ULL << (e - SUB_BITS);
+        return ((1ULL << SUB_BITS) + sub) * width + width / 2;
+    }
+};
+
+#endif //__HISTOGRAM_H__
@@ -0,0 +1,347 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+
+#include "tlbtree.h"
+#include "histogram.h"
+#include "topology.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+    Measures how much the rebuildings of the top layer disturb the operations running beside them.
+    The driver loads a fresh tree, then keeps a steady mix of reads, inserts and updates on it for
+    a number of seconds, and records the start and latency of every operation, together with the
+    start and end of each rebuilding (TLBtree::set_rebuild_listener). Inserts split subtrees, which
+    lengthens the sibling chain behind the top layer until a rebuilding is triggered.
+
+    An operation is inside a rebuild window if it overlaps the window widened by the grace period
+    on both sides, and outside otherwise. The latency percentiles of both are reported apart. With
+    a target rate (-q) each thread issues its operations at fixed times, and a latency is counted
+    from the time the operation was due, so an operation delayed by the one before it is not hidden.
+*/
+
+enum InterfereOp {I_READ = 0, I_INSERT, I_UPDATE, I_OPS};
+static const char * OP_NAMES[I_OPS] = {"read", "insert", "update"};
+
+struct Config {
+    uint64_t records = MILLION;
+    int threads = 1;
+    double duration = 10;   // seconds
+    int mix[I_OPS] = {50, 25, 25};
+    double rate = 0;        // operations per second of each thread, 0 to issue them back to back
+    double grace_ms = 0;
+    string pool = "/mnt/pmem/interfere.pool";
+    string series;          // prefix of the time series files, empty to keep them in memory only
+};
+
+struct Sample {
+    uint64_t start_ns;      // since the start of the run
+    uint32_t latency_ns;    // saturated at about 4 s
+    uint16_t op;
+    uint16_t thread;
+};
+
+// the samples of a thread, in blocks that are never moved, so that recording never copies them
+class SampleLog {
+    static const size_t BLOCK = 1 << 16;
+    std::vector<Sample *> blocks_;
+    size_t cnt_ = 0;
+
+public:
+    ~SampleLog() {
+        for(Sample * b : blocks_) delete [] b;
+    }
+
+    inline void add(const Sample & s) {
+        if(cnt_ == blocks_.size() * BLOCK) blocks_.push_back(new Sample[BLOCK]);
+        blocks_[cnt_ / BLOCK][cnt_ % BLOCK] = s;
+        cnt_++;
+    }
+
+    inline size_t size() const { return cnt_; }
+
+    inline const Sample & operator[](size_t i) const { return blocks_[i / BLOCK][i % BLOCK]; }
+};
+
+struct Span {
+    uint64_t start_ns, end_ns;
+};
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// record ids are scattered over the key space, so that the inserts split subtrees everywhere
+inline _key_t key_of(uint64_t id) {
+    return (_key_t)(((id + 1) * 0x9E3779B97F4A7C15ULL) & (uint64_t)MAX_KEY);
+}
+
+class Interfere {
+    Config cfg_;
+    TLBtree * tree_;
+    std::vector<int> cpus_;
+    std::atomic<uint64_t> next_id_;
+    std::atomic<bool> stop_;
+    uint64_t base_ns_;              // the start of the run
+    std::mutex spans_mtx_;
+    std::vector<Span> spans_;       // the rebuildings since the tree was opened, in absolute time
+
+public:
+    Interfere(const Config & cfg): cfg_(cfg), cpus_(cpu_order(false)), next_id_(cfg.records), stop_(false), base_ns_(0) {
+        remove(cfg_.pool.c_str()); // a fresh tree each run
+        tree_ = new TLBtree(cfg_.pool, std::max(POOL_SIZE, cfg_.records * 256));
+        tree_->set_rebuild_listener([this](bool start) {
+            std::lock_guard<std::mutex> l(spans_mtx_);
+            if(start) spans_.push_back({now_ns(), 0});
+            else if(!spans_.empty()) spans_.back().end_ns = now_ns(); // the rebuildings do not overlap
+        });
+    }
+
+    ~Interfere() {
+        delete tree_;
+    }
+
+    double load() {
+        std::vector<std::thread> loaders;
+        uint64_t chunk = (cfg_.records + cfg_.threads - 1) / cfg_.threads;
+        double start = seconds();
+        for(int t = 0; t < cfg_.threads; t++) {
+            loaders.emplace_back([this, t, chunk]() {
+                pin_to_cpu(cpus_[t % cpus_.size()]);
+                uint64_t end = std::min(cfg_.records, chunk * (t + 1));
+                for(uint64_t id = chunk * t; id < end; id++)
+                    tree_->insert(key_of(id), (uint64_t)key_of(id));
+            });
+        }
+        for(auto & l : loaders) l.join();
+        return seconds() - start;
+    }
+
+    void run() {
+        std::vector<SampleLog> logs(cfg_.threads);
+        std::vector<std::thread> threads;
+        std::atomic<int> ready(0);
+        for(int t = 0; t < cfg_.threads; t++) {
+            threads.emplace_back([this, t, &logs, &ready]() {
+                ready.fetch_add(1);
+                while(__atomic_load_n(&base_ns_, __ATOMIC_ACQUIRE) == 0) std::this_thread::yield();
+                work(t, logs[t]);
+            });
+        }
+        while(ready.load() < cfg_.threads) std::this_thread::yield();
+        __atomic_store_n(&base_ns_, now_ns(), __ATOMIC_RELEASE);
+        usleep(cfg_.duration * 1e6);
+        stop_.store(true);
+        for(auto & t : threads) t.join();
+        uint64_t end_ns = now_ns();
+
+        // the windows of the run relative to its start, a rebuilding still going on ends with the run
+        std::vector<Span> spans;
+        {
+            std::lock_guard<std::mutex> l(spans_mtx_);
+            for(Span s : spans_) {
+                if(s.end_ns == 0) s.end_ns = end_ns;
+                if(s.end_ns < base_ns_ || s.start_ns > end_ns) continue;
+                spans.push_back({std::max(s.start_ns, base_ns_) - base_ns_, s.end_ns - base_ns_});
+            }
+        }
+
+        report(logs, spans, (end_ns - base_ns_) / 1e9);
+        if(!cfg_.series.empty()) dump(logs, spans);
+    }
+
+private:
+    void work(int t, SampleLog & log) {
+        pin_to_cpu(cpus_[t % cpus_.size()]);
+        std::mt19937_64 gen(t * 7919 + getRandom());
+        std::uniform_int_distribution<int> pct(0, 99);
+
+        int op_of[100]; // percentile => operation type
+        for(int op = 0, i = 0; op < I_OPS; op++)
+            for(int j = 0; j < cfg_.mix[op]; j++) op_of[i++] = op;
+
+        uint64_t base = __atomic_load_n(&base_ns_, __ATOMIC_ACQUIRE);
+        uint64_t interval = cfg_.rate > 0 ? (uint64_t)(1e9 / cfg_.rate) : 0;
+        for(uint64_t i = 0; !stop_.load(std::memory_order_relaxed); i++) {
+            int op = op_of[pct(gen)];
+            uint64_t id = std::uniform_int_distribution<uint64_t>(0, cfg_.records - 1)(gen); // a loaded record
+
+            uint64_t start;
+            if(interval > 0) { // due at a fixed time, however late the operations before it were
+                start = base + i * interval;
+                while(now_ns() < start) ;
+            } else {
+                start = now_ns();
+            }
+            switch(op) {
+                case I_READ: {
+                    tree_->lookup(key_of(id));
+                    break;
+                }
+                case I_INSERT: {
+                    uint64_t new_id = next_id_.fetch_add(1, std::memory_order_relaxed);
+                    tree_->insert(key_of(new_id), (uint64_t)key_of(new_id));
+                    break;
+                }
+                case I_UPDATE: {
+                    tree_->update(key_of(id), (uint64_t)key_of(id));
+                    break;
+                }
+            }
+            uint64_t latency = now_ns() - start;
+            log.add({start - base, (uint32_t)std::min(latency, (uint64_t)UINT32_MAX), (uint16_t)op, (uint16_t)t});
+        }
+    }
+
+    /* whether the operation of s overlaps a rebuild window, widened by the grace period */
+    inline bool inside(const Sample & s, const std::vector<Span> & spans) const {
+        uint64_t grace = cfg_.grace_ms * MILLION;
+        uint64_t end = s.start_ns + s.latency_ns;
+        // the last window that starts before the operation ends
+        auto it = std::upper_bound(spans.begin(), spans.end(), end + grace, [](uint64_t t, const Span & sp) { return t < sp.start_ns; });
+        return it != spans.begin() && (it - 1)->end_ns + grace >= s.start_ns;
+    }
+
+    void report(const std::vector<SampleLog> & logs, const std::vector<Span> & spans, double elapsed) {
+        Histogram hists[I_OPS + 1][2]; // [op or all][outside, inside]
+        for(const SampleLog & log : logs) {
+            for(size_t i = 0; i < log.size(); i++) {
+                const Sample & s = log[i];
+                int in = inside(s, spans) ? 1 : 0;
+                hists[s.op][in].record(s.latency_ns);
+                hists[I_OPS][in].record(s.latency_ns);
+            }
+        }
+
+        uint64_t total = hists[I_OPS][0].count() + hists[I_OPS][1].count();
+        uint64_t rebuild_ns = 0, longest = 0;
+        for(const Span & s : spans) {
+            rebuild_ns += s.end_ns - s.start_ns;
+            longest = std::max(longest, s.end_ns - s.start_ns);
+        }
+        printf("run: %lu ops in %.2f s, %.3f Mops\n", total, elapsed, total / elapsed / 1e6);
+        printf("rebuilds: %lu, %.3f ms on average, %.3f ms at most, %.2f%% of the run\n", spans.size(),
+            spans.empty() ? 0 : rebuild_ns / 1e6 / spans.size(), longest / 1e6, rebuild_ns / 1e7 / elapsed);
+        printf("%-8s %-8s %12s %9s %9s %9s %9s %9s %9s\n", "op", "window", "count", "avg(us)", "p50", "p99", "p99.9", "p99.99", "max");
+        for(int op = 0; op <= I_OPS; op++) {
+            for(int in = 0; in < 2; in++) {
+                const Histogram & h = hists[op][in];
+                if(h.count() == 0) continue;
+                printf("%-8s %-8s %12lu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", op < I_OPS ? OP_NAMES[op] : "all", in ? "rebuild" : "steady",
+                    h.count(), h.mean() / 1000, h.percentile(50) / 1000.0, h.percentile(99) / 1000.0,
+                    h.percentile(99.9) / 1000.0, h.percentile(99.99) / 1000.0, h.max() / 1000.0);
+            }
+        }
+    }
+
+    /* the time series: <series>.ops.csv with one line per operation, <series>.rebuilds.csv with
+       one line per rebuild window, both in microseconds since the start of the run */
+    void dump(const std::vector<SampleLog> & logs, const std::vector<Span> & spans) {
+        string ops_file = cfg_.series + ".ops.csv", rebuilds_file = cfg_.series + ".rebuilds.csv";
+        FILE * f = fopen(ops_file.c_str(), "w");
+        FILE * r = fopen(rebuilds_file.c_str(), "w");
+        if(f == NULL || r == NULL) {
+            printf("can not write the time series %s\n", cfg_.series.c_str());
+            exit(-1);
+        }
+        fprintf(f, "start_us,thread,op,latency_ns,rebuild\n");
+        for(const SampleLog & log : logs) {
+            for(size_t i = 0; i < log.size(); i++) {
+                const Sample & s = log[i];
+                fprintf(f, "%.3f,%u,%s,%u,%d\n", s.start_ns / 1e3, s.thread, OP_NAMES[s.op], s.latency_ns, inside(s, spans) ? 1 : 0);
+            }
+        }
+        fprintf(r, "start_us,end_us\n");
+        for(const Span & s : spans) fprintf(r, "%.3f,%.3f\n", s.start_ns / 1e3, s.end_ns / 1e3);
+        fclose(f);
+        fclose(r);
+        printf("time series written to %s and %s\n", ops_file.c_str(), rebuilds_file.c_str());
+    }
+};
+
+int main(int argc, char ** argv) {
+    Config cfg;
+
+    static const char * optstr = "n:t:d:r:i:u:q:g:f:o:h";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'n':
+            if(atol(optarg) > 0)
+                cfg.records = atol(optarg);
+            break;
+        case 't':
+            if(atoi(optarg) > 0)
+                cfg.threads = atoi(optarg);
+            break;
+        case 'd':
+            cfg.duration = atof(optarg);
+            break;
+        case 'r':
+            cfg.mix[I_READ] = atoi(optarg);
+            break;
+        case 'i':
+            cfg.mix[I_INSERT] = atoi(optarg);
+            break;
+        case 'u':
+            cfg.mix[I_UPDATE] = atoi(optarg);
+            break;
+        case 'q':
+            cfg.rate = atof(optarg);
+            break;
+        case 'g':
+            cfg.grace_ms = atof(optarg);
+            break;
+        case 'f':
+            cfg.pool = string(optarg);
+            break;
+        case 'o':
+            cfg.series = string(optarg);
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -n: " << "Number of records to load" << endl;
+            cout << "\t -t: " << "Number of threads, pinned to cores" << endl;
+            cout << "\t -d: " << "Seconds of the run" << endl;
+            cout << "\t -r: " << "Percentage of reads (Not specified: 50)" << endl;
+            cout << "\t -i: " << "Percentage of inserts of new keys (Not specified: 25)" << endl;
+            cout << "\t -u: " << "Percentage of updates (Not specified: 25)" << endl;
+            cout << "\t -q: " << "Operations per second of each thread, latencies count from the due time (Not specified: back to back)" << endl;
+            cout << "\t -g: " << "Milliseconds around a rebuild window that still count as inside it" << endl;
+            cout << "\t -f: " << "The pool file, recreated by each run" << endl;
+            cout << "\t -o: " << "Write the time series of the operations and the rebuild windows to <prefix>.ops.csv and <prefix>.rebuilds.csv" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    if(cfg.mix[I_READ] < 0 || cfg.mix[I_INSERT] < 0 || cfg.mix[I_UPDATE] < 0
+        || cfg.mix[I_READ] + cfg.mix[I_INSERT] + cfg.mix[I_UPDATE] != 100 || cfg.threads > UINT16_MAX) {
+        cout << "Invalid configuration, the percentages must sum to 100" << endl;
+        exit(-1);
+    }
+
+    Interfere bench(cfg);
+    double load_time = bench.load();
+    printf("load: %lu records in %.2f s, %.3f Mops\n", cfg.records, load_time, cfg.records / load_time / 1e6);
+    bench.run();
+
+    return 0;
+}
@@ -1,26 +1,150 @@
 #include <iostream>
-#include <fstream>
 #include <cstdint>
 #include <cstdlib>
 #include <vector>
 #include <random>
+#include <fstream>
 #include <algorithm>
+#include <memory>
 #include <omp.h>
 
 #include "tlbtree.h"
+#include "workload.h"
+#include "perf_counters.h"
+#include "baselines.h"
+#include "topology.h"
 
 using std::cout;
 using std::endl;
-using std::ifstream;
 using std::string;
 
+// the options of a run, the features of the tree only apply to TLBtree
+struct RunOptions {
+    const char * pool = "";                      // the pool file of the index, if any
+    const std::vector<_key_t> * dataset = NULL; // loaded before the run, for the indexes that preload does not populate
+    int thread_cnt = 1;
+    const std::vector<int> * cpus = NULL;       // the CPUs to pin the threads to, NULL to leave them unpinned
+    PerfCounters * pc = NULL;
+    size_t cache_size = 0;                      // bytes of the record cache, 0 to disable
+    bool filters = false;
+    size_t dram_size = 0;                       // bytes of the DRAM tier, 0 to disable
+    size_t pm_budget = 0;                       // bytes of PM before cold subtrees spill, 0 to disable
+    bool compress = false;
+    string trace;                               // prefix of the trace files, empty to disable
+    string stats;                               // file of the stats written after the run
+    string heatmap;                             // file of the heatmap written after the run
+};
+
+/* how run_test sets up and reports the features of an index, which the baselines and the shards
+   do not have */
 template<typename BtreeType>
-double run_test(std::vector<QueryType> querys, int thread_cnt) {
+struct TreeFeatures {
+    static void open(BtreeType &, const RunOptions &) {}
+    static void start_run(BtreeType &, const RunOptions &) {}
+    static void end_run(BtreeType &, const RunOptions &) {}
+    static bool rebuilding(BtreeType &) { return false; }
+};
+
+template<>
+struct TreeFeatures<TLBtree> {
+    static void open(TLBtree & tree, const RunOptions & opts) {
+        if(opts.cache_size > 0) tree.enable_cache(opts.cache_size);
+        if(opts.filters) tree.enable_filters();
+        if(opts.dram_size > 0) tree.enable_tiering("/dev/shm/tlbtree.dram", opts.dram_size);
+        if(opts.pm_budget > 0) tree.enable_spill("tlbtree.spill", opts.pm_budget);
+        if(opts.compress) tree.enable_compression();
+        if(!opts.heatmap.empty()) tree.enable_heatmap();
+    }
+
+    static void start_run(TLBtree & tree, const RunOptions & opts) { // after the load, the trace records the run only
+        if(!opts.trace.empty()) tree.enable_trace(opts.trace);
+    }
+
+    static void end_run(TLBtree & tree, const RunOptions & opts) {
+        if(opts.cache_size > 0) cout << "cache hit rate: " << tree.cache_hit_rate() << endl;
+        if(!opts.stats.empty() && !tree.export_stats(opts.stats)) cout << "can not write the stats to " << opts.stats << endl;
+        if(!opts.heatmap.empty() && !tree.dump_heatmap(opts.heatmap)) cout << "can not write the heatmap to " << opts.heatmap << endl;
+    }
+
+    static bool rebuilding(TLBtree & tree) { return tree.is_rebuilding(); }
+};
+
+template<typename BtreeType>
+inline size_t run_scan(BtreeType & tree, _key_t lo, _key_t hi, std::vector<Record> & out) {
+    out.clear();
+    tree.scan(lo, hi, out);
+    return out.size();
+}
+
+// the keys of datagen's dataset.dat, for the indexes that preload does not populate
+std::vector<_key_t> load_dataset(const string & fname) {
+    std::ifstream fin(fname.c_str(), std::ios::binary);
+    if(!fin) {
+        cout << "Dataset " << fname << " not exists or Open error" << endl;
+        exit(-1);
+    }
+    fin.seekg(0, std::ios::end);
+    std::vector<_key_t> keys(fin.tellg() / sizeof(_key_t));
+    fin.seekg(0, std::ios::beg);
+    fin.read((char *)keys.data(), sizeof(_key_t) * keys.size());
+    return keys;
+}
+
+template<typename BtreeType>
+double run_test(const WorkloadFile & workload, const RunOptions & opts) {
+    typedef TreeFeatures<BtreeType> Features;
+    PerfCounters * pc = opts.pc;
+    int thread_cnt = opts.thread_cnt;
+    const std::vector<int> * cpus = opts.cpus;
+    const std::vector<_key_t> * dataset = opts.dataset;
+
+    // the counters of the phases before the run
+    PerfCounters::sample_t phase_sample;
+    if(pc) phase_sample = pc->read();
+    double phase_start = seconds();
+    auto end_phase = [&](const char * phase, uint64_t ops) {
+        if(pc == NULL) return ;
+        PerfCounters::sample_t s = pc->read();
+        double now = seconds();
+        pc->account(phase, phase_sample, s, ops, now - phase_start);
+        phase_sample = s;
+        phase_start = now;
+    };
+
     // construct a Btree
-    BtreeType tree("/mnt/pmem/tlbtree.pool");
+    BtreeType tree(opts.pool);
+    Features::open(tree, opts);
+    end_phase("open", 0);
+
+    if(dataset != NULL) { // populate it the way preload does, untimed
+        double load_start = seconds();
+        #pragma omp parallel num_threads(thread_cnt)
+        {
+            if(cpus) pin_to_cpu((*cpus)[omp_get_thread_num() % cpus->size()]);
+            #pragma omp for schedule(static)
+            for(size_t i = 0; i < dataset->size(); i++)
+                tree.insert((*dataset)[i], (uint64_t)(*dataset)[i]);
+        }
+        cout << "load: " << seconds() - load_start << endl;
+        end_phase("load", dataset->size());
+    }
+    Features::start_run(tree, opts);
     
-    std::atomic_int cur_pos(0);
-    int small_noise = getRandom() & 0xff; // each time we run, we will insert different keys
+    // each time we run, we will insert different keys, but the reads of LATEST look the inserted keys up
+    bool latest = workload.header().dist == LATEST;
+    int small_noise = latest ? 0 : getRandom() & 0xff;
+    _key_t key_gap = workload.header().key_gap;
+
+    // the counters of the run are split at the rebuilds of the top layer
+    std::vector<OpCounter> counters(thread_cnt);
+    std::unique_ptr<RebuildWatch> watch;
+    if(pc) {
+        watch.reset(new RebuildWatch(*pc, "run", [&tree]() { return Features::rebuilding(tree); }, [&counters]() {
+            uint64_t ops = 0;
+            for(auto & c : counters) ops += c.ops.load(std::memory_order_relaxed);
+            return ops;
+        }));
+    }
     
     // set the timer
     #pragma omp barrier
@@ -29,18 +153,21 @@ double run_test(std::vector<QueryType> querys, int thread_cnt) {
     // start the section of parallel 
     #pragma omp parallel num_threads(thread_cnt)
     {
-        #pragma omp for schedule(static)
-        for (size_t i = 0; i < querys.size(); ++i) {
-            // get a unique query from querys
-            int obtain_pos = cur_pos.fetch_add(1, std::memory_order_relaxed);
-            OperationType op = querys[obtain_pos].op;
-            _key_t key = querys[obtain_pos].key;
+        if(cpus) pin_to_cpu((*cpus)[omp_get_thread_num() % cpus->size()]);
+        // each thread runs its own chunk of the mapped workload
+        size_t cnt;
+        const QueryType * querys = workload.chunk(omp_get_thread_num(), omp_get_num_threads(), cnt);
+        OpCounter & counter = counters[omp_get_thread_num()];
+        std::vector<Record> scanned;
+        for (size_t i = 0; i < cnt; ++i) {
+            OperationType op = querys[i].op;
+            _key_t key = querys[i].key;
             uint64_t val = (uint64_t)key;
 
             switch (op) {
                 case OperationType::READ: {
                     auto val = tree.lookup(key);
-                    assert(val != 0);
+                    assert(val != 0 || latest); // a LATEST read may run before another thread inserts its key
                     break;
                 }
                 case OperationType::INSERT: {
@@ -57,26 +184,42 @@ double run_test(std::vector<QueryType> querys, int thread_cnt) {
                     assert(r);
                     break;
                 }
+                case OperationType::SCAN: {
+                    _key_t span = key_gap * querys[i].len;
+                    run_scan(tree, key, key < MAX_KEY - span ? key + span : MAX_KEY, scanned);
+                    break;
+                }
                 default:
                     std::cout << "Error: unknown operation!" << std::endl;
                     exit(0);
                     break;
             }
+            if(pc) counter.add();
         }
     }
 
     #pragma omp barrier
     auto end = seconds();
+    watch.reset();
 
+    Features::end_run(tree, opts);
     return end - start;
 }
 
 
 int main(int argc, char ** argv) {
-    string opt_fname = "../build/workload.txt";
+    string opt_fname = "../build/workload.dat";
+    string opt_index = "tlbtree";
+    string opt_dataset = "../build/dataset.dat";
     int opt_num_thread = 1;
+    bool opt_max_set = false; // -t given, the top of a sweep
+    bool opt_counters = false;
+    bool opt_sweep = false;
+    string opt_pin;
+    string opt_numa;
+    RunOptions opts;
 
-    static const char * optstr = "f:t:h";
+    static const char * optstr = "f:t:i:l:c:bd:s:zpr:SP:N:x:H:h";
     opterr = 0;
     char opt;
     while((opt = getopt(argc, argv, optstr)) != -1) {
@@ -85,8 +228,52 @@ int main(int argc, char ** argv) {
             opt_fname = string(optarg);
             break;
         case 't':
-            if(atoi(optarg) > 0)
+            if(atoi(optarg) > 0) {
                 opt_num_thread = atoi(optarg);
+                opt_max_set = true;
+            }
+            break;
+        case 'i':
+            opt_index = string(optarg);
+            break;
+        case 'l':
+            opt_dataset = string(optarg);
+            break;
+        case 'c':
+            opts.cache_size = atol(optarg) * MILLION;
+            break;
+        case 'b':
+            opts.filters = true;
+            break;
+        case 'd':
+            opts.dram_size = atol(optarg) * MILLION;
+            break;
+        case 's':
+            opts.pm_budget = atol(optarg) * MILLION;
+            break;
+        case 'z':
+            opts.compress = true;
+            break;
+        case 'p':
+            opt_counters = true;
+            break;
+        case 'r':
+            opts.trace = string(optarg);
+            break;
+        case 'S':
+            opt_sweep = true;
+            break;
+        case 'P':
+            opt_pin = string(optarg);
+            break;
+        case 'N':
+            opt_numa = string(optarg);
+            break;
+        case 'x':
+            opts.stats = string(optarg);
+            break;
+        case 'H':
+            opts.heatmap = string(optarg);
             break;
         case '?':
         case 'h':
@@ -95,26 +282,106 @@ int main(int argc, char ** argv) {
             cout << "\t -h: " << "Print the USAGE" << endl;
             cout << "\t -f: " << "Filename of the workload" << endl;
             cout << "\t -t: " << "Number of Threads to excute the workload" << endl;
-            cout << "\t -i: " << "The index tree type" << endl;
+            cout << "\t -i: " << "The index tree type (tlbtree, sharded, or the baselines map, btree, wotree)" << endl;
+            cout << "\t -l: " << "Dataset loaded into a baseline before the workload, tlbtree and sharded use the pools of preload (preload <threads> <dataset> sharded for sharded)" << endl;
+            cout << "\t -c: " << "DRAM budget (MB) of the hot record cache, 0 to disable" << endl;
+            cout << "\t -b: " << "Keep a Bloom filter of the keys to answer absent keys early" << endl;
+            cout << "\t -d: " << "DRAM budget (MB) of the tier of read-hot subtrees, mapped from /dev/shm/tlbtree.dram, 0 to disable" << endl;
+            cout << "\t -s: " << "PM budget (MB) of the down layer, cold subtrees beyond it are spilled to ./tlbtree.spill, 0 to disable" << endl;
+            cout << "\t -z: " << "Pack cold subtrees into compressed blocks in PM" << endl;
+            cout << "\t -p: " << "Report the hardware performance counters per operation of the open, the run and the rebuilds" << endl;
+            cout << "\t -r: " << "Record a trace of the run into <prefix>.<thread> (tlbtree only), replay it with replay" << endl;
+            cout << "\t -S: " << "Sweep the thread counts 1, 2, 4, ... up to -t (Not specified: all the CPUs) and print the scaling curve" << endl;
+            cout << "\t -P: " << "Pin the threads to the CPUs: compact (fill a core, then a socket) or scatter (spread over the sockets and cores)" << endl;
+            cout << "\t -N: " << "NUMA policy of the DRAM of the run: local, interleave or a node id to bind to" << endl;
+            cout << "\t -x: " << "Write the stats of the tree after the run to the file, in the Prometheus text format (tlbtree only)" << endl;
+            cout << "\t -H: " << "Sample the accesses of each subtree during the run and write the heatmap of the key ranges to the file (tlbtree only)" << endl;
             exit(-1);
             break;
         }
     }
 
-    ifstream fin(opt_fname.c_str());
-    if(!fin) {
-        cout << "workload file not openned" << endl;
-        exit(-1);
+    // the policy applies to the pages touched from now on: the workload, the dataset and the DRAM of the index
+    if(!opt_numa.empty()) set_numa_policy(opt_numa);
+    std::vector<int> cpus;
+    if(!opt_pin.empty()) {
+        if(opt_pin != "compact" && opt_pin != "scatter") {
+            cout << "Unknown pinning " << opt_pin << ", compact or scatter" << endl;
+            exit(-1);
+        }
+        cpus = cpu_order(opt_pin == "scatter");
+    }
+
+    // open the counters before the OpenMP threads, which inherit them
+    std::unique_ptr<PerfCounters> pc(opt_counters ? new PerfCounters() : NULL);
+    if(pc && !pc->available()) pc.reset();
+
+    WorkloadFile workload(opt_fname.c_str());
+    std::vector<_key_t> dataset;
+    bool baseline = opt_index == "map" || opt_index == "btree" || opt_index == "wotree";
+    if(baseline) dataset = load_dataset(opt_dataset);
+
+    opts.cpus = cpus.empty() ? NULL : &cpus;
+    opts.pc = pc.get();
+    auto run = [&](int thread_cnt) {
+        RunOptions o = opts;
+        o.thread_cnt = thread_cnt;
+        if(opt_index == "sharded") {
+            o.pool = "/mnt/pmem/tlbtree.pool";
+            return run_test<ShardedTLBtree>(workload, o);
+        } else if(opt_index == "map") {
+            o.dataset = &dataset;
+            return run_test<LockedMap>(workload, o);
+        } else if(opt_index == "btree") {
+            o.dataset = &dataset;
+            return run_test<DramBtree>(workload, o);
+        } else if(opt_index == "wotree") {
+            o.pool = "/mnt/pmem/wotree.pool";
+            o.dataset = &dataset;
+            return run_test<WotreeOnly>(workload, o);
+        } else {
+            o.pool = "/mnt/pmem/tlbtree.pool";
+            return run_test<TLBtree>(workload, o);
+        }
+    };
+
+    if(!opt_sweep) {
+        cout << run(opt_num_thread) << endl;
+        if(pc) pc->report();
+#ifdef PHASE_TIMERS
+        PhaseTimers::report();
+#endif
+        return 0;
     }
-    std::vector<QueryType> querys;
-    int op;
-    _key_t key;
-    while(fin >> op >> key) {
-        querys.push_back({(OperationType)op, key});
+
+    /*
+        One run for each thread count on the same workload, split among more threads each time. A
+        baseline starts from the dataset in each run, TLBtree from its pool, which keeps the keys
+        inserted by the runs before as consecutive runs of main would.
+    */
+    int max_thread = opt_max_set ? opt_num_thread : (int)cpu_order(false).size();
+    std::vector<int> counts;
+    for(int t = 1; t < max_thread; t *= 2) counts.push_back(t);
+    counts.push_back(max_thread);
+
+    std::vector<double> times;
+    string trace_prefix = opts.trace;
+    for(int t : counts) {
+        if(!trace_prefix.empty()) opts.trace = trace_prefix + "_" + std::to_string(t); // a trace for each run
+        times.push_back(run(t));
+        cout << t << " threads: " << times.back() << endl;
     }
-    double time = run_test<TLBtree>(querys, opt_num_thread);
 
-    cout << time << endl;
+    printf("scaling of %s on %s, %s threads\n", opt_fname.c_str(), opt_index.c_str(), opt_pin.empty() ? "unpinned" : opt_pin.c_str());
+    printf("%8s %10s %10s %8s %10s\n", "threads", "time(s)", "Mops", "speedup", "efficiency");
+    for(size_t i = 0; i < counts.size(); i++) {
+        double speedup = times[0] / times[i];
+        printf("%8d %10.3f %10.3f %8.2f %9.1f%%\n", counts[i], times[i], workload.size() / times[i] / 1e6, speedup, speedup / counts[i] * 100);
+    }
+    if(pc) pc->report(); // summed over the sweep
+#ifdef PHASE_TIMERS
+    PhaseTimers::report();
+#endif
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tlbtree.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+/*
+    Microbenchmarks of the components of TLBtree, each one apart from the others:
+
+        fixtree.find, fixtree.insert    the top layer over N records
+        node.get_child, node.store,     single 256B nodes of the down layer
+        node.merge
+        state.read, state.add           decoding and encoding the packed state of a node
+        alloc.malloc                    PMAllocator::malloc of 256B blocks on T threads at once
+        flush.clwb, flush.sfence,       the persistence instructions on lines of the pool
+        flush.persist
+
+    A benchmark is run once to warm up and then -r times, each run reports the time per
+    operation without its setup. The output is one line per benchmark, so that the runs of two
+    builds can be diffed or kept for regression tracking:
+
+        benchmark   param   ops/run   median(ns)   min(ns)   max(ns)   spread(%)
+
+    where the spread is the median absolute deviation of the runs over their median.
+*/
+
+typedef ConcurrentPolicy Policy;
+typedef fixtree::Fixtree<Policy> Fixtree;
+typedef wotree256::Node<Policy> Node;
+typedef wotree256::state_t state_t;
+
+static const _key_t KEY_STEP = 1 << 20; // keys of the records are multiples of it, others fall in between
+static volatile uint64_t sink;          // keeps the results of the benchmarked calls alive
+
+struct Config {
+    int repeats = 5;
+    int max_threads = std::thread::hardware_concurrency();
+    string filter;
+    string pool = "/mnt/pmem/micro.pool";
+};
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void pin_thread(int id) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(id % std::thread::hardware_concurrency(), &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+}
+
+inline const char * flush_name() {
+#ifdef CLWB
+    return "clwb";
+#elif defined(CLFLUSHOPT)
+    return "clflushopt";
+#else
+    return "clflush";
+#endif
+}
+
+class Runner {
+    const Config & cfg_;
+
+public:
+    Runner(const Config & cfg): cfg_(cfg) {
+        printf("%-16s %-10s %10s %11s %10s %10s %10s\n", "benchmark", "param", "ops/run", "median(ns)", "min(ns)", "max(ns)", "spread(%)");
+    }
+
+    /* run(ops) returns the nanoseconds taken by ops operations, without its setup */
+    void bench(const string & name, const string & param, uint64_t ops, std::function<uint64_t(uint64_t)> run) {
+        if(cfg_.filter.size() > 0 && name.find(cfg_.filter) == string::npos) return ;
+
+        run(ops); // warm up
+        vector<double> per_op;
+        for(int i = 0; i < cfg_.repeats; i++)
+            per_op.push_back((double)run(ops) / ops);
+
+        std::sort(per_op.begin(), per_op.end());
+        double median = per_op[per_op.size() / 2];
+        vector<double> dev;
+        for(double t : per_op) dev.push_back(std::fabs(t - median));
+        std::sort(dev.begin(), dev.end());
+        double spread = median > 0 ? dev[dev.size() / 2] / median * 100 : 0;
+
+        printf("%-16s %-10s %10lu %11.2f %10.2f %10.2f %10.2f\n", name.c_str(), param.c_str(), ops, median,
+                per_op.front(), per_op.back(), spread);
+        fflush(stdout);
+    }
+};
+
+// records of the keys KEY_STEP * 1 .. KEY_STEP * n
+vector<Record> make_records(uint64_t n) {
+    vector<Record> recs(n);
+    for(uint64_t i = 0; i < n; i++)
+        recs[i] = Record(KEY_STEP * (i + 1), (char *)(KEY_STEP * (i + 1)));
+    return recs;
+}
+
+vector<_key_t> make_lookups(uint64_t n, uint64_t ops, bool existing) {
+    std::mt19937_64 gen(10007);
+    std::uniform_int_distribution<uint64_t> dist(1, n);
+    vector<_key_t> keys(ops);
+    for(auto & k : keys)
+        k = KEY_STEP * dist(gen) + (existing ? 0 : (_key_t)(gen() % (KEY_STEP - 1) + 1));
+    return keys;
+}
+
+string size_name(uint64_t n) {
+    char buf[32];
+    if(n >= MILLION) snprintf(buf, sizeof(buf), "%luM", n / MILLION);
+    else if(n >= KILO) snprintf(buf, sizeof(buf), "%luK", n / KILO);
+    else snprintf(buf, sizeof(buf), "%lu", n);
+    return buf;
+}
+
+void bench_fixtree(Runner & runner) {
+    static const uint64_t OPS = MILLION;
+    for(uint64_t n : {(uint64_t)KILO, (uint64_t)64 * KILO, (uint64_t)MILLION}) {
+        vector<Record> recs = make_records(n);
+
+        Fixtree * tree = new Fixtree(recs);
+        vector<_key_t> lookups = make_lookups(n, OPS, true);
+        runner.bench("fixtree.find", size_name(n), OPS, [&](uint64_t ops) {
+            uint64_t sum = 0, start = now_ns();
+            for(uint64_t i = 0; i < ops; i++)
+                sum += (uint64_t)*tree->find_lower(lookups[i]);
+            uint64_t end = now_ns();
+            sink = sum;
+            return end - start;
+        });
+        fixtree::free(tree);
+
+        // a rebuilt leaf keeps LEAF_CARD - LEAF_REBUILD_CARD empty slots
+        uint64_t inserts = std::min(OPS, (n / fixtree::LEAF_REBUILD_CARD) * (fixtree::LEAF_CARD - fixtree::LEAF_REBUILD_CARD) / 2);
+        vector<_key_t> fresh = make_lookups(n, inserts, false);
+        runner.bench("fixtree.insert", size_name(n), inserts, [&](uint64_t ops) {
+            Fixtree * t = new Fixtree(recs);
+            uint64_t done = 0, start = now_ns();
+            for(uint64_t i = 0; i < ops; i++)
+                done += t->insert(fresh[i], (uint64_t)fresh[i]);
+            uint64_t end = now_ns();
+            sink = done;
+            fixtree::free(t);
+            return end - start;
+        });
+    }
+}
+
+// a node of count records with keys KEY_STEP * 1 .. KEY_STEP * count, an inner node if inner
+Node * make_node(bool inner, int count, _key_t base = 0) {
+    Node * node = (Node *)galc->malloc<Policy>(sizeof(Node));
+    ::new (node) Node();
+    if(inner) node->leftmost_ptr_ = (char *)node; // never followed
+    for(int i = 0; i < count; i++) {
+        node->recs_[i] = Record(base + KEY_STEP * (i + 1), (char *)(base + KEY_STEP * (i + 1)));
+        node->state_.pack = node->state_.append(i, i);
+    }
+    return node;
+}
+
+void bench_node(Runner & runner) {
+    static const uint64_t OPS = MILLION;
+    static const int NODES = 4096; // more than the L1 cache holds
+    const int full = wotree256::CARDINALITY - 1;
+
+    for(bool inner : {false, true}) {
+        vector<Node *> nodes;
+        for(int i = 0; i < NODES; i++)
+            nodes.push_back(make_node(inner, full));
+        vector<_key_t> lookups = make_lookups(full, OPS, !inner);
+        std::mt19937 gen(10007);
+        vector<int> which(OPS);
+        for(auto & w : which) w = gen() % NODES;
+
+        runner.bench("node.get_child", inner ? "inner" : "leaf", OPS, [&](uint64_t ops) {
+            uint64_t sum = 0, start = now_ns();
+            for(uint64_t i = 0; i < ops; i++)
+                sum += (uint64_t)nodes[which[i]]->get_child(lookups[i]);
+            uint64_t end = now_ns();
+            sink = sum;
+            return end - start;
+        });
+    }
+
+    // fill empty leaves up to one record short of a split
+    vector<Node *> leaves;
+    for(int i = 0; i < NODES; i++)
+        leaves.push_back(make_node(false, 0));
+    vector<_key_t> keys = make_lookups(MILLION, NODES * full, true);
+    runner.bench("node.store", "leaf", NODES * full, [&](uint64_t ops) {
+        for(Node * n : leaves) ::new (n) Node();
+        _key_t split_k;
+        Node * split_node;
+        uint64_t start = now_ns();
+        for(uint64_t i = 0; i < ops; i++)
+            leaves[i / full]->store(keys[i], (uint64_t)keys[i], split_k, split_node);
+        return now_ns() - start;
+    });
+
+    // merge pairs of half-full leaves, the merged right ones are not reused
+    const int half = wotree256::CARDINALITY / 2;
+    runner.bench("node.merge", "leaf", NODES, [&](uint64_t ops) {
+        vector<std::pair<Node *, Node *>> pairs;
+        for(uint64_t i = 0; i < ops; i++) {
+            Node * left = make_node(false, half);
+            Node * right = make_node(false, half, KEY_STEP * half);
+            left->siblings_[left->state_.unpack.sibling_version] = {KEY_STEP * (half + 1), (char *)galc->relative(right)};
+            pairs.push_back({left, right});
+        }
+        uint64_t start = now_ns();
+        for(auto & p : pairs)
+            Node::merge(p.first, p.second);
+        return now_ns() - start;
+    });
+}
+
+void bench_state(Runner & runner) {
+    static const uint64_t OPS = 16 * MILLION;
+    static const int STATES = 1024;
+
+    vector<state_t> states(STATES);
+    std::mt19937 gen(10007);
+    for(auto & s : states) { // full states of shuffled slots
+        int8_t slots[wotree256::CARDINALITY];
+        for(int i = 0; i < wotree256::CARDINALITY; i++) slots[i] = i;
+        std::shuffle(slots, slots + wotree256::CARDINALITY, gen);
+        for(int i = 0; i < wotree256::CARDINALITY; i++)
+            s.pack = s.append(i, slots[i]);
+    }
+
+    runner.bench("state.read", "", OPS, [&](uint64_t ops) {
+        uint64_t sum = 0, start = now_ns();
+        for(uint64_t i = 0; i < ops; i++)
+            sum += states[i % STATES].read(i % wotree256::CARDINALITY);
+        uint64_t end = now_ns();
+        sink = sum;
+        return end - start;
+    });
+
+    runner.bench("state.add", "", OPS, [&](uint64_t ops) {
+        uint64_t sum = 0, start = now_ns();
+        state_t s(0);
+        for(uint64_t i = 0; i < ops; i++) {
+            int count = i % wotree256::CARDINALITY;
+            if(count == 0) s.pack = 0;
+            s.pack = s.add(i % (count + 1), count);
+            sum += s.pack;
+        }
+        uint64_t end = now_ns();
+        sink = sum;
+        return end - start;
+    });
+}
+
+void bench_alloc(Runner & runner, const Config & cfg) {
+    static const uint64_t OPS = 64 * KILO; // per thread
+    string path = cfg.pool + ".alloc";
+
+    for(int threads = 1; threads <= cfg.max_threads; threads *= 2) {
+        // each run allocates from a fresh pool, the time per malloc is that of each thread
+        runner.bench("alloc.malloc", std::to_string(threads) + "t", OPS, [&](uint64_t ops) {
+            unlink(path.c_str());
+            PMAllocator * alc = new PMAllocator(path.c_str(), false, "micro", (threads * ops * 256) * 2 + 64 * MILLION);
+            std::atomic<int> ready(0);
+            std::atomic<bool> go(false);
+            vector<std::thread> workers;
+            for(int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]() {
+                    pin_thread(t);
+                    galc = alc;
+                    ready.fetch_add(1);
+                    while(!go.load(std::memory_order_acquire)) ;
+                    uint64_t sum = 0;
+                    for(uint64_t i = 0; i < ops; i++)
+                        sum += (uint64_t)galc->malloc<Policy>(256);
+                    sink = sum;
+                });
+            }
+            while(ready.load() < threads) ;
+            uint64_t start = now_ns();
+            go.store(true, std::memory_order_release);
+            for(auto & w : workers) w.join();
+            uint64_t end = now_ns();
+            delete alc;
+            unlink(path.c_str());
+            return end - start;
+        });
+    }
+}
+
+void bench_flush(Runner & runner) {
+    static const uint64_t OPS = MILLION;
+    static const size_t LINES = 4096; // 256KB of the pool
+    char * buf = (char *)galc->malloc<Policy>(LINES * CACHE_LINE_SIZE);
+    memset(buf, 0, LINES * CACHE_LINE_SIZE);
+    clwb(buf, LINES * CACHE_LINE_SIZE);
+    mfence();
+
+    runner.bench("flush.clwb", flush_name(), OPS, [&](uint64_t ops) { // a dirty line, no fence
+        uint64_t start = now_ns();
+        for(uint64_t i = 0; i < ops; i++) {
+            char * line = buf + (i % LINES) * CACHE_LINE_SIZE;
+            *(volatile uint64_t *)line = i;
+            clwb(line, CACHE_LINE_SIZE);
+        }
+        mfence();
+        return now_ns() - start;
+    });
+
+    runner.bench("flush.sfence", "", OPS, [&](uint64_t ops) { // nothing to drain
+        uint64_t start = now_ns();
+        for(uint64_t i = 0; i < ops; i++)
+            mfence();
+        return now_ns() - start;
+    });
+
+    runner.bench("flush.persist", flush_name(), OPS, [&](uint64_t ops) { // a durable 8B store
+        uint64_t start = now_ns();
+        for(uint64_t i = 0; i < ops; i++) {
+            uint64_t * word = (uint64_t *)(buf + (i % LINES) * CACHE_LINE_SIZE);
+            persist_assign(word, i);
+            mfence();
+        }
+        return now_ns() - start;
+    });
+}
+
+int main(int argc, char ** argv) {
+    Config cfg;
+
+    static const char * optstr = "r:t:b:f:h";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'r':
+            if(atoi(optarg) > 0)
+                cfg.repeats = atoi(optarg);
+            break;
+        case 't':
+            if(atoi(optarg) > 0)
+                cfg.max_threads = atoi(optarg);
+            break;
+        case 'b':
+            cfg.filter = string(optarg);
+            break;
+        case 'f':
+            cfg.pool = string(optarg);
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -r: " << "Measured runs of each benchmark, after one warm-up run" << endl;
+            cout << "\t -t: " << "Maximum number of threads of alloc.malloc, doubled from 1" << endl;
+            cout << "\t -b: " << "Only run the benchmarks whose name contains this (e.g. fixtree, node.store)" << endl;
+            cout << "\t -f: " << "The pool file, recreated by each run" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    pin_thread(0);
+    unlink(cfg.pool.c_str());
+    galc = new PMAllocator(cfg.pool.c_str(), false, "micro", 2048UL * MILLION);
+
+    Runner runner(cfg);
+    bench_fixtree(runner);
+    bench_node(runner);
+    bench_state(runner);
+    bench_alloc(runner, cfg);
+    bench_flush(runner);
+
+    delete galc;
+    unlink(cfg.pool.c_str());
+    return 0;
+}
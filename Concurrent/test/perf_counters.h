@@ -0,0 +1,206 @@
+/*  perf_counters.h - Hardware performance counters of the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "common.h"
+
+/*
+    PerfCounters: counters of the process read through perf_event_open, in user mode only, so that
+    they work with the default perf_event_paranoid. An event the CPU (or the VM) does not count is
+    skipped, e.g. the stalled cycles are not counted by many Intel CPUs.
+
+    The counters inherit to the threads created after them, construct them before the worker
+    threads (an OpenMP pool is created at the first parallel region). The counts of a phase are
+    the differences of two read()s, added by account() to the phase with its number of operations,
+    and report() prints them per operation.
+*/
+class PerfCounters {
+public:
+    static const int MAX_EVENTS = 8;
+    typedef std::vector<double> sample_t;
+
+private:
+    struct event_t {
+        const char * name;
+        uint32_t type;
+        uint64_t config;
+    };
+
+    struct phase_t {
+        std::string name;
+        sample_t counts;
+        uint64_t ops;
+        double seconds;
+    };
+
+    static constexpr uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    int fds_[MAX_EVENTS];
+    std::vector<const event_t *> events_; // the opened ones
+    std::vector<phase_t> phases_;
+
+public:
+    PerfCounters() {
+        static const event_t EVENTS[] = {
+            {"task-clock(ns)", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"LLC-load-misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"dTLB-load-misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"stalled-cycles-backend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND}, // memory stalls mostly
+        };
+
+        for(const event_t & e : EVENTS) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = e.type;
+            attr.config = e.config;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if(fd < 0) {
+                printf("perf counter %s not available\n", e.name);
+                continue;
+            }
+            fds_[events_.size()] = fd;
+            events_.push_back(&e);
+        }
+    }
+
+    ~PerfCounters() {
+        for(size_t i = 0; i < events_.size(); i++)
+            close(fds_[i]);
+    }
+
+    inline bool available() const { return events_.size() > 0; }
+
+    /* the counts so far, scaled up if the events were multiplexed */
+    sample_t read() const {
+        sample_t s(events_.size(), 0);
+        for(size_t i = 0; i < events_.size(); i++) {
+            uint64_t v[3]; // value, time enabled, time running
+            if(::read(fds_[i], v, sizeof(v)) == sizeof(v) && v[2] > 0)
+                s[i] = (double)v[0] * v[1] / v[2];
+        }
+        return s;
+    }
+
+    /* add the counts from one read() to a later one, with ops operations and seconds, to phase */
+    void account(const std::string & phase, const sample_t & from, const sample_t & to, uint64_t ops, double seconds) {
+        phase_t * p = NULL;
+        for(phase_t & q : phases_)
+            if(q.name == phase) p = &q;
+        if(p == NULL) {
+            phases_.push_back({phase, sample_t(events_.size(), 0), 0, 0});
+            p = &phases_.back();
+        }
+        for(size_t i = 0; i < events_.size(); i++)
+            p->counts[i] += to[i] - from[i];
+        p->ops += ops;
+        p->seconds += seconds;
+    }
+
+    /* the counts of each phase per operation, or in total for a phase without operations */
+    void report() const {
+        if(!available() || phases_.empty()) return ;
+        printf("%-24s", "counters per op");
+        for(const phase_t & p : phases_) printf(" %14s", p.name.c_str());
+        printf("\n%-24s", "ops");
+        for(const phase_t & p : phases_) printf(" %14lu", p.ops);
+        printf("\n%-24s", "seconds");
+        for(const phase_t & p : phases_) printf(" %14.3f", p.seconds);
+        for(size_t i = 0; i < events_.size(); i++) {
+            printf("\n%-24s", events_[i]->name);
+            for(const phase_t & p : phases_) printf(" %14.2f", p.counts[i] / std::max((uint64_t)1, p.ops));
+        }
+        int cycles = index_of("cycles"), instructions = index_of("instructions");
+        if(cycles >= 0 && instructions >= 0) {
+            printf("\n%-24s", "IPC");
+            for(const phase_t & p : phases_) printf(" %14.2f", p.counts[cycles] > 0 ? p.counts[instructions] / p.counts[cycles] : 0);
+        }
+        printf("\n");
+    }
+
+private:
+    int index_of(const char * name) const {
+        for(size_t i = 0; i < events_.size(); i++)
+            if(strcmp(events_[i]->name, name) == 0) return i;
+        return -1;
+    }
+};
+
+// operations done by one thread, read by RebuildWatch
+struct alignas(CACHE_LINE_SIZE) OpCounter {
+    std::atomic<uint64_t> ops{0};
+
+    inline void add() { ops.store(ops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+};
+
+/*
+    RebuildWatch: splits the counts of a phase at the rebuilds of the top layer, the windows when
+    rebuilding() holds are added to the phase "rebuild" and the rest to the given phase. It polls
+    every POLL_US, and ops() returns the operations done so far by all the threads.
+*/
+class RebuildWatch {
+    static const int POLL_US = 1000;
+
+    std::atomic<bool> stop_;
+    std::thread thread_;
+
+public:
+    RebuildWatch(PerfCounters & pc, const std::string & phase, std::function<bool()> rebuilding,
+                    std::function<uint64_t()> ops): stop_(false) {
+        thread_ = std::thread([this, &pc, phase, rebuilding, ops]() {
+            bool in_rebuild = rebuilding();
+            PerfCounters::sample_t last = pc.read();
+            uint64_t last_ops = ops();
+            double last_time = seconds();
+            while(true) {
+                bool stop = stop_.load(std::memory_order_acquire);
+                bool now = rebuilding();
+                if(now != in_rebuild || stop) {
+                    PerfCounters::sample_t s = pc.read();
+                    uint64_t cur_ops = ops();
+                    double cur_time = seconds();
+                    pc.account(in_rebuild ? "rebuild" : phase, last, s, cur_ops - last_ops, cur_time - last_time);
+                    last = s;
+                    last_ops = cur_ops;
+                    last_time = cur_time;
+                    in_rebuild = now;
+                }
+                if(stop) break;
+                usleep(POLL_US);
+            }
+        });
+    }
+
+    /* account the last window, stop watching */
+    ~RebuildWatch() {
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+};
+
+#endif //__PERF_COUNTERS_H__
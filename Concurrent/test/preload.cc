@@ -36,21 +36,40 @@ int main(int argc, char ** argv) {
     }
     // open the data file
     std::string filename = "/home/lyp/TLBtree/Concurrent/build/dataset.dat";
+    if(argc > 2) {
+        filename = argv[2];
+    }
     std::ifstream fin(filename.c_str(), std::ios::binary);
     if(!fin) {
         cout << "File not exists or Open error\n";
         exit(-1);
     }
 
-    // read all the key into vector keys
-    keys = new _key_t[sizeof(_key_t) * LOADSCALE * MILLION];
-    fin.read((char *)keys, sizeof(_key_t) * LOADSCALE * MILLION);
+    // read all the key into vector keys, datagen -n sets the size of the dataset
+    fin.seekg(0, std::ios::end);
+    int64_t load_size = fin.tellg() / sizeof(_key_t);
+    fin.seekg(0, std::ios::beg);
+    keys = new _key_t[load_size];
+    fin.read((char *)keys, sizeof(_key_t) * load_size);
     
-    cout << "tlbtree" << endl;
-    TLBtree tree("/mnt/pmem/tlbtree.pool");
-    preload(tree, LOADSCALE * MILLION, fin, num_threads);
+    // the index to populate, main -i sharded opens the shard pools and the route file written here
+    std::string index = "tlbtree";
+    if(argc > 3) {
+        index = argv[3];
+    }
+    cout << index << endl;
+    if(index == "sharded") {
+        ShardedTLBtree tree("/mnt/pmem/tlbtree.pool");
+        preload(tree, load_size, fin, num_threads);
+    } else if(index == "tlbtree") {
+        TLBtree tree("/mnt/pmem/tlbtree.pool");
+        preload(tree, load_size, fin, num_threads);
+    } else {
+        cout << "Unknown index " << index << ", tlbtree or sharded" << endl;
+        exit(-1);
+    }
 
-    delete keys;
+    delete [] keys;
     fin.close();
 
     return 0;
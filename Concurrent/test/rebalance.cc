@@ -0,0 +1,155 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <unistd.h>
+
+#include "tlbtree.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+    Checks the sharded tree while the background rebalancer migrates key ranges between its shards.
+    Each client runs a skewed mix of inserts, updates, removes and reads on keys of its own (key %
+    clients), so it keeps a reference map of them that no other client touches, and checks every
+    read against it. When the clients are done, the tree is checked against the union of the maps:
+    each record must be found, and a scan of the whole key space, taken while no client runs, must
+    return each record once and no other key.
+*/
+
+struct Config {
+    uint64_t ops = 200000;      // operations of each client
+    int clients = 4;
+    int shards = 4;
+    uint64_t keys = 100000;     // distinct keys of each client
+    uint32_t rebalance_ms = 100;
+    string pool = "/mnt/pmem/rebalance";
+};
+
+typedef ShardedTLBtreeImpl<2, 2> Sharded;
+
+static void run_client(Sharded * tree, const Config & cfg, int id, std::map<_key_t, uint64_t> & ref, std::atomic<uint64_t> & wrong) {
+    std::mt19937_64 rng(id + 1);
+    for(uint64_t n = 0; n < cfg.ops; n++) {
+        // a third of the keys spread 16 times wider, so the low range is hot and its boundaries move
+        uint64_t k = rng() % cfg.keys;
+        _key_t key = (_key_t)((rng() % 3 == 0 ? k * 16 : k) * cfg.clients + id);
+        uint64_t val = n + 1;
+
+        int op = rng() % 10;
+        if(op < 6) {
+            if(ref.count(key)) tree->update(key, val); // an insert of a present key would add a duplicate
+            else tree->insert(key, val);
+            ref[key] = val;
+        } else if(op < 8) {
+            tree->remove(key);
+            ref.erase(key);
+        } else {
+            uint64_t v;
+            bool found = tree->find(key, v);
+            auto it = ref.find(key);
+            if(found != (it != ref.end()) || (found && v != it->second))
+                wrong.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    Config cfg;
+
+    static const char * optstr = "n:t:s:k:m:f:h";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'n':
+            if(atol(optarg) > 0)
+                cfg.ops = atol(optarg);
+            break;
+        case 't':
+            if(atoi(optarg) > 0)
+                cfg.clients = atoi(optarg);
+            break;
+        case 's':
+            if(atoi(optarg) > 1)
+                cfg.shards = atoi(optarg);
+            break;
+        case 'k':
+            if(atol(optarg) > 0)
+                cfg.keys = atol(optarg);
+            break;
+        case 'm':
+            cfg.rebalance_ms = atoi(optarg);
+            break;
+        case 'f':
+            cfg.pool = string(optarg);
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -n: " << "Number of operations of each client" << endl;
+            cout << "\t -t: " << "Number of client threads" << endl;
+            cout << "\t -s: " << "Number of shards, i.e. owner threads (at least 2)" << endl;
+            cout << "\t -k: " << "Number of distinct keys of each client, fewer keys empty the subtrees more often" << endl;
+            cout << "\t -m: " << "Milliseconds between the background rebalancings (Not specified: 100)" << endl;
+            cout << "\t -f: " << "Prefix of the pool files, recreated by each run" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    for(int i = 0; i < cfg.shards; i++)
+        std::remove((cfg.pool + "." + std::to_string(i)).c_str());
+    std::remove((cfg.pool + ".route").c_str());
+
+    Sharded * tree = new Sharded(cfg.pool, cfg.shards, false, POOL_SIZE, false, 0,
+                                    (_key_t)(cfg.keys * 16 * cfg.clients), cfg.rebalance_ms);
+
+    std::vector<std::map<_key_t, uint64_t>> refs(cfg.clients);
+    std::atomic<uint64_t> wrong(0);
+    std::vector<std::thread> clients;
+    double start = seconds();
+    for(int i = 0; i < cfg.clients; i++)
+        clients.emplace_back(run_client, tree, std::cref(cfg), i, std::ref(refs[i]), std::ref(wrong));
+    for(auto & t : clients) t.join();
+    double elapsed = seconds() - start;
+
+    std::map<_key_t, uint64_t> all;
+    for(auto & ref : refs) all.insert(ref.begin(), ref.end());
+
+    uint64_t missed = 0; // records the tree does not find, or with another value
+    for(auto & p : all) {
+        uint64_t v;
+        if(!tree->find(p.first, v) || v != p.second) missed++;
+    }
+
+    std::vector<Record> out;
+    tree->scan(MIN_KEY, MAX_KEY, out);
+    uint64_t extra = 0, lost = 0, dup = 0; // keys out of the maps, records out of the scan, and twice in it
+    std::map<_key_t, uint64_t> scanned;
+    for(auto & r : out) {
+        if(scanned.count(r.key)) dup++;
+        scanned[r.key] = (uint64_t)r.val;
+    }
+    for(auto & p : scanned) if(!all.count(p.first)) extra++;
+    for(auto & p : all) if(!scanned.count(p.first)) lost++;
+
+    printf("%lu operations by %d clients on %d shards in %.2f s, boundaries:", cfg.ops * cfg.clients, cfg.clients, cfg.shards, elapsed);
+    for(_key_t b : tree->boundaries()) printf(" %ld", (long)b);
+    printf("\nwrong reads %lu, missed records %lu; scan of %zu records: %lu extra, %lu lost, %lu duplicated (%zu expected)\n",
+                wrong.load(), missed, out.size(), extra, lost, dup, all.size());
+    delete tree;
+
+    bool ok = wrong.load() == 0 && missed == 0 && extra == 0 && lost == 0 && dup == 0;
+    printf("%s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+
+#include "tlbtree.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+    Replays a trace recorded by TLBtree::enable_trace (e.g. main -r) on a tree, one thread for each
+    trace file, so that each thread issues the operations of its file in their recorded order:
+
+        fast:   each thread issues its operations back to back
+        timed:  each operation is issued at its recorded time since the start of the replay, a
+                thread that falls behind issues the late ones at once
+
+    The trace keeps digests of the values, an insert or update writes the digest as the value. A
+    read is counted as diverged if it finds the key where the recorded one did not, or the other
+    way round. Replaying a trace of one thread on the tree it started from diverges nowhere, with
+    several threads only the order within each thread is kept.
+*/
+
+struct alignas(CACHE_LINE_SIZE) ReplayStats {
+    uint64_t ops = 0;
+    uint64_t diverged = 0;
+    uint64_t late_ns = 0;     // sum of the delays behind the recorded times
+    uint64_t max_late_ns = 0;
+};
+
+void replay(TLBtree & tree, const TraceFile & trace, bool timed, uint64_t base_ns, ReplayStats & stats) {
+    const TraceRecord * recs = trace.records();
+    std::vector<Record> out;
+    for(size_t i = 0; i < trace.size(); i++) {
+        const TraceRecord & r = recs[i];
+        if(timed) {
+            uint64_t target = base_ns + r.ts_ns, now = trace_clock();
+            while(now < target) {
+                if(target - now > 200000) usleep((target - now) / 1000 - 100); // sleep until about 100us before it
+                now = trace_clock();
+            }
+            uint64_t late = now - target;
+            stats.late_ns += late;
+            stats.max_late_ns = std::max(stats.max_late_ns, late);
+        }
+
+        uint64_t val = r.digest != 0 ? r.digest : (uint64_t)r.key; // 0 reads as absent
+        switch(r.op) {
+            case OperationType::READ: {
+                bool found = tree.lookup(r.key) != 0;
+                if(found != (r.digest != 0)) stats.diverged++;
+                break;
+            }
+            case OperationType::INSERT:
+                tree.insert(r.key, val);
+                break;
+            case OperationType::UPDATE:
+                tree.update(r.key, val);
+                break;
+            case OperationType::DELETE:
+                tree.remove(r.key);
+                break;
+            case OperationType::SCAN:
+                out.clear();
+                tree.scan(r.key, (_key_t)r.digest, out);
+                break;
+            default:
+                cout << "Error: unknown operation in the trace!" << endl;
+                exit(-1);
+        }
+        stats.ops++;
+    }
+}
+
+int main(int argc, char ** argv) {
+    string opt_trace = "trace";
+    string opt_pool = "/mnt/pmem/tlbtree.pool";
+    bool opt_timed = false;
+    size_t opt_cache_mb = 0;
+    bool opt_filters = false;
+
+    static const char * optstr = "f:m:p:c:bh";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'f':
+            opt_trace = string(optarg);
+            break;
+        case 'm':
+            opt_timed = string(optarg) == "timed";
+            break;
+        case 'p':
+            opt_pool = string(optarg);
+            break;
+        case 'c':
+            opt_cache_mb = atol(optarg);
+            break;
+        case 'b':
+            opt_filters = true;
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -f: " << "Prefix of the trace files <prefix>.0, <prefix>.1, ..." << endl;
+            cout << "\t -m: " << "Replay mode: fast, or timed to keep the recorded timing (Not specified: fast)" << endl;
+            cout << "\t -p: " << "The pool file of the tree to replay on" << endl;
+            cout << "\t -c: " << "DRAM budget (MB) of the hot record cache, 0 to disable" << endl;
+            cout << "\t -b: " << "Keep a Bloom filter of the keys to answer absent keys early" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    std::vector<TraceFile *> traces;
+    uint64_t total = 0;
+    for(int t = 0; file_exist((opt_trace + "." + std::to_string(t)).c_str()); t++) {
+        traces.push_back(new TraceFile((opt_trace + "." + std::to_string(t)).c_str()));
+        total += traces.back()->size();
+    }
+    if(traces.empty()) {
+        cout << "No trace file " << opt_trace << ".0" << endl;
+        exit(-1);
+    }
+    printf("%lu operations of %lu threads\n", total, traces.size());
+
+    TLBtree tree(opt_pool);
+    if(opt_cache_mb > 0) tree.enable_cache(opt_cache_mb * MILLION);
+    if(opt_filters) tree.enable_filters();
+
+    std::vector<ReplayStats> stats(traces.size());
+    std::vector<std::thread> threads;
+    std::atomic<int> ready(0);
+    uint64_t base_ns = 0;
+    std::atomic<bool> go(false);
+    for(size_t t = 0; t < traces.size(); t++) {
+        threads.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while(!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            replay(tree, *traces[t], opt_timed, base_ns, stats[t]);
+        });
+    }
+    while(ready.load() < (int)traces.size()) std::this_thread::yield();
+    double start = seconds();
+    base_ns = trace_clock();
+    go.store(true, std::memory_order_release);
+    for(auto & t : threads) t.join();
+    double elapsed = seconds() - start;
+
+    ReplayStats sum;
+    for(auto & s : stats) {
+        sum.ops += s.ops;
+        sum.diverged += s.diverged;
+        sum.late_ns += s.late_ns;
+        sum.max_late_ns = std::max(sum.max_late_ns, s.max_late_ns);
+    }
+    printf("replayed %lu ops in %.3f s, %.3f Mops\n", sum.ops, elapsed, sum.ops / elapsed / 1e6);
+    printf("%lu reads diverged from the trace\n", sum.diverged);
+    if(opt_timed)
+        printf("behind the recorded times: %.2f us on average, %.2f us at most\n", (double)sum.late_ns / std::max(sum.ops, (uint64_t)1) / 1000, sum.max_late_ns / 1000.0);
+
+    for(TraceFile * t : traces) delete t;
+    return 0;
+}
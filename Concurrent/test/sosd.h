@@ -0,0 +1,75 @@
+/*  sosd.h - Loader of SOSD key files for the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __SOSD_H__
+#define __SOSD_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+/*
+    A key file of the SOSD benchmark (e.g. books_200M_uint64, fb_200M_uint64, osm_cellids_200M_uint64,
+    wiki_ts_200M_uint64) is the count of the keys as an uint64 followed by the keys, as uint64 or
+    uint32, which the size of the file tells apart:
+
+        | count (8B) | key[count] |
+
+    load_sosd returns the keys sorted and without duplicates. Keys that are not valid keys of the
+    tree (0, whose value reads as absent, and MAX_KEY or more, the sentinel) are dropped.
+*/
+inline std::vector<_key_t> load_sosd(const char * path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(uint64_t)) {
+        printf("key file %s not openned\n", path);
+        exit(-1);
+    }
+    char * map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+        printf("key file %s not openned\n", path);
+        exit(-1);
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    uint64_t cnt = *(uint64_t *)map;
+    size_t width = cnt == 0 ? 0 : (st.st_size - sizeof(uint64_t)) / cnt;
+    if(cnt == 0 || (width != sizeof(uint64_t) && width != sizeof(uint32_t)) || sizeof(uint64_t) + cnt * width != (uint64_t)st.st_size) {
+        printf("%s is not a SOSD key file\n", path);
+        exit(-1);
+    }
+
+    std::vector<_key_t> keys;
+    keys.reserve(cnt);
+    uint64_t dropped = 0;
+    for(uint64_t i = 0; i < cnt; i++) {
+        uint64_t k = width == sizeof(uint64_t) ? ((uint64_t *)(map + sizeof(uint64_t)))[i]
+                                                : ((uint32_t *)(map + sizeof(uint64_t)))[i];
+        if(k == 0 || k >= (uint64_t)MAX_KEY) {
+            dropped++;
+            continue;
+        }
+        keys.push_back((_key_t)k);
+    }
+    munmap(map, st.st_size);
+    close(fd);
+
+    if(!std::is_sorted(keys.begin(), keys.end())) std::sort(keys.begin(), keys.end());
+    size_t loaded = keys.size();
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    printf("%lu keys of %lu bits from %s, %lu duplicates and %lu invalid dropped\n", keys.size(), width * 8,
+            path, loaded - keys.size(), dropped);
+    return keys;
+}
+
+#endif //__SOSD_H__
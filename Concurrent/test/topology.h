@@ -0,0 +1,125 @@
+/*  topology.h - CPU placement and NUMA memory policy of the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __TOPOLOGY_H__
+#define __TOPOLOGY_H__
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+/*
+    The CPUs this process may run on, in the order the threads of a run are pinned to them:
+
+        compact:    the CPUs of a core next to each other, the cores of a socket next to each
+                    other, so that n threads share as few cores and sockets as they can
+        scatter:    one CPU of each core before the second CPU of any core, and the sockets taken
+                    in turn, so that n threads spread over as many sockets and cores as they can
+
+    The sockets and cores are read from /sys, a CPU without them counts as a core of socket 0.
+*/
+inline std::vector<int> cpu_order(bool scatter) {
+    struct cpu_t {
+        int cpu, socket, core, smt; // smt: the rank of the CPU within its core
+    };
+
+    auto read_int = [](int cpu, const char * name) {
+        std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name;
+        FILE * f = fopen(path.c_str(), "r");
+        int v = -1;
+        if(f != NULL) {
+            if(fscanf(f, "%d", &v) != 1) v = -1;
+            fclose(f);
+        }
+        return v;
+    };
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    std::vector<cpu_t> cpus;
+    for(int c = 0; c < CPU_SETSIZE; c++) {
+        if(!CPU_ISSET(c, &allowed)) continue;
+        int socket = read_int(c, "physical_package_id"), core = read_int(c, "core_id");
+        cpus.push_back({c, std::max(socket, 0), core < 0 ? c : core, 0});
+    }
+    for(cpu_t & a : cpus) // CPUs are listed in increasing order, count the siblings before it
+        for(const cpu_t & b : cpus)
+            if(b.cpu < a.cpu && b.socket == a.socket && b.core == a.core) a.smt++;
+
+    if(scatter) {
+        // rank the cores of each socket, then take (smt, core rank) level by level across the sockets
+        std::vector<int> rank(cpus.size());
+        for(size_t i = 0; i < cpus.size(); i++)
+            for(size_t j = 0; j < cpus.size(); j++)
+                if(cpus[j].socket == cpus[i].socket && cpus[j].smt == 0 && cpus[j].core < cpus[i].core) rank[i]++;
+        std::vector<size_t> idx(cpus.size());
+        for(size_t i = 0; i < idx.size(); i++) idx[i] = i;
+        std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) {
+            if(cpus[a].smt != cpus[b].smt) return cpus[a].smt < cpus[b].smt;
+            if(rank[a] != rank[b]) return rank[a] < rank[b];
+            return cpus[a].socket < cpus[b].socket;
+        });
+        std::vector<int> order;
+        for(size_t i : idx) order.push_back(cpus[i].cpu);
+        return order;
+    }
+
+    std::sort(cpus.begin(), cpus.end(), [](const cpu_t & a, const cpu_t & b) {
+        if(a.socket != b.socket) return a.socket < b.socket;
+        if(a.core != b.core) return a.core < b.core;
+        return a.smt < b.smt;
+    });
+    std::vector<int> order;
+    for(const cpu_t & c : cpus) order.push_back(c.cpu);
+    return order;
+}
+
+inline void pin_to_cpu(int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    sched_setaffinity(0, sizeof(cpu_set_t), &cpuset); // the calling thread
+}
+
+/*
+    Set the NUMA policy of the memory the process allocates from now on, which also places the page
+    cache of the files it maps (e.g. the workload): "local" (allocate on the node of the CPU that
+    first touches the page), "interleave" (round-robin over all the nodes) or a node id (bind to
+    it). The pool is placed by its file, a pool on a DAX file system lives on the node of its device.
+*/
+inline void set_numa_policy(const std::string & policy) {
+    unsigned long mask = 0;
+    int mode;
+    if(policy == "local") {
+        mode = MPOL_DEFAULT;
+    } else if(policy == "interleave") {
+        unsigned long nodes = 0;
+        for(int n = 0; n < (int)sizeof(mask) * 8; n++)
+            if(access(("/sys/devices/system/node/node" + std::to_string(n)).c_str(), F_OK) == 0) nodes |= 1UL << n;
+        mask = nodes == 0 ? 1 : nodes;
+        mode = MPOL_INTERLEAVE;
+    } else {
+        int node = atoi(policy.c_str());
+        if(node < 0 || node >= (int)sizeof(mask) * 8 || access(("/sys/devices/system/node/node" + std::to_string(node)).c_str(), F_OK) != 0) {
+            printf("no NUMA node %s\n", policy.c_str());
+            exit(-1);
+        }
+        mask = 1UL << node;
+        mode = MPOL_BIND;
+    }
+    if(syscall(SYS_set_mempolicy, mode, mode == MPOL_DEFAULT ? NULL : &mask, mode == MPOL_DEFAULT ? 0 : sizeof(mask) * 8 + 1) != 0) {
+        printf("can not set the NUMA policy %s\n", policy.c_str());
+        exit(-1);
+    }
+}
+
+#endif //__TOPOLOGY_H__
@@ -0,0 +1,129 @@
+/*  workload.h - The binary workload file of the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+enum DistributionType {RAND = 0, ZIPFIAN, LATEST, HOTSPOT, SEQUENTIAL, SCRAMBLED};
+
+enum ScanLengthType {SCAN_UNIFORM = 0, SCAN_ZIPFIAN, SCAN_FIXED};
+
+/*
+    A workload file is a header followed by the queries as they are laid out in memory, so that
+    a driver maps the file and hands each thread a chunk of the array, without parsing or copying:
+
+        | WorkloadHeader (128B) | QueryType[count] |
+
+    A SCAN of len records covers the keys [key, key + len * key_gap).
+*/
+struct WorkloadHeader {
+    static const uint64_t MAGIC = 0x444c4b5754424c54ULL; // "TLBTWKLD"
+    static const uint32_t VERSION = 2;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t dist;          // DistributionType of the keys
+    uint64_t count;         // of the queries
+    uint64_t seed;          // of the generator
+    float read, insert, update, remove, scan; // ratios of the operations
+    float skewness;         // of a zipfian distribution
+    float hot_set, hot_ops; // of a hotspot distribution
+    uint32_t query_size;    // sizeof(QueryType) of the writer
+    uint32_t scan_dist;     // ScanLengthType
+    uint32_t max_scan;
+    uint32_t padding0;
+    uint64_t scale;         // keys of the dataset
+    uint64_t key_gap;       // between two adjacent keys of the dataset
+    char padding[32];
+};
+static_assert(sizeof(WorkloadHeader) == 128, "the queries follow a 128B header");
+
+class WorkloadFile {
+    int fd_;
+    char * map_;
+    size_t size_;
+    const WorkloadHeader * header_;
+    const QueryType * querys_;
+
+public:
+    WorkloadFile(const char * path) {
+        fd_ = open(path, O_RDONLY);
+        struct stat st;
+        if(fd_ < 0 || fstat(fd_, &st) != 0) {
+            printf("workload file %s not openned\n", path);
+            exit(-1);
+        }
+        size_ = st.st_size;
+
+        map_ = size_ < sizeof(WorkloadHeader) ? (char *)MAP_FAILED : (char *)mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        header_ = (const WorkloadHeader *)map_;
+        if(map_ == MAP_FAILED || header_->magic != WorkloadHeader::MAGIC || header_->version != WorkloadHeader::VERSION
+            || header_->query_size != sizeof(QueryType) || size_ < sizeof(WorkloadHeader) + header_->count * sizeof(QueryType)) {
+            printf("%s is not a workload file of this version, generate it again with datagen\n", path);
+            exit(-1);
+        }
+        querys_ = (const QueryType *)(header_ + 1);
+        madvise(map_, size_, MADV_SEQUENTIAL); // each thread reads its chunk in order
+    }
+
+    ~WorkloadFile() {
+        munmap(map_, size_);
+        close(fd_);
+    }
+
+    inline const WorkloadHeader & header() const { return *header_; }
+
+    inline size_t size() const { return header_->count; }
+
+    inline const QueryType * querys() const { return querys_; }
+
+    /* the queries of thread t of thread_cnt, in contiguous chunks whose sizes differ by one at most */
+    const QueryType * chunk(int t, int thread_cnt, size_t & cnt) const {
+        size_t base = header_->count / thread_cnt, extra = header_->count % thread_cnt;
+        size_t begin = t * base + std::min((size_t)t, extra);
+        cnt = base + ((size_t)t < extra ? 1 : 0);
+        return querys_ + begin;
+    }
+
+    /* create the file of header.count queries and map it, the writer fills the queries and
+       hands them to finish() */
+    static QueryType * create(const char * path, const WorkloadHeader & header) {
+        size_t size = sizeof(WorkloadHeader) + header.count * sizeof(QueryType);
+        int fd = open(path, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        char * map = fd < 0 || ftruncate(fd, size) != 0 ? (char *)MAP_FAILED
+                        : (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED) {
+            printf("can not write the workload file %s\n", path);
+            exit(-1);
+        }
+        close(fd); // the mapping keeps the file
+        memcpy(map, &header, sizeof(WorkloadHeader));
+        return (QueryType *)(map + sizeof(WorkloadHeader));
+    }
+
+    static void finish(QueryType * querys, uint64_t count) {
+        char * map = (char *)querys - sizeof(WorkloadHeader);
+        size_t size = sizeof(WorkloadHeader) + count * sizeof(QueryType);
+        if(msync(map, size, MS_SYNC) != 0) {
+            printf("can not write the workload file\n");
+            exit(-1);
+        }
+        munmap(map, size);
+    }
+};
+
+#endif //__WORKLOAD_H__
@@ -0,0 +1,443 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tlbtree.h"
+#include "zipfian.h"
+#include "histogram.h"
+#include "perf_counters.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+    A YCSB-style driver: load a number of records with pinned worker threads, then run one of the
+    core workloads for a warm-up period and a measured period:
+
+        A: 50% read, 50% update                     zipfian
+        B: 95% read, 5% update                      zipfian
+        C: 100% read                                zipfian
+        D: 95% read, 5% insert                      latest
+        E: 95% scan of 1 to 100 records, 5% insert  zipfian
+        F: 50% read, 50% read-modify-write          zipfian
+
+    Only the measured period is recorded: a latency histogram per operation type, and the
+    throughput of each report window. Values longer than 8 bytes are kept out of the tree in
+    per-thread arenas, and the tree indexes their addresses.
+*/
+
+enum YcsbOp {Y_READ = 0, Y_UPDATE, Y_INSERT, Y_SCAN, Y_RMW, Y_OPS};
+static const char * OP_NAMES[Y_OPS] = {"read", "update", "insert", "scan", "rmw"};
+
+enum Phase {WARMUP = 0, MEASURE, DONE};
+
+struct WorkloadSpec {
+    char name;
+    int mix[Y_OPS]; // percentages of each operation type
+    bool latest;    // reads prefer the latest inserted records
+};
+
+static const WorkloadSpec WORKLOADS[] = {
+    {'a', {50, 50, 0, 0, 0}, false},
+    {'b', {95, 5, 0, 0, 0}, false},
+    {'c', {100, 0, 0, 0, 0}, false},
+    {'d', {95, 0, 5, 0, 0}, true},
+    {'e', {0, 0, 5, 95, 0}, false},
+    {'f', {50, 0, 0, 0, 50}, false},
+};
+
+static const int MAX_SCAN = 100;
+
+struct Config {
+    WorkloadSpec w;
+    uint64_t records = MILLION;
+    int threads = 1;
+    int value_size = 8;
+    double theta = 0.99;
+    double warmup = 2;    // seconds
+    double duration = 10; // seconds
+    int window_ms = 1000;
+    string pool = "/mnt/pmem/ycsb.pool";
+    bool counters = false; // report the hardware performance counters
+};
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void pin_thread(int id) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(id % std::thread::hardware_concurrency(), &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+}
+
+// record ids are scattered over the key space, so that the hot records are not neighbours
+inline _key_t key_of(uint64_t id) {
+    return (_key_t)(((id + 1) * 0x9E3779B97F4A7C15ULL) & (uint64_t)MAX_KEY);
+}
+
+// values longer than 8 bytes, allocated by one thread and never freed during the run
+class ValueArena {
+    static const size_t CHUNK = 64 * MILLION;
+    std::vector<char *> chunks_;
+    size_t used_ = CHUNK;
+    int size_;
+
+public:
+    ValueArena(int size): size_(size) {}
+
+    ~ValueArena() {
+        for(char * c : chunks_) free(c);
+    }
+
+    char * alloc() {
+        if(used_ + size_ > CHUNK) {
+            chunks_.push_back((char *)malloc(CHUNK));
+            used_ = 0;
+        }
+        char * v = chunks_.back() + used_;
+        used_ += size_;
+        return v;
+    }
+};
+
+// the ids below limit() are all inserted, like the AcknowledgedCounterGenerator of YCSB: the reads of
+// the latest records never look up a key whose insert has not finished yet
+class AckedIds {
+    static const uint64_t WINDOW = 1 << 16; // ids in flight at most, one per thread
+    std::atomic<uint64_t> limit_;
+    std::unique_ptr<std::atomic<bool>[]> acked_; // acked_[id % WINDOW] for the ids from limit_ on
+    std::mutex mtx_;
+
+public:
+    AckedIds(uint64_t start): limit_(start), acked_(new std::atomic<bool>[WINDOW]) {
+        for(uint64_t i = 0; i < WINDOW; i++) acked_[i].store(false, std::memory_order_relaxed);
+    }
+
+    inline uint64_t limit() const { return limit_.load(std::memory_order_acquire); }
+
+    void ack(uint64_t id) {
+        acked_[id % WINDOW].store(true, std::memory_order_release);
+        if(!mtx_.try_lock()) return; // the holder moves the limit, a later ack picks up what it misses
+        uint64_t cur = limit_.load(std::memory_order_relaxed);
+        while(acked_[cur % WINDOW].load(std::memory_order_acquire)) {
+            acked_[cur % WINDOW].store(false, std::memory_order_relaxed);
+            cur++;
+        }
+        limit_.store(cur, std::memory_order_release);
+        mtx_.unlock();
+    }
+};
+
+struct alignas(CACHE_LINE_SIZE) Worker {
+    std::atomic<uint64_t> ops;   // operations of the warm-up and the measurement, sampled by the report windows
+    uint64_t notfound = 0;
+    uint64_t scanned = 0;
+    Histogram hists[Y_OPS];
+};
+
+class Ycsb {
+    Config cfg_;
+    TLBtree * tree_;
+    std::atomic<uint64_t> next_id_;    // ids of the records to insert next
+    AckedIds acked_;                   // ids of the records inserted
+    std::atomic<int> phase_;
+    zipfian_int_distribution<int64_t>::param_type zipf_;
+    std::vector<ValueArena *> arenas_;
+    std::unique_ptr<PerfCounters> pc_; // NULL unless counted
+
+public:
+    Ycsb(const Config & cfg): cfg_(cfg), next_id_(cfg.records), acked_(cfg.records), phase_(WARMUP),
+            zipf_(0, cfg.records - 1, cfg.theta) {
+        if(cfg_.counters) { // before the threads, which inherit the counters
+            pc_.reset(new PerfCounters());
+            if(!pc_->available()) pc_.reset();
+        }
+        remove(cfg_.pool.c_str()); // a fresh tree each run
+        uint64_t pool_size = std::max(POOL_SIZE, cfg_.records * 256);
+        tree_ = new TLBtree(cfg_.pool, pool_size);
+        for(int t = 0; t < cfg_.threads; t++)
+            arenas_.push_back(new ValueArena(cfg_.value_size));
+    }
+
+    ~Ycsb() {
+        delete tree_;
+        for(ValueArena * a : arenas_) delete a;
+    }
+
+    double load() {
+        std::vector<std::thread> loaders;
+        std::vector<OpCounter> counters(cfg_.threads);
+        uint64_t chunk = (cfg_.records + cfg_.threads - 1) / cfg_.threads;
+        watch("load", counters);
+        double start = seconds();
+        for(int t = 0; t < cfg_.threads; t++) {
+            loaders.emplace_back([this, t, chunk, &counters]() {
+                pin_thread(t);
+                uint64_t end = std::min(cfg_.records, chunk * (t + 1));
+                for(uint64_t id = chunk * t; id < end; id++) {
+                    tree_->insert(key_of(id), make_value(t, id));
+                    if(pc_) counters[t].add();
+                }
+            });
+        }
+        for(auto & l : loaders) l.join();
+        double elapsed = seconds() - start;
+        watch_.reset();
+        return elapsed;
+    }
+
+    void run() {
+        std::vector<Worker> workers(cfg_.threads);
+        std::vector<std::thread> threads;
+        for(int t = 0; t < cfg_.threads; t++) {
+            workers[t].ops.store(0);
+            threads.emplace_back(&Ycsb::work, this, t, std::ref(workers[t]));
+        }
+
+        watch("warmup", workers);
+        usleep(cfg_.warmup * 1e6);
+        phase_.store(MEASURE);
+        watch("run", workers);
+        double start = seconds(), last = start;
+        uint64_t last_ops = 0;
+        for(auto & w : workers) last_ops += w.ops.load(std::memory_order_relaxed);
+        int window = 0;
+        while(last - start < cfg_.duration) {
+            usleep(cfg_.window_ms * 1000);
+            double now = seconds();
+            uint64_t ops = 0;
+            for(auto & w : workers) ops += w.ops.load(std::memory_order_relaxed);
+            printf("window %3d: %8.3f Mops\n", ++window, (ops - last_ops) / (now - last) / 1e6);
+            last = now;
+            last_ops = ops;
+        }
+        phase_.store(DONE);
+        for(auto & t : threads) t.join();
+        double elapsed = seconds() - start;
+        watch_.reset();
+
+        report(workers, elapsed);
+        if(pc_) pc_->report();
+    }
+
+private:
+    std::unique_ptr<RebuildWatch> watch_;
+
+    /* count the following operations of the threads into phase, and into "rebuild" while the top
+       layer is being rebuilt, until the next phase */
+    template<typename Counter>
+    void watch(const char * phase, std::vector<Counter> & counters) {
+        if(!pc_) return ;
+        watch_.reset(); // accounts the last window of the previous phase
+        watch_.reset(new RebuildWatch(*pc_, phase, [this]() { return tree_->is_rebuilding(); }, [&counters]() {
+            uint64_t ops = 0;
+            for(auto & c : counters) ops += c.ops.load(std::memory_order_relaxed);
+            return ops;
+        }));
+    }
+
+    inline uint64_t make_value(int t, uint64_t id) {
+        if(cfg_.value_size <= 8) return (uint64_t)key_of(id);
+        char * v = arenas_[t]->alloc();
+        memset(v, (int)id, cfg_.value_size);
+        return (uint64_t)v;
+    }
+
+    inline void read_value(uint64_t val, char * buf) {
+        if(cfg_.value_size > 8) memcpy(buf, (const char *)val, cfg_.value_size);
+    }
+
+    void work(int t, Worker & w) {
+        pin_thread(t);
+        std::mt19937_64 gen(t * 7919 + getRandom());
+        std::uniform_int_distribution<int> pct(0, 99);
+        std::uniform_int_distribution<int> scan_len(1, MAX_SCAN);
+        zipfian_int_distribution<int64_t> zipf(zipf_);
+
+        int op_of[100]; // percentile => operation type
+        for(int op = 0, i = 0; op < Y_OPS; op++)
+            for(int j = 0; j < cfg_.w.mix[op]; j++) op_of[i++] = op;
+
+        char * buf = new char[std::max(cfg_.value_size, 8)];
+        std::vector<Record> out;
+        out.reserve(MAX_SCAN * 2);
+
+        while(true) {
+            int phase = phase_.load(std::memory_order_relaxed);
+            if(phase == DONE) break;
+
+            int op = op_of[pct(gen)];
+            uint64_t id;
+            if(cfg_.w.latest) { // the latest records are the hottest
+                uint64_t last = acked_.limit() - 1;
+                id = last - std::min(last, (uint64_t)zipf(gen));
+            } else {
+                id = zipf(gen);
+            }
+            _key_t key = key_of(id);
+
+            uint64_t start = now_ns();
+            switch(op) {
+                case Y_READ: {
+                    uint64_t val = tree_->lookup(key);
+                    if(val == 0) w.notfound++;
+                    else read_value(val, buf);
+                    break;
+                }
+                case Y_UPDATE: {
+                    tree_->update(key, make_value(t, id));
+                    break;
+                }
+                case Y_INSERT: {
+                    uint64_t new_id = next_id_.fetch_add(1, std::memory_order_relaxed);
+                    tree_->insert(key_of(new_id), make_value(t, new_id));
+                    acked_.ack(new_id);
+                    break;
+                }
+                case Y_SCAN: {
+                    uint64_t key_gap = (uint64_t)MAX_KEY / next_id_.load(std::memory_order_relaxed); // between neighbouring records
+                    _key_t hi = key + std::min((uint64_t)(MAX_KEY - key), key_gap * scan_len(gen));
+                    out.clear();
+                    tree_->scan(key, hi, out);
+                    w.scanned += out.size();
+                    break;
+                }
+                case Y_RMW: {
+                    uint64_t val = tree_->lookup(key);
+                    if(val == 0) w.notfound++;
+                    else read_value(val, buf);
+                    tree_->update(key, make_value(t, id));
+                    break;
+                }
+            }
+
+            if(phase == MEASURE) w.hists[op].record(now_ns() - start);
+            w.ops.store(w.ops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        delete [] buf;
+    }
+
+    void report(std::vector<Worker> & workers, double elapsed) {
+        Histogram total, hists[Y_OPS];
+        uint64_t notfound = 0, scanned = 0;
+        for(auto & w : workers) {
+            for(int op = 0; op < Y_OPS; op++) {
+                hists[op].merge(w.hists[op]);
+                total.merge(w.hists[op]);
+            }
+            notfound += w.notfound;
+            scanned += w.scanned;
+        }
+
+        printf("measured: %lu ops in %.2f s, %.3f Mops\n", total.count(), elapsed, total.count() / elapsed / 1e6);
+        printf("%-8s %12s %9s %9s %9s %9s %9s %9s %9s\n", "op", "count", "avg(us)", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+        for(int op = 0; op <= Y_OPS; op++) {
+            const Histogram & h = op < Y_OPS ? hists[op] : total;
+            if(h.count() == 0) continue;
+            printf("%-8s %12lu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", op < Y_OPS ? OP_NAMES[op] : "all",
+                h.count(), h.mean() / 1000, h.percentile(50) / 1000.0, h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+                h.percentile(99.9) / 1000.0, h.percentile(99.99) / 1000.0, h.max() / 1000.0);
+        }
+        if(notfound > 0) printf("%lu keys not found\n", notfound);
+        if(hists[Y_SCAN].count() > 0) printf("%.1f records per scan\n", (double)scanned / hists[Y_SCAN].count());
+    }
+};
+
+int main(int argc, char ** argv) {
+    Config cfg;
+    char opt_workload = 'a';
+
+    static const char * optstr = "w:n:t:v:z:u:d:r:f:ph";
+    opterr = 0;
+    char opt;
+    while((opt = getopt(argc, argv, optstr)) != -1) {
+        switch(opt) {
+        case 'w':
+            opt_workload = optarg[0] | 0x20; // lower case
+            break;
+        case 'n':
+            if(atol(optarg) > 0)
+                cfg.records = atol(optarg);
+            break;
+        case 't':
+            if(atoi(optarg) > 0)
+                cfg.threads = atoi(optarg);
+            break;
+        case 'v':
+            if(atoi(optarg) > 0)
+                cfg.value_size = atoi(optarg);
+            break;
+        case 'z':
+            cfg.theta = atof(optarg);
+            break;
+        case 'u':
+            cfg.warmup = atof(optarg);
+            break;
+        case 'd':
+            cfg.duration = atof(optarg);
+            break;
+        case 'r':
+            if(atoi(optarg) > 0)
+                cfg.window_ms = atoi(optarg);
+            break;
+        case 'f':
+            cfg.pool = string(optarg);
+            break;
+        case 'p':
+            cfg.counters = true;
+            break;
+        case '?':
+        case 'h':
+        default:
+            cout << "USAGE: "<< argv[0] << "[option]" << endl;
+            cout << "\t -h: " << "Print the USAGE" << endl;
+            cout << "\t -w: " << "YCSB workload, a to f" << endl;
+            cout << "\t -n: " << "Number of records to load" << endl;
+            cout << "\t -t: " << "Number of threads, pinned to cores" << endl;
+            cout << "\t -v: " << "Value size in bytes, values over 8 bytes are kept out of the tree" << endl;
+            cout << "\t -z: " << "Skewness of the zipfian distribution (0 - 1)" << endl;
+            cout << "\t -u: " << "Seconds of warm-up, not measured" << endl;
+            cout << "\t -d: " << "Seconds of measurement" << endl;
+            cout << "\t -r: " << "Milliseconds of a throughput report window" << endl;
+            cout << "\t -f: " << "The pool file, recreated by each run" << endl;
+            cout << "\t -p: " << "Report the hardware performance counters per operation of the load, the warm-up, the run and the rebuilds" << endl;
+            exit(-1);
+            break;
+        }
+    }
+
+    bool found = false;
+    for(const WorkloadSpec & w : WORKLOADS) {
+        if(w.name == opt_workload) {
+            cfg.w = w;
+            found = true;
+        }
+    }
+    if(!found || cfg.theta <= 0 || cfg.theta >= 1) {
+        cout << "Invalid workload configuration" << endl;
+        exit(-1);
+    }
+
+    Ycsb ycsb(cfg);
+    double load_time = ycsb.load();
+    printf("load: %lu records in %.2f s, %.3f Mops\n", cfg.records, load_time, cfg.records / load_time / 1e6);
+    ycsb.run();
+
+    return 0;
+}
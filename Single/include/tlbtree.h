@@ -1,10 +1,12 @@
 #ifndef __TLBTREE_H__
 #define __TLBTREE_H__
 
-#include "../src/tlbtree_impl.h"
+#include "../../Concurrent/src/tlbtree_impl.h" // the same code as Concurrent, without the latches
 
 using tlbtree::TLBtreeImpl;
 
+typedef TLBtreeImpl<2, 2, SingleOwnerPolicy> TLBtreeType;
+
 // configure the PMEM file and file size
 static constexpr uint64_t POOL_SIZE = 512UL * 1024 * 1024;
 
@@ -12,7 +14,7 @@ class TLBtree {
 public:
     TLBtree(std::string tlbname, uint64_t poolsize = POOL_SIZE) {
         bool recover = file_exist(tlbname.c_str());
-        tree_ = new TLBtreeImpl<2,2>(tlbname, recover, poolsize);
+        tree_ = new TLBtreeType(tlbname, recover, poolsize);
     }
 
     ~TLBtree() {
@@ -42,7 +44,7 @@ public:
     }
 
 private:
-    TLBtreeImpl <2,2> * tree_;
+    TLBtreeType * tree_;
 };
 
 #endif //__TLBTREE_H__
\ No newline at end of file
@@ -1,3 +0,0 @@
-#include "tlbtree_impl.h"
-
-PMAllocator * galc;
\ No newline at end of file
@@ -7,11 +7,13 @@
 #include <string>
 #include <random>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 #include <algorithm>
 
 #include "common.h"
 #include "zipfian.h"
+#include "workload.h"
 
 using std::cout;
 using std::endl;
@@ -19,8 +21,6 @@ using std::string;
 using std::ofstream;
 using std::ifstream;
 
-enum DistributionType {RAND = 0, ZIPFIAN};
-
 struct WorkloadType {
     int operations = KILO;
     float read = 1.0;
@@ -29,6 +29,7 @@ struct WorkloadType {
     float remove = 0;
     DistributionType dist = RAND;
     float skewness = 0.8;
+    uint64_t seed = 0;
     bool valid() {
         return read + insert + update + remove == 1.0 && skewness > 0 && skewness < 1.0;
     }
@@ -43,22 +44,18 @@ struct WorkloadType {
         if (dist == ZIPFIAN) {
             cout << "Skewness " << skewness << endl;
         }
+        cout << "Seed        : " << seed << endl;
         cout << "===============================" << endl;
     }
 };
 
-struct QueryType {
-    OperationType op;
-    int64_t key;
-};
-
 class OperationGenerator {
 public :
     OperationType mappings_[100];
     std::default_random_engine gen_;
     std::uniform_int_distribution<uint32_t> dist_;
 
-    OperationGenerator(WorkloadType &w) : gen_(getRandom()) {
+    OperationGenerator(WorkloadType &w) : gen_(w.seed) {
         int read_end = 100 * w.read;
         int insert_end = read_end + 100 * w.insert;
         int update_end = insert_end + 100 * w.update;
@@ -113,7 +110,8 @@ void gen_dataset(int64_t *arr, int64_t scale, bool random) {
 }
 
 void gen_workload(int64_t *arr, int64_t scale, QueryType * querys, WorkloadType w) {
-    std::mt19937 gen(getRandom());
+    std::mt19937 gen(w.seed);
+    std::mt19937_64 noise(w.seed + 1);
     std::uniform_int_distribution<int64_t> idx1_dist(0, scale - 1);
     zipfian_int_distribution<int64_t> idx2_dist(0, scale - 1, w.skewness);
     OperationGenerator op_gen(w);
@@ -122,9 +120,9 @@ void gen_workload(int64_t *arr, int64_t scale, QueryType * querys, WorkloadType
         OperationType op = op_gen.next();
         int idx = (w.dist == RAND ? idx1_dist(gen) : idx2_dist(gen));
         // for insert operations, we should make sure the key does not exist in the dataset
-        int64_t key = (op == OperationType::INSERT ? arr[idx] + getRandom(): arr[idx]); 
+        int64_t key = (op == OperationType::INSERT ? arr[idx] + (int64_t)(noise() % 1000000): arr[idx]); 
 
-        querys[i] = {op, key};
+        querys[i] = {op, 0, key};
     }
 }
 
@@ -132,8 +130,9 @@ int main(int argc, char ** argv) {
     static const bool DATASET_RANDOM = true;
     bool opt_zipfian  = false;
     WorkloadType w;
+    w.seed = getRandom();
 
-    static const char * optstr = "r:i:u:d:o:s:hz"; 
+    static const char * optstr = "r:i:u:d:o:s:e:hz"; 
     opterr = 0;
     char opt;
     while((opt = getopt(argc, argv, optstr)) != -1) {
@@ -156,6 +155,9 @@ int main(int argc, char ** argv) {
         case 'u':
             w.update = atof(optarg);
             break;
+        case 'e':
+            w.seed = strtoull(optarg, NULL, 10);
+            break;
         case 'z':
             opt_zipfian = true;
             break;
@@ -171,6 +173,7 @@ int main(int argc, char ** argv) {
             cout << "\t -i: " << "Insert ratio" << endl;
             cout << "\t -u: " << "update ratio" << endl;
             cout << "\t -d: " << "Delete ratio" << endl;
+            cout << "\t -e: " << "Seed of the generator, the same seed makes the same workload (Not specified: random)" << endl;
             exit(-1);
         }
     }
@@ -204,17 +207,27 @@ int main(int argc, char ** argv) {
         fin.close();
     }
 
-    QueryType * querys = new QueryType[w.operations];
+    WorkloadHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = WorkloadHeader::MAGIC;
+    header.version = WorkloadHeader::VERSION;
+    header.dist = w.dist;
+    header.count = w.operations;
+    header.seed = w.seed;
+    header.read = w.read;
+    header.insert = w.insert;
+    header.update = w.update;
+    header.remove = w.remove;
+    header.skewness = w.skewness;
+    header.query_size = sizeof(QueryType);
+    header.scale = scale;
+    header.key_gap = std::max((uint64_t)1, (uint64_t)MAX_KEY / scale); // the random dataset spreads its keys evenly
+
+    QueryType * querys = WorkloadFile::create("workload.dat", header);
     gen_workload(arr, scale, querys, w);
-    
-    ofstream fout("workload.txt");
-    for(int i = 0; i < w.operations; i++) {
-        fout << querys[i].op << " " << querys[i].key << endl;
-    }
-    fout.close();
+    WorkloadFile::finish(querys, w.operations);
     cout << "generate a query workload file" << endl;
 
     delete [] arr;
-    delete [] querys;
     return 0;
 }
\ No newline at end of file
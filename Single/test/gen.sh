@@ -7,24 +7,24 @@ fi
 
 # Random RO
 ./datagen -o $scale -r 1 -i 0
-mv workload.txt workload1.txt
+mv workload.dat workload1.dat
 
 # Random RW
 ./datagen -o $scale -r 0.5 -i 0.5
-mv workload.txt workload2.txt
+mv workload.dat workload2.dat
 
 # Random WO
 ./datagen -o $scale -r 0 -i 1
-mv workload.txt workload3.txt
+mv workload.dat workload3.dat
 
 # Zipfian RO
 ./datagen -o $scale -r 1 -i 0 -z -s 0.7
-mv workload.txt workload4.txt
+mv workload.dat workload4.dat
 
 # Zipfian RW
 ./datagen -o $scale -r 0.5 -i 0.5 -z -s 0.7
-mv workload.txt workload5.txt
+mv workload.dat workload5.dat
 
 # Zipfian WO
 ./datagen -o $scale -r 0 -i 1 -z -s 0.7
-mv workload.txt workload6.txt
\ No newline at end of file
+mv workload.dat workload6.dat
\ No newline at end of file
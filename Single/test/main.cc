@@ -3,7 +3,6 @@
     USE AT YOUR OWN RISK!
 */
 #include <iostream>
-#include <fstream>
 #include <cstdint>
 #include <cstdlib>
 #include <vector>
@@ -11,24 +10,25 @@
 #include <algorithm>
 
 #include "tlbtree.h"
+#include "workload.h"
 
 using std::cout;
 using std::endl;
-using std::ifstream;
 using std::string;
 
 template<typename BTreeType>
-double run_test(ifstream & fin) {
+double run_test(const WorkloadFile & workload) {
     int small_noise = getRandom() & 0x3ff; // each time we run, we will insert different keys
     
     auto start = seconds();
 
     BTreeType tree("/mnt/pmem/tlbtree.pool");
-    int op_id, notfound = 0;
-    _key_t key;
+    const QueryType * querys = workload.querys();
+    int notfound = 0;
     uint64_t val;
-    for(int i = 0; fin >> op_id >> key; i++) {
-        switch (op_id) {
+    for(size_t i = 0; i < workload.size(); i++) {
+        _key_t key = querys[i].key;
+        switch (querys[i].op) {
             case OperationType::INSERT:
                 tree.insert(key + small_noise, uint64_t(key + small_noise));
                 break;
@@ -43,6 +43,8 @@ double run_test(ifstream & fin) {
             case OperationType::DELETE:
                 tree.remove(key);
                 break;
+            case OperationType::SCAN: // the workloads of Concurrent may have them, Single has no range query
+                break;
             default:
                 cout << "wrong operation id" << endl;
                 break;
@@ -56,7 +58,7 @@ double run_test(ifstream & fin) {
 
 int main(int argc, char ** argv) {
     int opt_testid = 1;
-    string opt_fname = "workload.txt";
+    string opt_fname = "workload.dat";
 
     if(argc > 1) {
         if(file_exist(argv[1]))
@@ -65,11 +67,10 @@ int main(int argc, char ** argv) {
             cout << "workload file "<< argv[1] << " not exist" << endl;
     }
 
-    ifstream fin(opt_fname.c_str());
+    WorkloadFile workload(opt_fname.c_str());
     double time = 0;
-    time = run_test<TLBtree>(fin);
+    time = run_test<TLBtree>(workload);
     
     cout << time << endl;
-    fin.close();
     return 0;
 }
\ No newline at end of file
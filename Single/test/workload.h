@@ -0,0 +1,11 @@
+/*  workload.h - The binary workload file of the benchmark drivers
+    Copyright(c) 2020 Luo Yongping. THIS SOFTWARE COMES WITH NO WARRANTIES,
+    USE AT YOUR OWN RISK!
+*/
+
+#ifndef __SINGLE_WORKLOAD_H__
+#define __SINGLE_WORKLOAD_H__
+
+#include "../../Concurrent/test/workload.h" // one file format for the drivers of Single and Concurrent
+
+#endif //__SINGLE_WORKLOAD_H__